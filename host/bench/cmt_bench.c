@@ -0,0 +1,453 @@
+/**
+ * CMT Host Benchmark.
+ *
+ * Runs the CMT message loops on the host (the cores are threads) and measures:
+ *  Ping-Pong:   Round trips of a message between the cores (post, handle, post back).
+ *  Burst:       Messages posted from core 0 to core 1 as fast as they are taken.
+ *  ms Schedule: Lateness of messages scheduled with `schedule_core0_msg_in_ms` (1ms tick).
+ *  µs Timer:    Lateness of `cmt_run_after_us` (hardware alarm).
+ *  Periodic:    Interval jitter and total drift of a periodic timer.
+ *
+ * The phases are run in turn from messages on core 0, then the results are printed and
+ * checked against the pass/fail limits (BENCH_xxx_MIN/MAX, which can be set for a build).
+ *
+ *   cmt_bench [iterations]     (default 20000 for the throughput phases)
+ *
+ * Exits with 1 if a result is outside its limit.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt.h"
+#include "cmt_periodic.h"
+#include "multicore.h"
+#include "hwrt/hwrt.h"  // For `core1_main`
+
+#include "board.h"
+#include "picoutil.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_ITERATIONS_DEFAULT    20000
+#define BENCH_SCHED_SAMPLES         200
+#define BENCH_SCHED_MS_MAX          4       // Scheduled delays are 1..BENCH_SCHED_MS_MAX ms
+#define BENCH_US_TIMER_SAMPLES      1000
+#define BENCH_US_TIMER_US           250
+#define BENCH_PERIODIC_SAMPLES      200
+#define BENCH_PERIODIC_MS           5
+#define BENCH_POST_TIMEOUT_US       ONE_SECOND_US
+#define BENCH_RPC_TIMEOUT_MS        1000    // The RPC that completes (its timeout is cancelled)
+#define BENCH_RPC_SLOW_TIMEOUT_MS   10      // The RPC that times out...
+#define BENCH_RPC_SLOW_RUN_MS       200     // ...because its handler runs this long (less than CMT_STUCK_MS)
+
+// Pass/fail limits. They are loose, so that a loaded host (CI) passes, but a
+// regression (a lost wakeup, a timer that drifts) fails. The host can preempt the
+// bench for several ms at any time, so the average lateness is held to a tight
+// limit, and a single (max) sample only to a ceiling that a lost wakeup exceeds.
+#ifndef BENCH_MSGS_PER_SEC_MIN
+#define BENCH_MSGS_PER_SEC_MIN      100000  // Ping-Pong and Burst throughput floor
+#endif
+#ifndef BENCH_LATE_AVG_MAX_US
+#define BENCH_LATE_AVG_MAX_US       1000    // ms Schedule and µs Timer average lateness limit
+#endif
+#ifndef BENCH_LATE_MAX_US
+#define BENCH_LATE_MAX_US           100000  // ms Schedule and µs Timer lateness ceiling
+#endif
+#ifndef BENCH_JITTER_MAX_US
+#define BENCH_JITTER_MAX_US         (BENCH_PERIODIC_MS * 10000) // Periodic interval jitter ceiling
+#endif
+#ifndef BENCH_DRIFT_MAX_US
+#define BENCH_DRIFT_MAX_US          1000    // Periodic total drift bound (±)
+#endif
+
+/**
+ * @brief Latency (or jitter) accumulator (µs).
+ */
+typedef struct BENCH_LAT_ {
+    uint32_t n;
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+} bench_lat_t;
+
+static void _phase_pingpong(void);
+static void _phase_burst(void);
+static void _phase_sched_ms(void);
+static void _phase_us_timer(void);
+static void _phase_periodic(void);
+static void _phase_rpc(void);
+static void _report(void);
+
+// ######################################################################################
+// Data                                                                               ###
+// ######################################################################################
+
+static uint32_t _iterations = BENCH_ITERATIONS_DEFAULT;
+
+static uint64_t _t_start;
+static uint32_t _count;
+
+static uint64_t _t_pingpong;
+static uint64_t _t_burst;
+static uint32_t _burst_post_fails;
+static volatile uint32_t _burst_received;
+
+static uint64_t _t_sched;
+static int32_t _sched_ms;
+static bench_lat_t _lat_sched_ms;
+
+static bench_lat_t _lat_us_timer;
+
+static cmt_periodic_t _periodic;
+static uint64_t _t_periodic_first;
+static uint64_t _t_periodic_last;
+static uint32_t _exp_periodic_first;
+static uint32_t _exp_periodic_last;
+static bench_lat_t _jitter_periodic;
+
+static bool _rpc_fast_ok;
+static uint32_t _rpc_slow_calls;
+static rpc_status_t _rpc_slow_status;
+static int _rpc_inflight_end;
+static int64_t _drift_periodic;
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+static void _lat_record(bench_lat_t* lat, int64_t v) {
+    if (lat->n == 0 || v < lat->min) {
+        lat->min = v;
+    }
+    if (lat->n == 0 || v > lat->max) {
+        lat->max = v;
+    }
+    lat->sum += v;
+    lat->n++;
+}
+
+static bool _check(bool ok, const char* what, double value, double limit) {
+    if (!ok) {
+        printf("FAIL: %s %.0f (limit %.0f)\n", what, value, limit);
+    }
+    return (ok);
+}
+
+static int64_t _lat_avg(const bench_lat_t* lat) {
+    return (lat->n ? lat->sum / lat->n : 0);
+}
+
+static void _lat_print(const char* name, const bench_lat_t* lat) {
+    printf("%-12s n=%-6u min=%-6lld avg=%-6lld max=%-6lld (us)\n", name, lat->n,
+        (long long)lat->min, (long long)_lat_avg(lat), (long long)lat->max);
+}
+
+static void _post_exec_to_core(uint8_t corenum, msg_handler_fn hdlr, uint32_t value) {
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, hdlr);
+    msg.data.value32u = value;
+    if (corenum == 0) {
+        post_to_core0(&msg);
+    }
+    else {
+        post_to_core1(&msg);
+    }
+}
+
+
+// ######################################################################################
+// Ping-Pong                                                                          ###
+// ######################################################################################
+
+static void _pingpong_core0(cmt_msg_t* msg);
+
+static void _pingpong_core1(cmt_msg_t* msg) {
+    _post_exec_to_core(0, _pingpong_core0, msg->data.value32u);
+}
+
+static void _pingpong_core0(cmt_msg_t* msg) {
+    if (++_count < _iterations) {
+        _post_exec_to_core(1, _pingpong_core1, _count);
+        return;
+    }
+    _t_pingpong = now_us() - _t_start;
+    _phase_burst();
+}
+
+static void _phase_pingpong(void) {
+    _count = 0;
+    _t_start = now_us();
+    _post_exec_to_core(1, _pingpong_core1, _count);
+}
+
+
+// ######################################################################################
+// Burst                                                                              ###
+// ######################################################################################
+
+static void _burst_done(cmt_msg_t* msg) {
+    _t_burst = now_us() - _t_start;
+    _phase_sched_ms();
+}
+
+static void _burst_core1(cmt_msg_t* msg) {
+    if (++_burst_received == _iterations - _burst_post_fails) {
+        _post_exec_to_core(0, _burst_done, 0);
+    }
+}
+
+static void _burst_send(cmt_msg_t* msg) {
+    // Post them all from this one handler (core 0 doesn't take messages meanwhile).
+    cmt_msg_t bmsg;
+    cmt_exec_init(&bmsg, _burst_core1);
+    for (uint32_t i = 0; i < _iterations; i++) {
+        bmsg.data.value32u = i;
+        if (!post_to_core1_wait(&bmsg, BENCH_POST_TIMEOUT_US)) {
+            _burst_post_fails++;
+        }
+    }
+}
+
+static void _phase_burst(void) {
+    _burst_post_fails = 0;
+    _burst_received = 0;
+    _t_start = now_us();
+    _post_exec_to_core(0, _burst_send, 0);
+}
+
+
+// ######################################################################################
+// Scheduled Messages (ms)                                                            ###
+// ######################################################################################
+
+static void _sched_ms_next(void);
+
+static void _sched_ms_due(cmt_msg_t* msg) {
+    _lat_record(&_lat_sched_ms, (int64_t)(now_us() - _t_sched) - ((int64_t)_sched_ms * 1000));
+    if (++_count < BENCH_SCHED_SAMPLES) {
+        _sched_ms_next();
+        return;
+    }
+    _phase_us_timer();
+}
+
+static void _sched_ms_next(void) {
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, _sched_ms_due);
+    _sched_ms = 1 + (int32_t)(_count % BENCH_SCHED_MS_MAX);
+    _t_sched = now_us();
+    schedule_core0_msg_in_ms(_sched_ms, &msg);
+}
+
+static void _phase_sched_ms(void) {
+    _count = 0;
+    _sched_ms_next();
+}
+
+
+// ######################################################################################
+// Microsecond Timers                                                                 ###
+// ######################################################################################
+
+static void _us_timer_next(void);
+
+static void _us_timer_due(void* user_data) {
+    _lat_record(&_lat_us_timer, (int64_t)(now_us() - _t_sched) - BENCH_US_TIMER_US);
+    if (++_count < BENCH_US_TIMER_SAMPLES) {
+        _us_timer_next();
+        return;
+    }
+    _phase_periodic();
+}
+
+static void _us_timer_next(void) {
+    _t_sched = now_us();
+    if (cmt_run_after_us(BENCH_US_TIMER_US, _us_timer_due, NULL) < 0) {
+        board_panic("!!! cmt_bench: No microsecond timer available !!!");
+    }
+}
+
+static void _phase_us_timer(void) {
+    _count = 0;
+    _us_timer_next();
+}
+
+
+// ######################################################################################
+// Periodic Timer                                                                     ###
+// ######################################################################################
+
+static void _periodic_done(cmt_msg_t* msg) {
+    _phase_rpc();
+}
+
+static void _periodic_fn(cmt_periodic_t* pt) {
+    // The timer skips the expirations missed while the host held the bench off, so the
+    // interval and the drift are measured against the expirations (not the runs).
+    uint64_t now = now_us();
+    uint32_t exp = pt->handled;
+    if (_count == 0) {
+        _t_periodic_first = now;
+        _exp_periodic_first = exp;
+    }
+    else {
+        _lat_record(&_jitter_periodic, (int64_t)(now - _t_periodic_last) - ((int64_t)(exp - _exp_periodic_last) * BENCH_PERIODIC_MS * 1000));
+    }
+    _t_periodic_last = now;
+    _exp_periodic_last = exp;
+    if (++_count == BENCH_PERIODIC_SAMPLES) {
+        cmt_periodic_stop(pt);
+        _drift_periodic = (int64_t)(now - _t_periodic_first) - ((int64_t)(exp - _exp_periodic_first) * BENCH_PERIODIC_MS * 1000);
+        _post_exec_to_core(0, _periodic_done, 0);
+    }
+}
+
+static void _phase_periodic(void) {
+    _count = 0;
+    cmt_periodic_start(&_periodic);
+}
+
+
+// ######################################################################################
+// Cross-Core RPC                                                                     ###
+// ######################################################################################
+
+static void _rpc_fast_core1(cmt_msg_t* msg) {
+    msg->data.value32u++;
+}
+
+static void _rpc_slow_core1(cmt_msg_t* msg) {
+    busy_wait_us(BENCH_RPC_SLOW_RUN_MS * 1000);
+}
+
+static void _rpc_check(cmt_msg_t* msg) {
+    // The slow handler has finished (its completion was discarded), so the slot is free.
+    _rpc_inflight_end = rpc_inflight();
+    _report();
+}
+
+static void _rpc_slow_done(cmt_msg_t* msg, rpc_status_t status, void* user_data) {
+    _rpc_slow_status = status;
+    if (++_rpc_slow_calls == 1) {
+        cmt_msg_t cmsg;
+        cmt_exec_init(&cmsg, _rpc_check);
+        schedule_core0_msg_in_ms(BENCH_RPC_SLOW_RUN_MS * 2, &cmsg);
+    }
+}
+
+static void _rpc_fast_done(cmt_msg_t* msg, rpc_status_t status, void* user_data) {
+    _rpc_fast_ok = (status == RPC_DONE && msg->data.value32u == 42);
+    cmt_msg_t smsg;
+    cmt_exec_init(&smsg, _rpc_slow_core1);
+    if (rpc_on_core(1, &smsg, _rpc_slow_done, NULL, BENCH_RPC_SLOW_TIMEOUT_MS) < 0) {
+        board_panic("!!! cmt_bench: RPC not available !!!");
+    }
+}
+
+static void _phase_rpc(void) {
+    // One RPC that completes (with a result), and one that times out while it runs.
+    _rpc_slow_calls = 0;
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, _rpc_fast_core1);
+    msg.data.value32u = 41;
+    if (rpc_on_core(1, &msg, _rpc_fast_done, NULL, BENCH_RPC_TIMEOUT_MS) < 0) {
+        board_panic("!!! cmt_bench: RPC not available !!!");
+    }
+}
+
+
+// ######################################################################################
+// Report                                                                             ###
+// ######################################################################################
+
+static void _report(void) {
+    double pingpong_rate = (2.0 * _iterations * ONE_SECOND_US) / (double)(_t_pingpong ? _t_pingpong : 1);
+    double burst_rate = ((double)_burst_received * ONE_SECOND_US) / (double)(_t_burst ? _t_burst : 1);
+    printf("\nCMT Host Benchmark (%u iterations)\n", _iterations);
+    printf("Ping-Pong:   %u round trips in %llu us: %.2f us/round trip, %.0f msgs/sec\n",
+        _iterations, (unsigned long long)_t_pingpong, (double)_t_pingpong / _iterations, pingpong_rate);
+    printf("Burst:       %u msgs (%u failed posts) in %llu us: %.0f msgs/sec\n",
+        _iterations, _burst_post_fails, (unsigned long long)_t_burst, burst_rate);
+    _lat_print("ms Schedule:", &_lat_sched_ms);
+    _lat_print("us Timer:", &_lat_us_timer);
+    _lat_print("Periodic:", &_jitter_periodic);
+    printf("             Periodic drift over %lu periods (%lu skipped): %lld us\n",
+        (unsigned long)(_exp_periodic_last - _exp_periodic_first), (unsigned long)_periodic.skipped, (long long)_drift_periodic);
+    printf("RPC:         Completed: %s  Timed out: %s (done calls: %lu)  In-flight after: %d\n",
+        (_rpc_fast_ok ? "ok" : "BAD"), (_rpc_slow_status == RPC_TIMEOUT ? "ok" : "BAD"),
+        (unsigned long)_rpc_slow_calls, _rpc_inflight_end);
+    uint32_t stuck = 0;
+    for (uint8_t corenum = 0; corenum < 2; corenum++) {
+        cmt_budget_viol_t rec;
+        uint32_t cnt = cmt_stuck_get(corenum, &rec);
+        printf("Core %hhu:      Budget violations: %lu  Stuck: %lu\n", corenum,
+            cmt_budget_viol_total(corenum), cnt);
+        stuck += cnt;
+    }
+    static const char* pnames[CMT_POOL_CNT] = { "Handlers", "Scheduled", "us-Timers" };
+    for (int pool = 0; pool < CMT_POOL_CNT; pool++) {
+        cmt_pool_stats_t stats;
+        if (cmt_pool_stats((cmt_pool_id_t)pool, &stats)) {
+            printf("Pool %-9s Size: %u  Peak: %u\n", pnames[pool], stats.size, stats.peak);
+        }
+    }
+    int64_t drift = (_drift_periodic < 0 ? -_drift_periodic : _drift_periodic);
+    bool ok = _check(pingpong_rate >= BENCH_MSGS_PER_SEC_MIN, "Ping-Pong msgs/sec", pingpong_rate, BENCH_MSGS_PER_SEC_MIN);
+    ok = _check(burst_rate >= BENCH_MSGS_PER_SEC_MIN, "Burst msgs/sec", burst_rate, BENCH_MSGS_PER_SEC_MIN) && ok;
+    ok = _check(_burst_post_fails == 0, "Burst failed posts", _burst_post_fails, 0) && ok;
+    ok = _check(_lat_avg(&_lat_sched_ms) <= BENCH_LATE_AVG_MAX_US, "ms Schedule avg late (us)", (double)_lat_avg(&_lat_sched_ms), BENCH_LATE_AVG_MAX_US) && ok;
+    ok = _check(_lat_sched_ms.max <= BENCH_LATE_MAX_US, "ms Schedule max late (us)", (double)_lat_sched_ms.max, BENCH_LATE_MAX_US) && ok;
+    ok = _check(_lat_us_timer.min >= 0, "us Timer min late (us)", (double)_lat_us_timer.min, 0) && ok;
+    ok = _check(_lat_avg(&_lat_us_timer) <= BENCH_LATE_AVG_MAX_US, "us Timer avg late (us)", (double)_lat_avg(&_lat_us_timer), BENCH_LATE_AVG_MAX_US) && ok;
+    ok = _check(_lat_us_timer.max <= BENCH_LATE_MAX_US, "us Timer max late (us)", (double)_lat_us_timer.max, BENCH_LATE_MAX_US) && ok;
+    ok = _check(_jitter_periodic.max <= BENCH_JITTER_MAX_US, "Periodic max jitter (us)", (double)_jitter_periodic.max, BENCH_JITTER_MAX_US) && ok;
+    ok = _check(drift <= BENCH_DRIFT_MAX_US, "Periodic drift (us)", (double)_drift_periodic, BENCH_DRIFT_MAX_US) && ok;
+    ok = _check(stuck == 0, "Stuck handlers", stuck, 0) && ok;
+    ok = _check(_rpc_fast_ok, "RPC completion ok", _rpc_fast_ok, 1) && ok;
+    ok = _check(_rpc_slow_calls == 1 && _rpc_slow_status == RPC_TIMEOUT, "RPC timeout calls", _rpc_slow_calls, 1) && ok;
+    ok = _check(_rpc_inflight_end == 0, "RPC in-flight after", _rpc_inflight_end, 0) && ok;
+    printf("CMT checks: %s\n", (ok ? "pass" : "FAIL"));
+    fflush(stdout);
+    exit(ok ? 0 : 1);
+}
+
+
+// ######################################################################################
+// Startup                                                                            ###
+// ######################################################################################
+
+static void _bench_start(cmt_msg_t* msg) {
+    _phase_pingpong();
+}
+
+static void _core1_started(cmt_msg_t* msg) {
+    // Both loops are running. Start the first phase on core 0.
+    _post_exec_to_core(0, _bench_start, 0);
+}
+
+static void _core0_started(cmt_msg_t* msg) {
+    cmt_periodic_init(&_periodic, "bench", BENCH_PERIODIC_MS, 0, CMT_PERIODIC_SKIP, _periodic_fn, NULL, 1);
+    start_core1();
+}
+
+void core1_main(void) {
+    message_loop(_core1_started);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        _iterations = (uint32_t)strtoul(argv[1], NULL, 0);
+        if (_iterations == 0) {
+            fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+            return (1);
+        }
+    }
+    multicore_modinit(false);
+    cmt_modinit();
+    message_loop(_core0_started);
+    return (0);
+}
@@ -0,0 +1,276 @@
+/**
+ * SD CRC Host Benchmark.
+ *
+ * Checks that the CRC16 kernels of the SD driver (`sd_driver/crc.c`) agree with a
+ * bitwise reference (and each other), that the data CRC computed by the driver's SPI
+ * transfers (`sd_driver/spi.c`, run on a model of the SPI, DMA, and DMA sniffer in
+ * `shim/spi_host.c`) agrees with `crc16()`, and that the precomputed command CRC7 values
+ * are correct, then reports the throughput (MB/s) of each CRC16 kernel.
+ *
+ *   crc_bench [MB]     (default 64 MB per kernel)
+ *
+ * Exits with 1 if a check fails.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "crc.h"
+#include "host_spi.h"
+#include "spi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MB_DEFAULT    64
+#define BENCH_BLOCK_SIZE    512     // An SD data block
+#define CHECK_LEN_MAX       600
+#define CHECK_ROUNDS        200
+
+typedef uint16_t (*crc16_kernel_fn)(uint16_t crc, const uint8_t* data, size_t length);
+
+typedef struct CRC16_KERNEL_ {
+    const char* name;
+    crc16_kernel_fn fn;
+} crc16_kernel_t;
+
+static const crc16_kernel_t _kernels[] = {
+    { "bytewise", crc16_bytewise },
+    { "slice-4", crc16_slice4 },
+    { "slice-8", crc16_slice8 },
+};
+#define KERNEL_CNT (sizeof(_kernels) / sizeof(_kernels[0]))
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+}
+
+static uint16_t _crc16_bitwise(uint16_t crc, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return (crc);
+}
+
+static bool _check_crc16(void) {
+    static uint8_t buf[CHECK_LEN_MAX + 8];
+    bool ok = true;
+    // The standard check value (CRC-16/XMODEM, as used by SD)
+    const uint8_t* check = (const uint8_t*)"123456789";
+    for (size_t k = 0; k < KERNEL_CNT; k++) {
+        uint16_t crc = _kernels[k].fn(0, check, 9);
+        if (crc != 0x31C3) {
+            printf("FAIL: %s check value 0x%04X (expected 0x31C3)\n", _kernels[k].name, crc);
+            ok = false;
+        }
+    }
+    // Random data, at all lengths and alignments, continuing a random CRC
+    srand(1);
+    for (int round = 0; round < CHECK_ROUNDS; round++) {
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            buf[i] = (uint8_t)rand();
+        }
+        size_t len = (size_t)rand() % (CHECK_LEN_MAX + 1);
+        size_t offset = (size_t)round % 8;
+        uint16_t seed = (round & 1) ? (uint16_t)rand() : 0;
+        uint16_t ref = _crc16_bitwise(seed, buf + offset, len);
+        for (size_t k = 0; k < KERNEL_CNT; k++) {
+            uint16_t crc = _kernels[k].fn(seed, buf + offset, len);
+            if (crc != ref) {
+                printf("FAIL: %s len:%zu offset:%zu seed:0x%04X = 0x%04X (expected 0x%04X)\n",
+                    _kernels[k].name, len, offset, seed, crc, ref);
+                ok = false;
+            }
+        }
+    }
+    // The public API (the configured kernel)
+    uint16_t upd = 0;
+    update_crc16(&upd, (const char*)buf, 100);
+    update_crc16(&upd, (const char*)buf + 100, 412);
+    if (crc16((const char*)buf, 512) != _crc16_bitwise(0, buf, 512) || upd != _crc16_bitwise(0, buf, 512)) {
+        printf("FAIL: crc16/update_crc16\n");
+        ok = false;
+    }
+    return (ok);
+}
+
+static void _spi_dma_isr(void);
+
+static spi_t _spi = {
+    .hw_inst = spi0,
+    .initSPI = false,
+    .dma_isr = _spi_dma_isr,
+};
+
+static void _spi_dma_isr(void) {
+    spi_irq_handler(&_spi);
+}
+
+static void _async_done(void* ctx) {
+    *(bool*)ctx = true;
+}
+
+// The bytes the sniffer should have computed the CRC of for a transfer.
+static uint32_t _sniff_expected(size_t length, bool dma) {
+    return ((dma && _spi.dma_crc) ? (uint32_t)length : 0);
+}
+
+static bool _check_xfer(const char* what, uint16_t crc, uint16_t ref, uint32_t sniffed, uint32_t sniff_ref, size_t length) {
+    if (crc != ref || sniffed != sniff_ref) {
+        printf("FAIL: spi %s dma_crc:%d len:%zu = 0x%04X sniffed %u (expected 0x%04X sniffed %u)\n",
+            what, _spi.dma_crc, length, crc, sniffed, ref, sniff_ref);
+        return (false);
+    }
+    return (true);
+}
+
+static bool _check_sniffer(void) {
+    static uint8_t block[BENCH_BLOCK_SIZE];
+    static uint8_t rx[BENCH_BLOCK_SIZE];
+    bool ok = true;
+    // my_spi_init checks the sniffer against crc16() (spi_dma_crc_check), and only uses
+    // it if they agree.
+    static spi_t spi_bad = { .hw_inst = spi1, .initSPI = false };
+    host_dma_sniffer_fault(true);
+    my_spi_init(&spi_bad);
+    host_dma_sniffer_fault(false);
+    my_spi_init(&_spi);
+    if (!_spi.dma_crc || spi_bad.dma_crc) {
+        printf("FAIL: spi sniffer init check (good:%d faulty:%d)\n", _spi.dma_crc, spi_bad.dma_crc);
+        ok = false;
+    }
+    srand(2);
+    for (int round = 0; round < CHECK_ROUNDS; round++) {
+        for (size_t i = 0; i < sizeof(block); i++) {
+            block[i] = (uint8_t)rand();
+        }
+        _spi.dma_crc = !(round & 1);    // As if the sniffer had failed its check
+        // Lengths on both sides of SPI_POLLED_MAX, and whole blocks
+        size_t len = ((round & 2) ? sizeof(block) : (size_t)rand() % (2 * SPI_POLLED_MAX + 1) + 1);
+        bool dma = (len > SPI_POLLED_MAX);
+        // sd_write_block: the block from 0 (the CRC is of the TX data)
+        uint16_t crc = 0;
+        host_dma_sniffed(true);
+        host_spi_miso(NULL);
+        spi_transfer_crc(&_spi, block, NULL, len, &crc);
+        ok = _check_xfer("write", crc, crc16((const char*)block, len), host_dma_sniffed(true), _sniff_expected(len, dma), len) && ok;
+        // sd_read_block: the start of the data comes with the token (sd_data_crc_start),
+        // the rest is read continuing its CRC (the CRC is of the RX data, from the card).
+        size_t got = (size_t)rand() % (len + 1);
+        crc = 0;
+        if (got) {
+            update_crc16(&crc, (const char*)block, got);
+        }
+        host_spi_miso(block + got);
+        bool rest_dma = (len - got > SPI_POLLED_MAX);
+        if (got < len) {
+            spi_transfer_crc(&_spi, NULL, rx + got, len - got, &crc);
+        }
+        // A polled transfer reads the loopback (the fill), a DMA transfer the card data.
+        uint16_t ref = 0;
+        update_crc16(&ref, (const char*)block, got);
+        update_crc16(&ref, (const char*)rx + got, len - got);
+        if (rest_dma && memcmp(rx + got, block + got, len - got) != 0) {
+            printf("FAIL: spi read data len:%zu got:%zu\n", len, got);
+            ok = false;
+        }
+        ok = _check_xfer("read", crc, ref, host_dma_sniffed(true), _sniff_expected(len - got, rest_dma), len) && ok;
+        // sd_read_blocks_async: a block started and finished later (always DMA)
+        bool done = false;
+        crc = 0;
+        host_spi_miso(block);
+        spi_transfer_start(&_spi, NULL, rx, len, &crc, _async_done, &done);
+        spi_transfer_end(&_spi);
+        if (!done || memcmp(rx, block, len) != 0) {
+            printf("FAIL: spi async read len:%zu done:%d\n", len, done);
+            ok = false;
+        }
+        ok = _check_xfer("async read", crc, crc16((const char*)block, len), host_dma_sniffed(true), _sniff_expected(len, true), len) && ok;
+    }
+    host_spi_miso(NULL);
+    return (ok);
+}
+
+static bool _check_crc7(void) {
+    static const struct {
+        uint8_t cmd;
+        uint32_t arg;
+        uint8_t crc;
+    } cmds[] = {
+        { 0, 0, CRC7_CMD0_ARG0 },
+        { 8, 0x1AA, CRC7_CMD8_ARG1AA },
+        { 13, 0, CRC7_CMD13_ARG0 },
+        { 55, 0, CRC7_CMD55_ARG0 },
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+        char packet[5] = {
+            (char)(0x40 | cmds[i].cmd), (char)(cmds[i].arg >> 24), (char)(cmds[i].arg >> 16),
+            (char)(cmds[i].arg >> 8), (char)cmds[i].arg };
+        uint8_t crc = (uint8_t)((crc7(packet, 5) << 1) | 0x01);
+        if (crc != cmds[i].crc) {
+            printf("FAIL: CMD%hhu CRC7 0x%02X (precomputed 0x%02X)\n", cmds[i].cmd, crc, cmds[i].crc);
+            ok = false;
+        }
+    }
+    return (ok);
+}
+
+static void _bench(uint32_t mb) {
+    static uint8_t block[BENCH_BLOCK_SIZE];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (uint8_t)(i * 37 + 11);
+    }
+    uint32_t blocks = (mb * 1024u * 1024u) / BENCH_BLOCK_SIZE;
+    printf("\nCRC16 of %u MB (%u byte blocks)\n", mb, BENCH_BLOCK_SIZE);
+    for (size_t k = 0; k < KERNEL_CNT; k++) {
+        volatile uint16_t sink = 0;
+        uint64_t t = _now_ns();
+        for (uint32_t b = 0; b < blocks; b++) {
+            block[0] = (uint8_t)b;  // Keep the compiler from hoisting the CRC
+            sink ^= _kernels[k].fn(0, block, sizeof(block));
+        }
+        t = _now_ns() - t;
+        printf("%-9s %8.1f MB/s  %6.2f ns/byte\n", _kernels[k].name,
+            ((double)mb * 1e9) / (double)(t ? t : 1), (double)t / ((double)blocks * BENCH_BLOCK_SIZE));
+    }
+}
+
+
+// ######################################################################################
+// Main                                                                               ###
+// ######################################################################################
+
+int main(int argc, char** argv) {
+    uint32_t mb = BENCH_MB_DEFAULT;
+    if (argc > 1) {
+        mb = (uint32_t)strtoul(argv[1], NULL, 0);
+        if (mb == 0) {
+            fprintf(stderr, "usage: %s [MB]\n", argv[0]);
+            return (1);
+        }
+    }
+    bool ok = _check_crc16();
+    ok = _check_sniffer() && ok;
+    ok = _check_crc7() && ok;
+    printf("CRC checks: %s\n", (ok ? "pass" : "FAIL"));
+    if (!ok) {
+        return (1);
+    }
+    _bench(mb);
+    return (0);
+}
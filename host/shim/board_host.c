@@ -0,0 +1,68 @@
+/**
+ * Host (Linux) Shim - The board and pico helper functions used by CMT and multicore.
+ *
+ * Output goes to stdout and a panic ends the process.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "board.h"
+#include "debug_support.h"
+#include "picoutil.h"
+
+#include "pico/time.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+volatile uint16_t debugging_flags;
+
+char shared_print_buf[SHARED_PRINT_BUF_SIZE];
+
+void board_panic(const char* fmt, ...) {
+    va_list xArgs;
+    va_start(xArgs, fmt);
+    fprintf(stderr, "\n*** PANIC ***\n");
+    vfprintf(stderr, fmt, xArgs);
+    fprintf(stderr, "\n");
+    va_end(xArgs);
+    abort();
+}
+
+void debug_printf(const char* format, ...) {
+    va_list xArgs;
+    va_start(xArgs, format);
+    vprintf(format, xArgs);
+    va_end(xArgs);
+}
+
+void error_printf(const char* format, ...) {
+    va_list xArgs;
+    va_start(xArgs, format);
+    vfprintf(stderr, format, xArgs);
+    va_end(xArgs);
+}
+
+void info_printf(const char* format, ...) {
+    va_list xArgs;
+    va_start(xArgs, format);
+    vprintf(format, xArgs);
+    va_end(xArgs);
+}
+
+void warn_printf(const char* format, ...) {
+    va_list xArgs;
+    va_start(xArgs, format);
+    vprintf(format, xArgs);
+    va_end(xArgs);
+}
+
+uint32_t now_ms() {
+    return ((uint32_t)(time_us_64() / 1000));
+}
+
+uint64_t now_us() {
+    return (time_us_64());
+}
@@ -0,0 +1,25 @@
+/**
+ * Host Shim - Clocks.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_CLOCKS_H_
+#define _HOST_HARDWARE_CLOCKS_H_
+
+#include "pico.h"
+
+enum clock_index {
+    clk_ref = 4,
+    clk_sys = 5,
+    clk_peri = 6,
+};
+
+/** @brief The RP2040 default system clock. */
+static inline uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void)clk_index;
+    return (125000000);
+}
+
+#endif // _HOST_HARDWARE_CLOCKS_H_
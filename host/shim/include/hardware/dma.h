@@ -0,0 +1,98 @@
+/**
+ * Host Shim - DMA (with the sniffer).
+ *
+ * Only what the SD driver's `spi.c` uses (built into crc_bench with the model in
+ * `spi_host.c`). A transfer is done when it's started, and the completion interrupt
+ * (if enabled) is run then, by the starting thread.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_DMA_H_
+#define _HOST_HARDWARE_DMA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#define NUM_DMA_CHANNELS 12u
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+#define DREQ_FORCE 0x3f
+
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC16 0x2
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct _HOST_DMA_CHANNEL_CONFIG_ {
+    uint dreq;
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    bool sniff_enable;
+} dma_channel_config;
+
+typedef struct _HOST_DMA_HW_ {
+    io_rw_32 ints0;
+    io_rw_32 ints1;
+} dma_hw_t;
+
+extern dma_hw_t host_dma_hw;
+
+#define dma_hw (&host_dma_hw)
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr) {
+    c->write_increment = incr;
+}
+
+static inline void channel_config_set_sniff_enable(dma_channel_config* c, bool sniff_enable) {
+    c->sniff_enable = sniff_enable;
+}
+
+extern int dma_claim_unused_channel(bool required);
+extern dma_channel_config dma_channel_get_default_config(uint channel);
+extern void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, uint transfer_count, bool trigger);
+extern void dma_start_channel_mask(uint32_t chan_mask);
+extern void dma_channel_abort(uint channel);
+extern void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+extern void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+extern void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable);
+extern void dma_sniffer_disable(void);
+extern void dma_sniffer_set_data_accumulator(uint32_t seed_value);
+extern uint32_t dma_sniffer_get_data_accumulator(void);
+
+static inline bool dma_channel_is_busy(uint channel) {
+    (void)channel;
+    return (false);
+}
+
+static inline void dma_channel_wait_for_finish_blocking(uint channel) {
+    (void)channel;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_DMA_H_
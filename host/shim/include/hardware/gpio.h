@@ -0,0 +1,37 @@
+/**
+ * Host Shim - GPIO.
+ *
+ * Only the declarations the SD driver's `spi.c` needs to build (crc_bench doesn't
+ * initialize the SPI pins, see `spi_host.c`).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_GPIO_H_
+#define _HOST_HARDWARE_GPIO_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+};
+
+enum gpio_drive_strength {
+    GPIO_DRIVE_STRENGTH_2MA = 0,
+    GPIO_DRIVE_STRENGTH_4MA = 1,
+    GPIO_DRIVE_STRENGTH_8MA = 2,
+    GPIO_DRIVE_STRENGTH_12MA = 3
+};
+
+extern void gpio_set_function(uint gpio, enum gpio_function fn);
+extern void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive);
+extern void gpio_pull_up(uint gpio);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_GPIO_H_
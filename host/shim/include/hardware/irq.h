@@ -0,0 +1,36 @@
+/**
+ * Host Shim - IRQ.
+ *
+ * Only the PWM wrap interrupt is generated, every HOST_PWM_WRAP_US. On the hardware the
+ * rate depends on clk_sys (CMT's PWM wraps after 1001 counts of clk_sys/150).
+ *
+ * In crc_bench (`spi_host.c` instead of `pico_shim.c`) the DMA interrupt is run when a
+ * transfer completes.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_IRQ_H_
+#define _HOST_HARDWARE_IRQ_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#define PWM_IRQ_WRAP 4
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define NUM_IRQS 32
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+extern void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+extern void irq_set_enabled(uint num, bool enabled);
+extern void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_IRQ_H_
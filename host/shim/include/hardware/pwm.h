@@ -0,0 +1,50 @@
+/**
+ * Host Shim - PWM.
+ *
+ * The configuration is ignored. An enabled slice with its IRQ enabled interrupts
+ * every 1ms.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_PWM_H_
+#define _HOST_HARDWARE_PWM_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+#include "hardware/irq.h"
+
+#define PWM_CHAN_A 0
+#define PWM_CHAN_B 1
+#define PWM_DEFAULT_IRQ_NUM() PWM_IRQ_WRAP
+
+/** @brief Period of the PWM wrap interrupt (µs). */
+#define HOST_PWM_WRAP_US 1000
+
+typedef struct _HOST_PWM_CONFIG_ {
+    uint32_t div;
+    uint32_t top;
+} pwm_config;
+
+static inline pwm_config pwm_get_default_config(void) {
+    pwm_config c = { 1, 0xffff };
+    return (c);
+}
+
+static inline void pwm_config_set_clkdiv(pwm_config* c, float div) { c->div = (uint32_t)div; }
+static inline void pwm_config_set_clkdiv_int(pwm_config* c, uint div) { c->div = div; }
+static inline void pwm_config_set_wrap(pwm_config* c, uint16_t wrap) { c->top = wrap; }
+static inline void pwm_init(uint slice_num, pwm_config* c, bool start) { (void)slice_num; (void)c; (void)start; }
+static inline void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level) { (void)slice_num; (void)chan; (void)level; }
+static inline void pwm_clear_irq(uint slice_num) { (void)slice_num; }
+
+extern void pwm_set_irq_enabled(uint slice_num, bool enabled);
+extern void pwm_set_enabled(uint slice_num, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_PWM_H_
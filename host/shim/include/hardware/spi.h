@@ -0,0 +1,64 @@
+/**
+ * Host Shim - SPI.
+ *
+ * Only what the SD driver's `spi.c` uses (built into crc_bench with the model in
+ * `spi_host.c`). The SPI is looped back: the status always has room in the TX FIFO
+ * and data in the RX FIFO, so a byte written to the data register is read back.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_SPI_H_
+#define _HOST_HARDWARE_SPI_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#define SPI_SSPSR_TNF_BITS 0x00000002u
+#define SPI_SSPSR_RNE_BITS 0x00000004u
+
+typedef struct _HOST_SPI_HW_ {
+    io_rw_32 dr;
+    io_ro_32 sr;
+} spi_hw_t;
+
+typedef struct _HOST_SPI_HW_ spi_inst_t;
+
+extern spi_hw_t host_spi_hw[2];
+
+#define spi0 (&host_spi_hw[0])
+#define spi1 (&host_spi_hw[1])
+
+typedef enum {
+    SPI_CPHA_0 = 0,
+    SPI_CPHA_1 = 1
+} spi_cpha_t;
+
+typedef enum {
+    SPI_CPOL_0 = 0,
+    SPI_CPOL_1 = 1
+} spi_cpol_t;
+
+typedef enum {
+    SPI_LSB_FIRST = 0,
+    SPI_MSB_FIRST = 1
+} spi_order_t;
+
+static inline spi_hw_t* spi_get_hw(spi_inst_t* spi) {
+    return (spi);
+}
+
+static inline uint spi_get_index(const spi_inst_t* spi) {
+    return (spi == spi1 ? 1 : 0);
+}
+
+extern uint spi_init(spi_inst_t* spi, uint baudrate);
+extern void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_SPI_H_
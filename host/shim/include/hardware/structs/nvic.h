@@ -0,0 +1,23 @@
+/**
+ * Host Shim - NVIC registers.
+ *
+ * Reports the enabled interrupts (only the PWM wrap).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_STRUCTS_NVIC_H_
+#define _HOST_HARDWARE_STRUCTS_NVIC_H_
+
+#include "pico.h"
+
+typedef struct _HOST_NVIC_HW_ {
+    io_rw_32 iser;
+} nvic_hw_t;
+
+extern nvic_hw_t host_nvic_hw;
+
+#define nvic_hw (&host_nvic_hw)
+
+#endif // _HOST_HARDWARE_STRUCTS_NVIC_H_
@@ -0,0 +1,39 @@
+/**
+ * Host Shim - Sync (spin locks).
+ *
+ * A spin lock is the interrupt lock (`save_and_disable_interrupts`) plus a mutex, so
+ * that the holder isn't interrupted and the other core is kept out.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_SYNC_H_
+#define _HOST_HARDWARE_SYNC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#include <pthread.h>
+
+#define NUM_SPIN_LOCKS 32u
+
+typedef struct _HOST_SPIN_LOCK_ {
+    pthread_mutex_t m;
+} spin_lock_t;
+
+extern int spin_lock_claim_unused(bool required);
+extern spin_lock_t* spin_lock_instance(uint lock_num);
+extern uint32_t spin_lock_blocking(spin_lock_t* lock);
+extern void spin_unlock(spin_lock_t* lock, uint32_t saved_irq);
+
+static inline void __sev(void) {}
+static inline void __wfe(void) { tight_loop_contents(); }
+static inline void __wfi(void) { tight_loop_contents(); }
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_SYNC_H_
@@ -0,0 +1,38 @@
+/**
+ * Host Shim - Timer (time and the hardware alarms).
+ *
+ * The alarm callbacks are run from the interrupt thread.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_TIMER_H_
+#define _HOST_HARDWARE_TIMER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico/time.h"
+
+#define NUM_GENERIC_TIMERS 1u
+#define NUM_ALARMS 4u
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+extern int hardware_alarm_claim_unused(bool required);
+extern void hardware_alarm_unclaim(uint alarm_num);
+extern void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+/**
+ * @brief Set the time the alarm fires.
+ *
+ * @return true If the target time has already passed (the alarm isn't set)
+ */
+extern bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+extern void hardware_alarm_cancel(uint alarm_num);
+extern void hardware_alarm_force_irq(uint alarm_num);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_HARDWARE_TIMER_H_
@@ -0,0 +1,13 @@
+/**
+ * Host Shim - UART (not used by the modules built on the host).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_UART_H_
+#define _HOST_HARDWARE_UART_H_
+
+#include "pico.h"
+
+#endif // _HOST_HARDWARE_UART_H_
@@ -0,0 +1,44 @@
+/**
+ * Host Shim - Control of the SPI/DMA model (see `spi_host.c`).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_SPI_H_
+#define _HOST_SPI_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+/**
+ * @brief Set the data the card sends (MISO) during the DMA transfers that follow. It is
+ * read from the start of `data` for each transfer. NULL to loop the SPI back.
+ *
+ * The polled transfers are always looped back (they read the data register directly).
+ *
+ * @param data The data (long enough for the transfers), or NULL
+ */
+extern void host_spi_miso(const uint8_t* data);
+
+/**
+ * @brief Make the DMA sniffer compute a wrong CRC16 (so its check at init fails).
+ *
+ * @param fault True to corrupt the sniffer result
+ */
+extern void host_dma_sniffer_fault(bool fault);
+
+/**
+ * @brief Get the number of bytes the DMA sniffer has computed the CRC16 of.
+ *
+ * @param reset True to reset the count (after getting it)
+ * @return uint32_t The byte count
+ */
+extern uint32_t host_dma_sniffed(bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_SPI_H_
@@ -0,0 +1,88 @@
+/**
+ * Host (Linux) Shim - Core pico definitions.
+ *
+ * A thin stand-in for the pico-sdk so that the CMT, heap, and multicore modules can be
+ * built and run on a host. The two cores are two threads, the interrupt handlers are
+ * run from a third thread, and 'interrupts disabled' is a process wide lock that the
+ * interrupt thread also takes.
+ *
+ * Only what the modules built on the host use is provided.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_H_
+#define _HOST_PICO_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+#define __isr
+#define __not_in_flash_func(func) func
+#define __time_critical_func(func) func
+#define __force_inline inline
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef void (*irq_handler_t)(void);
+
+/**
+ * @brief The number of the calling core (0 for the main thread, 1 for the thread
+ * started by `multicore_launch_core1`, 0 for the interrupt thread).
+ */
+extern uint get_core_num(void);
+
+/**
+ * @brief 'Disable interrupts' - Take the (recursive) interrupt lock.
+ *
+ * Interrupt handlers aren't run while any thread holds it.
+ */
+extern uint32_t save_and_disable_interrupts(void);
+
+/**
+ * @brief 'Restore interrupts' - Release the interrupt lock.
+ */
+extern void restore_interrupts(uint32_t status);
+
+static inline void restore_interrupts_from_disabled(uint32_t status) {
+    restore_interrupts(status);
+}
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __compiler_memory_barrier(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+static inline void __breakpoint(void) {
+    __builtin_trap();
+}
+
+/**
+ * @brief Give up the processor. The host may have fewer processors than threads, so
+ * the spin loops must let the other 'core' run.
+ */
+extern void tight_loop_contents(void);
+
+extern void panic(const char* fmt, ...) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_H_
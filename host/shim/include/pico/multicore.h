@@ -0,0 +1,40 @@
+/**
+ * Host Shim - Multicore (launch and the inter-core FIFOs).
+ *
+ * The FIFOs are 8 entries deep, as they are on the RP2040. Values are 32 bits, so
+ * pointers can't be passed through them on a 64-bit host (the CMT 'runon' calls
+ * are not usable on such a host).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_MULTICORE_H_
+#define _HOST_PICO_MULTICORE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+/** @brief Start `entry` on a new thread that is core 1. */
+extern void multicore_launch_core1(void (*entry)(void));
+
+extern bool multicore_fifo_rvalid(void);
+extern bool multicore_fifo_wready(void);
+extern void multicore_fifo_push_blocking(uint32_t data);
+extern uint32_t multicore_fifo_pop_blocking(void);
+extern void multicore_fifo_drain(void);
+
+static inline void multicore_fifo_push_blocking_inline(uint32_t data) {
+    multicore_fifo_push_blocking(data);
+}
+
+static inline uint32_t multicore_fifo_pop_blocking_inline(void) {
+    return (multicore_fifo_pop_blocking());
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_MULTICORE_H_
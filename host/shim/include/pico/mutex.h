@@ -0,0 +1,51 @@
+/**
+ * Host Shim - Mutex.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_MUTEX_H_
+#define _HOST_PICO_MUTEX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#include <pthread.h>
+
+typedef struct _HOST_MUTEX_ {
+    pthread_mutex_t m;
+    bool initialized;
+} mutex_t;
+
+/** @brief Define a statically initialized mutex (like the SDK's, it is file scope). */
+#define auto_init_mutex(name) static mutex_t name = { PTHREAD_MUTEX_INITIALIZER, true }
+
+static inline void mutex_init(mutex_t* mtx) {
+    pthread_mutex_init(&mtx->m, NULL);
+    mtx->initialized = true;
+}
+
+static inline bool mutex_is_initialized(mutex_t* mtx) {
+    return (mtx->initialized);
+}
+
+static inline void mutex_enter_blocking(mutex_t* mtx) {
+    pthread_mutex_lock(&mtx->m);
+}
+
+static inline bool mutex_try_enter(mutex_t* mtx, uint32_t* owner_out) {
+    (void)owner_out;
+    return (pthread_mutex_trylock(&mtx->m) == 0);
+}
+
+static inline void mutex_exit(mutex_t* mtx) {
+    pthread_mutex_unlock(&mtx->m);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_MUTEX_H_
@@ -0,0 +1,13 @@
+/**
+ * Host Shim - pico platform.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_PLATFORM_H_
+#define _HOST_PICO_PLATFORM_H_
+
+#include "pico.h"
+
+#endif // _HOST_PICO_PLATFORM_H_
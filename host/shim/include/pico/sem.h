@@ -0,0 +1,50 @@
+/**
+ * Host Shim - Semaphore.
+ *
+ * Only what the SD driver's `spi.c` uses. crc_bench is single threaded (the DMA
+ * completion interrupt is run by the thread that starts the transfer), so this
+ * only counts.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_SEM_H_
+#define _HOST_PICO_SEM_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+typedef struct _HOST_SEMAPHORE_ {
+    int16_t permits;
+    int16_t max_permits;
+} semaphore_t;
+
+static inline void sem_init(semaphore_t* sem, int16_t initial_permits, int16_t max_permits) {
+    sem->permits = initial_permits;
+    sem->max_permits = max_permits;
+}
+
+static inline bool sem_release(semaphore_t* sem) {
+    if (sem->permits < sem->max_permits) {
+        sem->permits++;
+        return (true);
+    }
+    return (false);
+}
+
+static inline bool sem_acquire_timeout_ms(semaphore_t* sem, uint32_t timeout_ms) {
+    (void)timeout_ms;   // Nothing else can release it
+    if (sem->permits > 0) {
+        sem->permits--;
+        return (true);
+    }
+    return (false);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_SEM_H_
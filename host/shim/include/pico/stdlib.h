@@ -0,0 +1,18 @@
+/**
+ * Host Shim - pico stdlib.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_STDLIB_H_
+#define _HOST_PICO_STDLIB_H_
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#include <stdio.h>
+
+#endif // _HOST_PICO_STDLIB_H_
@@ -0,0 +1,63 @@
+/**
+ * Host Shim - Time.
+ *
+ * Time is the host monotonic clock, in µs since the process started.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_TIME_H_
+#define _HOST_PICO_TIME_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico/types.h"
+
+extern uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) {
+    return ((uint32_t)time_us_64());
+}
+
+static inline absolute_time_t get_absolute_time(void) {
+    return (time_us_64());
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+    return (us);
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return (t);
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return ((uint32_t)(t / 1000));
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return (time_us_64() + us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return (time_us_64() + ((uint64_t)ms * 1000));
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return ((int64_t)(to - from));
+}
+
+static inline bool time_reached(absolute_time_t t) {
+    return (time_us_64() >= t);
+}
+
+extern void sleep_us(uint64_t us);
+extern void sleep_ms(uint32_t ms);
+extern void busy_wait_us(uint64_t us);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_TIME_H_
@@ -0,0 +1,27 @@
+/**
+ * Host Shim - pico types.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_TYPES_H_
+#define _HOST_PICO_TYPES_H_
+
+#include "pico.h"
+
+/** @brief Microseconds since boot (the shim's 'boot' is the process start). */
+typedef uint64_t absolute_time_t;
+
+/** @brief Date and time (as the SDK defines it for the RTC). */
+typedef struct _HOST_DATETIME_ {
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+#endif // _HOST_PICO_TYPES_H_
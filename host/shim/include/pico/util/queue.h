@@ -0,0 +1,48 @@
+/**
+ * Host Shim - Queue.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_UTIL_QUEUE_H_
+#define _HOST_PICO_UTIL_QUEUE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico.h"
+
+#include <pthread.h>
+
+typedef struct _HOST_QUEUE_ {
+    pthread_mutex_t lock;
+    uint8_t* data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint16_t element_size;
+    uint16_t element_count;
+} queue_t;
+
+extern void queue_init(queue_t* q, uint element_size, uint element_count);
+extern void queue_free(queue_t* q);
+extern uint queue_get_level_unsafe(queue_t* q);
+extern uint queue_get_level(queue_t* q);
+extern bool queue_try_add(queue_t* q, const void* data);
+extern bool queue_try_remove(queue_t* q, void* data);
+extern bool queue_try_peek(queue_t* q, void* data);
+extern void queue_add_blocking(queue_t* q, const void* data);
+extern void queue_remove_blocking(queue_t* q, void* data);
+
+static inline bool queue_is_empty(queue_t* q) {
+    return (queue_get_level(q) == 0);
+}
+
+static inline bool queue_is_full(queue_t* q) {
+    return (queue_get_level(q) == q->element_count);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_PICO_UTIL_QUEUE_H_
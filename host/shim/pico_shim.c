@@ -0,0 +1,545 @@
+/**
+ * Host (Linux) Shim - Implementation of the pico APIs used by CMT and multicore.
+ *
+ * Threads:
+ *  Core 0: The thread that runs `main`.
+ *  Core 1: The thread started by `multicore_launch_core1`.
+ *  IRQ:    Runs the PWM wrap handler every HOST_PWM_WRAP_US and the hardware alarm callbacks. It holds
+ *          the interrupt lock while running a handler, so a core that has 'disabled
+ *          interrupts' isn't interrupted (the handlers do run concurrently with the other
+ *          core, as they can on the RP2040).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "pico.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include "pico/util/queue.h"
+#include "hardware/irq.h"
+#include "hardware/pwm.h"
+#include "hardware/structs/nvic.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FIFO_DEPTH 8
+
+typedef struct _HOST_FIFO_ {
+    uint32_t data[FIFO_DEPTH];
+    uint32_t wptr;
+    uint32_t rptr;
+} host_fifo_t;
+
+typedef struct _HOST_ALARM_ {
+    bool claimed;
+    bool armed;
+    uint64_t target;
+    hardware_alarm_callback_t callback;
+} host_alarm_t;
+
+// ######################################################################################
+// Data                                                                               ###
+// ######################################################################################
+
+nvic_hw_t host_nvic_hw;
+
+static __thread uint _core_num;
+
+static pthread_mutex_t _irq_lock;   // 'Interrupts disabled' (recursive)
+static pthread_once_t _irq_lock_once = PTHREAD_ONCE_INIT;
+
+static spin_lock_t _spin_locks[NUM_SPIN_LOCKS];
+static uint32_t _spin_locks_claimed;
+static pthread_mutex_t _claim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t _fifo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _fifo_cond = PTHREAD_COND_INITIALIZER;
+static host_fifo_t _fifo[2];        // Indexed by the receiving core
+
+// The interrupt thread waits on `_irqt_cond` for the next PWM tick or alarm target.
+static pthread_mutex_t _irqt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _irqt_cond;  // Waits are timed on the monotonic clock
+static bool _irqt_started;
+static irq_handler_t _irq_handlers[NUM_IRQS];
+static bool _irq_enabled[NUM_IRQS];
+static bool _pwm_irq_enabled;
+static bool _pwm_enabled;
+static host_alarm_t _alarms[NUM_ALARMS];
+
+static struct timespec _t_boot;
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+static void _irq_lock_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&_irq_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    for (uint i = 0; i < NUM_SPIN_LOCKS; i++) {
+        pthread_mutex_init(&_spin_locks[i].m, NULL);
+    }
+}
+
+static void _irq_lock_take(void) {
+    pthread_once(&_irq_lock_once, _irq_lock_init);
+    pthread_mutex_lock(&_irq_lock);
+}
+
+static struct timespec _abstime_from_us(uint64_t t_us) {
+    // Convert a shim time (µs since boot) to a CLOCK_MONOTONIC time for a timed wait.
+    struct timespec ts = _t_boot;
+    ts.tv_sec += (time_t)(t_us / 1000000);
+    ts.tv_nsec += (long)((t_us % 1000000) * 1000);
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return (ts);
+}
+
+static void* _irq_thread(void* arg) {
+    (void)arg;
+    _core_num = 0;  // The CMT interrupts are enabled (and run) on core 0
+    uint64_t t_tick = time_us_64() + HOST_PWM_WRAP_US;
+    pthread_mutex_lock(&_irqt_lock);
+    while (true) {
+        bool ticking = _pwm_enabled && _pwm_irq_enabled && _irq_enabled[PWM_IRQ_WRAP];
+        uint64_t t_wake = (ticking ? t_tick : UINT64_MAX);
+        for (uint i = 0; i < NUM_ALARMS; i++) {
+            if (_alarms[i].armed && _alarms[i].target < t_wake) {
+                t_wake = _alarms[i].target;
+            }
+        }
+        uint64_t now = time_us_64();
+        if (now < t_wake) {
+            if (t_wake == UINT64_MAX) {
+                pthread_cond_wait(&_irqt_cond, &_irqt_lock);
+            }
+            else {
+                struct timespec ts = _abstime_from_us(t_wake);
+                pthread_cond_timedwait(&_irqt_cond, &_irqt_lock, &ts);
+            }
+            continue;
+        }
+        // Something is due. Run the handlers without holding the thread lock, as they
+        // set alarms.
+        for (uint i = 0; i < NUM_ALARMS; i++) {
+            host_alarm_t* alarm = &_alarms[i];
+            if (alarm->armed && alarm->target <= now) {
+                alarm->armed = false;
+                hardware_alarm_callback_t callback = alarm->callback;
+                if (callback) {
+                    pthread_mutex_unlock(&_irqt_lock);
+                    _irq_lock_take();
+                    callback(i);
+                    pthread_mutex_unlock(&_irq_lock);
+                    pthread_mutex_lock(&_irqt_lock);
+                }
+            }
+        }
+        if (ticking && t_tick <= now) {
+            // Like the hardware, a tick that is missed entirely is lost rather than queued.
+            t_tick += HOST_PWM_WRAP_US;
+            if (t_tick <= now) {
+                t_tick = now + HOST_PWM_WRAP_US;
+            }
+            irq_handler_t handler = _irq_handlers[PWM_IRQ_WRAP];
+            if (handler) {
+                pthread_mutex_unlock(&_irqt_lock);
+                _irq_lock_take();
+                handler();
+                pthread_mutex_unlock(&_irq_lock);
+                pthread_mutex_lock(&_irqt_lock);
+            }
+        }
+    }
+    return (NULL);
+}
+
+static void _irqt_changed(void) {
+    // Called with `_irqt_lock` held. Start the interrupt thread (once) and wake it.
+    if (!_irqt_started) {
+        pthread_t t;
+        _irqt_started = true;
+        if (pthread_create(&t, NULL, _irq_thread, NULL) != 0) {
+            panic("host shim: Unable to start the interrupt thread");
+        }
+        pthread_detach(t);
+    }
+    pthread_cond_signal(&_irqt_cond);
+}
+
+static void* _core1_thread(void* arg) {
+    _core_num = 1;
+    void (*entry)(void) = (void (*)(void))arg;
+    entry();
+    return (NULL);
+}
+
+static void _shim_init(void) __attribute__((constructor));
+static void _shim_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &_t_boot);
+    pthread_once(&_irq_lock_once, _irq_lock_init);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_irqt_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+
+// ######################################################################################
+// Core, Interrupts, and Panic                                                        ###
+// ######################################################################################
+
+uint get_core_num(void) {
+    return (_core_num);
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    _irq_lock_take();
+    return (0);
+}
+
+void restore_interrupts(uint32_t status) {
+    (void)status;
+    pthread_mutex_unlock(&_irq_lock);
+}
+
+void tight_loop_contents(void) {
+    sched_yield();
+}
+
+void panic(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "\n*** PANIC ***\n");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+
+// ######################################################################################
+// Time                                                                               ###
+// ######################################################################################
+
+uint64_t time_us_64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t sec = (int64_t)(ts.tv_sec - _t_boot.tv_sec);
+    int64_t nsec = (int64_t)(ts.tv_nsec - _t_boot.tv_nsec);
+    return ((uint64_t)(sec * 1000000 + nsec / 1000));
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec ts = { (time_t)(us / 1000000), (long)((us % 1000000) * 1000) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void busy_wait_us(uint64_t us) {
+    uint64_t t_end = time_us_64() + us;
+    while (time_us_64() < t_end) {
+        tight_loop_contents();
+    }
+}
+
+
+// ######################################################################################
+// Spin Locks                                                                         ###
+// ######################################################################################
+
+int spin_lock_claim_unused(bool required) {
+    pthread_mutex_lock(&_claim_lock);
+    for (uint i = 0; i < NUM_SPIN_LOCKS; i++) {
+        if (!(_spin_locks_claimed & (1u << i))) {
+            _spin_locks_claimed |= (1u << i);
+            pthread_mutex_unlock(&_claim_lock);
+            return ((int)i);
+        }
+    }
+    pthread_mutex_unlock(&_claim_lock);
+    if (required) {
+        panic("host shim: No spin locks are available");
+    }
+    return (-1);
+}
+
+spin_lock_t* spin_lock_instance(uint lock_num) {
+    return (&_spin_locks[lock_num % NUM_SPIN_LOCKS]);
+}
+
+uint32_t spin_lock_blocking(spin_lock_t* lock) {
+    uint32_t saved = save_and_disable_interrupts();
+    pthread_mutex_lock(&lock->m);
+    return (saved);
+}
+
+void spin_unlock(spin_lock_t* lock, uint32_t saved_irq) {
+    pthread_mutex_unlock(&lock->m);
+    restore_interrupts(saved_irq);
+}
+
+
+// ######################################################################################
+// Queue                                                                              ###
+// ######################################################################################
+
+void queue_init(queue_t* q, uint element_size, uint element_count) {
+    pthread_mutex_init(&q->lock, NULL);
+    // One more slot than elements, so that full and empty can be told apart.
+    q->data = (uint8_t*)calloc(element_count + 1, element_size);
+    if (!q->data) {
+        panic("host shim: Unable to allocate a queue");
+    }
+    q->element_size = (uint16_t)element_size;
+    q->element_count = (uint16_t)element_count;
+    q->wptr = 0;
+    q->rptr = 0;
+}
+
+void queue_free(queue_t* q) {
+    free(q->data);
+    q->data = NULL;
+}
+
+uint queue_get_level_unsafe(queue_t* q) {
+    int32_t rc = (int32_t)q->wptr - (int32_t)q->rptr;
+    if (rc < 0) {
+        rc += q->element_count + 1;
+    }
+    return ((uint)rc);
+}
+
+uint queue_get_level(queue_t* q) {
+    pthread_mutex_lock(&q->lock);
+    uint level = queue_get_level_unsafe(q);
+    pthread_mutex_unlock(&q->lock);
+    return (level);
+}
+
+bool queue_try_add(queue_t* q, const void* data) {
+    pthread_mutex_lock(&q->lock);
+    if (queue_get_level_unsafe(q) == q->element_count) {
+        pthread_mutex_unlock(&q->lock);
+        return (false);
+    }
+    memcpy(q->data + (size_t)q->wptr * q->element_size, data, q->element_size);
+    q->wptr = (uint16_t)((q->wptr + 1) % (q->element_count + 1));
+    pthread_mutex_unlock(&q->lock);
+    return (true);
+}
+
+static bool _queue_take(queue_t* q, void* data, bool remove) {
+    pthread_mutex_lock(&q->lock);
+    if (q->wptr == q->rptr) {
+        pthread_mutex_unlock(&q->lock);
+        return (false);
+    }
+    if (data) {
+        memcpy(data, q->data + (size_t)q->rptr * q->element_size, q->element_size);
+    }
+    if (remove) {
+        q->rptr = (uint16_t)((q->rptr + 1) % (q->element_count + 1));
+    }
+    pthread_mutex_unlock(&q->lock);
+    return (true);
+}
+
+bool queue_try_remove(queue_t* q, void* data) {
+    return (_queue_take(q, data, true));
+}
+
+bool queue_try_peek(queue_t* q, void* data) {
+    return (_queue_take(q, data, false));
+}
+
+void queue_add_blocking(queue_t* q, const void* data) {
+    while (!queue_try_add(q, data)) {
+        tight_loop_contents();
+    }
+}
+
+void queue_remove_blocking(queue_t* q, void* data) {
+    while (!queue_try_remove(q, data)) {
+        tight_loop_contents();
+    }
+}
+
+
+// ######################################################################################
+// Multicore                                                                          ###
+// ######################################################################################
+
+void multicore_launch_core1(void (*entry)(void)) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, _core1_thread, (void*)entry) != 0) {
+        panic("host shim: Unable to start core 1");
+    }
+    pthread_detach(t);
+}
+
+bool multicore_fifo_rvalid(void) {
+    host_fifo_t* fifo = &_fifo[get_core_num()];
+    pthread_mutex_lock(&_fifo_lock);
+    bool valid = (fifo->wptr != fifo->rptr);
+    pthread_mutex_unlock(&_fifo_lock);
+    return (valid);
+}
+
+bool multicore_fifo_wready(void) {
+    host_fifo_t* fifo = &_fifo[get_core_num() ^ 1];
+    pthread_mutex_lock(&_fifo_lock);
+    bool ready = (fifo->wptr - fifo->rptr < FIFO_DEPTH);
+    pthread_mutex_unlock(&_fifo_lock);
+    return (ready);
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    host_fifo_t* fifo = &_fifo[get_core_num() ^ 1];
+    pthread_mutex_lock(&_fifo_lock);
+    while (fifo->wptr - fifo->rptr >= FIFO_DEPTH) {
+        pthread_cond_wait(&_fifo_cond, &_fifo_lock);
+    }
+    fifo->data[fifo->wptr++ % FIFO_DEPTH] = data;
+    pthread_cond_broadcast(&_fifo_cond);
+    pthread_mutex_unlock(&_fifo_lock);
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    host_fifo_t* fifo = &_fifo[get_core_num()];
+    pthread_mutex_lock(&_fifo_lock);
+    while (fifo->wptr == fifo->rptr) {
+        pthread_cond_wait(&_fifo_cond, &_fifo_lock);
+    }
+    uint32_t data = fifo->data[fifo->rptr++ % FIFO_DEPTH];
+    pthread_cond_broadcast(&_fifo_cond);
+    pthread_mutex_unlock(&_fifo_lock);
+    return (data);
+}
+
+void multicore_fifo_drain(void) {
+    host_fifo_t* fifo = &_fifo[get_core_num()];
+    pthread_mutex_lock(&_fifo_lock);
+    fifo->rptr = fifo->wptr;
+    pthread_cond_broadcast(&_fifo_cond);
+    pthread_mutex_unlock(&_fifo_lock);
+}
+
+
+// ######################################################################################
+// IRQ, PWM, and Alarms                                                               ###
+// ######################################################################################
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    pthread_mutex_lock(&_irqt_lock);
+    _irq_handlers[num % NUM_IRQS] = handler;
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    pthread_mutex_lock(&_irqt_lock);
+    _irq_enabled[num % NUM_IRQS] = enabled;
+    if (enabled) {
+        host_nvic_hw.iser |= (1u << (num % NUM_IRQS));
+    }
+    else {
+        host_nvic_hw.iser &= ~(1u << (num % NUM_IRQS));
+    }
+    _irqt_changed();
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+void pwm_set_irq_enabled(uint slice_num, bool enabled) {
+    (void)slice_num;
+    pthread_mutex_lock(&_irqt_lock);
+    _pwm_irq_enabled = enabled;
+    _irqt_changed();
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+    (void)slice_num;
+    pthread_mutex_lock(&_irqt_lock);
+    _pwm_enabled = enabled;
+    _irqt_changed();
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    pthread_mutex_lock(&_irqt_lock);
+    for (uint i = 0; i < NUM_ALARMS; i++) {
+        if (!_alarms[i].claimed) {
+            _alarms[i].claimed = true;
+            pthread_mutex_unlock(&_irqt_lock);
+            return ((int)i);
+        }
+    }
+    pthread_mutex_unlock(&_irqt_lock);
+    if (required) {
+        panic("host shim: No hardware alarms are available");
+    }
+    return (-1);
+}
+
+void hardware_alarm_unclaim(uint alarm_num) {
+    pthread_mutex_lock(&_irqt_lock);
+    _alarms[alarm_num % NUM_ALARMS].claimed = false;
+    _alarms[alarm_num % NUM_ALARMS].armed = false;
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    pthread_mutex_lock(&_irqt_lock);
+    _alarms[alarm_num % NUM_ALARMS].callback = callback;
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    host_alarm_t* alarm = &_alarms[alarm_num % NUM_ALARMS];
+    pthread_mutex_lock(&_irqt_lock);
+    if (t <= time_us_64()) {
+        alarm->armed = false;
+        pthread_mutex_unlock(&_irqt_lock);
+        return (true);
+    }
+    alarm->target = t;
+    alarm->armed = true;
+    _irqt_changed();
+    pthread_mutex_unlock(&_irqt_lock);
+    return (false);
+}
+
+void hardware_alarm_cancel(uint alarm_num) {
+    pthread_mutex_lock(&_irqt_lock);
+    _alarms[alarm_num % NUM_ALARMS].armed = false;
+    pthread_mutex_unlock(&_irqt_lock);
+}
+
+void hardware_alarm_force_irq(uint alarm_num) {
+    pthread_mutex_lock(&_irqt_lock);
+    _alarms[alarm_num % NUM_ALARMS].target = 0;
+    _alarms[alarm_num % NUM_ALARMS].armed = true;
+    _irqt_changed();
+    pthread_mutex_unlock(&_irqt_lock);
+}
@@ -0,0 +1,296 @@
+/**
+ * Host Shim - Model of the SPI, DMA, and DMA sniffer used by the SD driver's `spi.c`.
+ *
+ * crc_bench is built with the real `spi.c` and this (instead of `pico_shim.c`), so the
+ * driver's choice between polled and DMA transfers, the channel it sniffs, and how it
+ * seeds and reads back the sniffer CRC are checked as they are in the firmware.
+ *
+ *  SPI:     Looped back (see `hardware/spi.h`).
+ *  DMA:     A transfer is done when it's started. A TX/RX channel pair started together
+ *           moves the TX data out and the MISO data (`host_spi_miso`, or the TX data
+ *           looped back) in. The completion interrupt is run when the transfer is done
+ *           (the interrupt status isn't cleared by writing it, as it is on the RP2040,
+ *           but the handler is only run for a completion).
+ *  Sniffer: DMA_SNIFF_CTRL_CALC_VALUE_CRC16 (CRC-16-CCITT, MSB first, without output
+ *           reversal or inversion) of the data moved by the sniffed channel, if the
+ *           channel's config enables it.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "pico.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/spi.h"
+#include "host_spi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct _HOST_DMA_CHANNEL_ {
+    bool claimed;
+    dma_channel_config cfg;
+    volatile void* write_addr;
+    const volatile void* read_addr;
+    uint count;
+} host_dma_channel_t;
+
+// ######################################################################################
+// Data                                                                               ###
+// ######################################################################################
+
+spi_hw_t host_spi_hw[2] = {
+    { .sr = SPI_SSPSR_TNF_BITS | SPI_SSPSR_RNE_BITS },
+    { .sr = SPI_SSPSR_TNF_BITS | SPI_SSPSR_RNE_BITS },
+};
+
+dma_hw_t host_dma_hw;
+
+static host_dma_channel_t _channels[NUM_DMA_CHANNELS];
+static uint32_t _irq0_enabled;          // Channel mask
+static uint32_t _irq1_enabled;          // Channel mask
+
+static bool _sniffer_on;
+static uint _sniffer_channel;
+static uint32_t _sniffer_accum;
+static bool _sniffer_fault;
+static uint32_t _sniffed;
+
+static const uint8_t* _miso;
+
+static irq_handler_t _irq_handlers[NUM_IRQS];
+static bool _irq_enabled[NUM_IRQS];
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+static void _sniff(uint channel, uint8_t b) {
+    if (!_sniffer_on || channel != _sniffer_channel || !_channels[channel].cfg.sniff_enable) {
+        return;
+    }
+    uint16_t crc = (uint16_t)_sniffer_accum ^ (uint16_t)(b << 8);
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    _sniffer_accum = crc;
+    _sniffed++;
+}
+
+static uint8_t _read(host_dma_channel_t* ch, uint i) {
+    const volatile uint8_t* p = (const volatile uint8_t*)ch->read_addr;
+    return (ch->cfg.read_increment ? p[i] : *p);
+}
+
+static void _write(host_dma_channel_t* ch, uint i, uint8_t b) {
+    volatile uint8_t* p = (volatile uint8_t*)ch->write_addr;
+    if (ch->cfg.write_increment) {
+        p[i] = b;
+    }
+    else {
+        *p = b;
+    }
+}
+
+static void _complete(uint32_t chan_mask) {
+    uint32_t ints0 = (chan_mask & _irq0_enabled);
+    uint32_t ints1 = (chan_mask & _irq1_enabled);
+    host_dma_hw.ints0 |= ints0;
+    host_dma_hw.ints1 |= ints1;
+    if (ints0 && _irq_enabled[DMA_IRQ_0] && _irq_handlers[DMA_IRQ_0]) {
+        _irq_handlers[DMA_IRQ_0]();
+    }
+    if (ints1 && _irq_enabled[DMA_IRQ_1] && _irq_handlers[DMA_IRQ_1]) {
+        _irq_handlers[DMA_IRQ_1]();
+    }
+}
+
+static void _run_m2m(uint channel) {
+    host_dma_channel_t* ch = &_channels[channel];
+    for (uint i = 0; i < ch->count; i++) {
+        uint8_t b = _read(ch, i);
+        _sniff(channel, b);
+        _write(ch, i, b);
+    }
+    _complete(1u << channel);
+}
+
+static void _run_spi(uint tx_channel, uint rx_channel) {
+    host_dma_channel_t* tx = &_channels[tx_channel];
+    host_dma_channel_t* rx = &_channels[rx_channel];
+    if (tx->count != rx->count) {
+        fprintf(stderr, "spi_host: DMA TX count %u != RX count %u\n", tx->count, rx->count);
+        abort();
+    }
+    for (uint i = 0; i < tx->count; i++) {
+        uint8_t out = _read(tx, i);
+        _sniff(tx_channel, out);
+        uint8_t in = (_miso ? _miso[i] : out);
+        _sniff(rx_channel, in);
+        _write(rx, i, in);
+    }
+    _complete((1u << tx_channel) | (1u << rx_channel));
+}
+
+
+// ######################################################################################
+// Public Methods                                                                     ###
+// ######################################################################################
+
+void host_spi_miso(const uint8_t* data) {
+    _miso = data;
+}
+
+void host_dma_sniffer_fault(bool fault) {
+    _sniffer_fault = fault;
+}
+
+uint32_t host_dma_sniffed(bool reset) {
+    uint32_t n = _sniffed;
+    if (reset) {
+        _sniffed = 0;
+    }
+    return (n);
+}
+
+uint spi_init(spi_inst_t* spi, uint baudrate) {
+    return (baudrate);
+}
+
+void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+}
+
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive) {
+}
+
+void gpio_pull_up(uint gpio) {
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    _irq_handlers[num % NUM_IRQS] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    // Only one SPI uses the DMA interrupt at a time in crc_bench.
+    _irq_handlers[num % NUM_IRQS] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    _irq_enabled[num % NUM_IRQS] = enabled;
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+        if (!_channels[i].claimed) {
+            _channels[i].claimed = true;
+            return ((int)i);
+        }
+    }
+    if (required) {
+        fprintf(stderr, "spi_host: No DMA channels are available\n");
+        abort();
+    }
+    return (-1);
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c = {
+        .dreq = DREQ_FORCE,
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .sniff_enable = false,
+    };
+    return (c);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, uint transfer_count, bool trigger) {
+    host_dma_channel_t* ch = &_channels[channel];
+    if (config->size != DMA_SIZE_8) {
+        fprintf(stderr, "spi_host: Only 8-bit DMA transfers are modeled\n");
+        abort();
+    }
+    ch->cfg = *config;
+    ch->write_addr = write_addr;
+    ch->read_addr = read_addr;
+    ch->count = transfer_count;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    // A channel paced by an SPI TX request runs with the channel paced by its RX request.
+    for (uint c = 0; c < NUM_DMA_CHANNELS; c++) {
+        if (!(chan_mask & (1u << c))) {
+            continue;
+        }
+        uint dreq = _channels[c].cfg.dreq;
+        if (dreq == DREQ_SPI0_RX || dreq == DREQ_SPI1_RX) {
+            continue;   // Run with its TX channel
+        }
+        if (dreq == DREQ_SPI0_TX || dreq == DREQ_SPI1_TX) {
+            uint rx_channel = NUM_DMA_CHANNELS;
+            for (uint r = 0; r < NUM_DMA_CHANNELS; r++) {
+                if ((chan_mask & (1u << r)) && _channels[r].cfg.dreq == dreq + 1) {
+                    rx_channel = r;
+                }
+            }
+            if (rx_channel == NUM_DMA_CHANNELS) {
+                fprintf(stderr, "spi_host: SPI TX DMA started without its RX channel\n");
+                abort();
+            }
+            _run_spi(c, rx_channel);
+        }
+        else {
+            _run_m2m(c);
+        }
+    }
+}
+
+void dma_channel_abort(uint channel) {
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    _irq0_enabled = (enabled ? (_irq0_enabled | (1u << channel)) : (_irq0_enabled & ~(1u << channel)));
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+    _irq1_enabled = (enabled ? (_irq1_enabled | (1u << channel)) : (_irq1_enabled & ~(1u << channel)));
+}
+
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable) {
+    if (mode != DMA_SNIFF_CTRL_CALC_VALUE_CRC16) {
+        fprintf(stderr, "spi_host: Only the CRC16 sniffer mode is modeled\n");
+        abort();
+    }
+    _sniffer_on = true;
+    _sniffer_channel = channel;
+    if (force_channel_enable) {
+        _channels[channel].cfg.sniff_enable = true;
+    }
+}
+
+void dma_sniffer_disable(void) {
+    _sniffer_on = false;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value) {
+    _sniffer_accum = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator(void) {
+    return (_sniffer_fault ? (_sniffer_accum ^ 0x0001) : _sniffer_accum);
+}
+
+void my_assert_func(const char* file, int line, const char* func, const char* pred) {
+    fprintf(stderr, "assertion \"%s\" failed: file \"%s\", line %d, function: %s\n", pred, file, line, func);
+    abort();
+}
@@ -11,6 +11,7 @@
 #include "xyz.h"
 
 #include "board.h"
+#include "cmt_periodic.h"
 #include "msgpost.h"
 
 #include "pico/types.h" // 'uint' and other standard types
@@ -19,12 +20,17 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/** @brief Period (ms) of the housekeeping */
+#define XYZ_HOUSEKEEPING_MS 1000
+
 // ====================================================================
 // Data Section
 // ====================================================================
 
 static volatile bool _modinit_called;
 
+static cmt_periodic_t _housekeeping_pt;
+
 // ====================================================================
 // Local/Private Method Declarations
 // ====================================================================
@@ -45,24 +51,24 @@ static void _delay_action(void* data) {
 }
 
 
-// ====================================================================
-// Message Handler Methods
-// ====================================================================
-
 /**
- * @brief Handle our Housekeeping tasks. This is triggered every ~16ms.
+ * @brief Do our Housekeeping tasks. Run by a periodic timer (remove it, and its
+ * registration in `xyz_modinit`, if the module doesn't need one).
  *
- * Triggered at 62.5Hz, so 625 times is 10 seconds.
- *
- * @param msg Nothing important in the message.
+ * @param pt The periodic timer
  */
-static void _handle_housekeeping(cmt_msg_t* msg) {
+static void _housekeeping(cmt_periodic_t* pt) {
     static uint cnt = 0;
 
     cnt++;
 }
 
 
+// ====================================================================
+// Message Handler Methods
+// ====================================================================
+
+
 // ====================================================================
 // Local/Private Methods
 // ====================================================================
@@ -84,4 +90,6 @@ void xyz_modinit() {
     }
     _modinit_called = true;
 
+    cmt_periodic_init(&_housekeeping_pt, "xyz", XYZ_HOUSEKEEPING_MS, 0, CMT_PERIODIC_SKIP, _housekeeping, NULL, 0);
+    cmt_periodic_start(&_housekeeping_pt);
 }
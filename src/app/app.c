@@ -24,6 +24,7 @@
 
 #ifdef SHELL_ENABLE
     #include "shell.h"
+    #include "cmt/cmd/cmds.h"
     #ifdef BUS_MASTER
         #include "dbusm/cmd/cmds.h"
     #else
@@ -35,6 +36,8 @@
 #include "hwrt_t.h"
 #include "picoutil.h"
 #include "cmt.h"
+#include "cmt_dwork.h"
+#include "cmt_periodic.h"
 #include "dskops/dskops.h"
 
 #include <locale.h>
@@ -45,6 +48,14 @@
 // ############################################################################
 //
 #define APP_DISPLAY_BG              C16_BLACK
+/** @brief Number of message IDs (using the most time) per core to include in the status */
+#define APP_STATUS_MSGPROF_TOP      3
+/** @brief Deadline (µs) for delivering a received terminal character to the shell (keyboard echo latency) */
+#define APP_CHAR_RDY_DEADLINE_US    5000
+/** @brief Period of the status output (ms) */
+#define APP_STATUS_PERIOD_MS        Seconds_ms(16)
+/** @brief Time from the start to the first status output (ms) */
+#define APP_STATUS_PHASE_MS         7000
 
 
 // ############################################################################
@@ -57,12 +68,9 @@
 // Function Declarations
 // ############################################################################
 //
+static void _show_msgprof(int corenum);
 static void _show_psa(proc_status_accum_t* psa, int corenum);
 
-// Message handler functions...
-static void _handle_housekeeping(cmt_msg_t* msg);
-//
-
 
 // ############################################################################
 // Data
@@ -70,6 +78,9 @@ static void _handle_housekeeping(cmt_msg_t* msg);
 //
 int ERRORNO;    // Primarily used by the Shell and Shell Commands. Globally available error number.
 
+static cmt_dwork_slot_t _char_rdy_slot;     // Terminal character ready notification (from the shell irq)
+static cmt_periodic_t _status_periodic;     // Proc status output
+
 // ====================================================================
 // Interrupt (irq) handler functions
 // ====================================================================
@@ -88,10 +99,10 @@ int ERRORNO;    // Primarily used by the Shell and Shell Commands. Globally avai
  *
  */
 static void _do_on_char_rdy_irq() {
-    // Post MSG_TERM_CHAR_RCVD to have our app thread handle.
-    cmt_msg_t msg;
-    cmt_msg_init(&msg, MSG_TERM_CHAR_RCVD);
-    postAPPMsg(&msg);
+    // Post MSG_TERM_CHAR_RCVD (as deferred work) to have our app thread handle.
+    // Repeated notifications before it is handled collapse into one, as the
+    // handler processes all of the characters that are ready.
+    cmt_dwork_post(&_char_rdy_slot, 0);
 }
 
 
@@ -119,6 +130,7 @@ static void _clear_and_enable_input(void* data) {
         // Initialize the Bus Client Commands
         dbusccmds_modinit();
     #endif
+        cmtcmds_modinit();
         debugcmds_modinit();
         picocmds_modinit();
     // Start the shell
@@ -126,7 +138,7 @@ static void _clear_and_enable_input(void* data) {
 #endif
 }
 
-static void _display_proc_status(void* data) {
+static void _display_proc_status(cmt_periodic_t* pt) {
     // Output the current state
     if (debug_mode_enabled()) {
         cmt_sm_counts_t smwc = scheduled_msgs_waiting();
@@ -135,12 +147,12 @@ static void _display_proc_status(void* data) {
             cmt_proc_status_sec(&psa, i);
             // Display the proc status...
             _show_psa(&psa, i);
+            // ...and the messages that are using the most time (if profiling)
+            _show_msgprof(i);
         }
         debug_printf("Scheduled messages: %d\n", smwc.total);
     }
     // Do 'other' status
-    // Output status every 16 seconds
-    cmt_run_after_ms(Seconds_ms(16), _display_proc_status, NULL);
 }
 
 
@@ -148,9 +160,6 @@ static void _display_proc_status(void* data) {
 // Message Handlers
 // ############################################################################
 //
-static void _handle_housekeeping(__unused cmt_msg_t* msg) {
-}
-
 #ifdef SHELL_ENABLE
 // Handle `MSG_TERM_CHAR_RCVD` Let the Shell know that there are characters ready.
 static void _handle_term_char_rdy(__unused cmt_msg_t* msg) {
@@ -163,6 +172,18 @@ static void _handle_term_char_rdy(__unused cmt_msg_t* msg) {
 // Internal Functions
 // ############################################################################
 //
+static void _show_msgprof(int corenum) {
+    msg_id_t ids[APP_STATUS_MSGPROF_TOP];
+    int cnt = cmt_msg_prof_top(corenum, ids, APP_STATUS_MSGPROF_TOP);
+    for (int i = 0; i < cnt; i++) {
+        cmt_msg_prof_t prof;
+        if (cmt_msg_prof_get(corenum, ids[i], &prof)) {
+            debug_printf("    MsgID:%02X Cnt:%lu Total:%lluus Avg:%luus Max:%luus\n",
+                (unsigned int)ids[i], prof.count, prof.t_total, (uint32_t)(prof.t_total / prof.count), prof.t_max);
+        }
+    }
+}
+
 static void _show_psa(proc_status_accum_t* psa, int corenum) {
     long active = psa->t_active;
     float busy = (active < 1000000l ? (float)active / 10000.0f : 100.0f); // Divide by 10,000 rather than 1,000,000 for percent
@@ -172,11 +193,12 @@ static void _show_psa(proc_status_accum_t* psa, int corenum) {
         ts = "ms";
     }
     int retrieved = psa->retrieved;
+    int retrieved_any = psa->retrieved_any;
     int msg_id = psa->msg_longest;
     long msg_t = psa->t_msg_longest;
     int interrupt_status = psa->interrupt_status;
-    debug_printf("Core %d: Active:% 3.2f%% (%ld%s)\t Msgs:%d\t LongMsgID:%02X (%ldus)\t IntFlags:%08x\n",
-        corenum, busy, active, ts, retrieved, msg_id, msg_t, interrupt_status);
+    debug_printf("Core %d: Active:% 3.2f%% (%ld%s)\t Msgs:%d (Shared:%d)\t LongMsgID:%02X (%ldus)\t IntFlags:%08x\n",
+        corenum, busy, active, ts, retrieved, retrieved_any, msg_id, msg_t, interrupt_status);
 }
 
 
@@ -201,9 +223,10 @@ static void _modinit(void) {
     setlocale(LC_NUMERIC, "en_US.UTF-8"); // Set the locale
 
     // Add our message handlers
-    cmt_msg_hdlr_add(MSG_PERIODIC_RT, _handle_housekeeping);
 #ifdef SHELL_ENABLE
     cmt_msg_hdlr_add(MSG_TERM_CHAR_RCVD, _handle_term_char_rdy);
+    cmt_dwork_slot_init(&_char_rdy_slot, "term_char_rdy", MSG_TERM_CHAR_RCVD, NULL_MSG_HDLR, 1);
+    cmt_dwork_slot_deadline(&_char_rdy_slot, APP_CHAR_RDY_DEADLINE_US);
 #endif
     // Initialize the App Modules
     appops_modinit();
@@ -218,8 +241,9 @@ void start_app(void) {
     cmt_run_after_ms(2000, _clear_and_enable_input, NULL);
 
     //
-    // Output status every 7 seconds
-    cmt_run_after_ms(7000, _display_proc_status, NULL);
+    // Output status after 7 seconds, then every 16 seconds
+    cmt_periodic_init(&_status_periodic, "app_status", APP_STATUS_PERIOD_MS, APP_STATUS_PHASE_MS, CMT_PERIODIC_SKIP, _display_proc_status, NULL, 1);
+    cmt_periodic_start(&_status_periodic);
 
     //
     // Done with Apps Startup - Let the Runtime know.
@@ -0,0 +1,389 @@
+/**
+ * Commands: Cooperative Multi-Tasking
+ *
+ * Shell commands for the CMT operational information.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+ */
+
+#include "cmds.h"
+#include "cmt.h"
+#include "cmt_dwork.h"
+#include "cmt_periodic.h"
+#include "multicore.h"
+
+#include "util.h"
+
+#include "shell.h"
+#include "cmd_t.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/** @brief Number of message IDs listed (per core) if not specified */
+#define MSGPROF_TOP_DEFAULT 8
+/** @brief Maximum number of message IDs that can be listed (per core) */
+#define MSGPROF_TOP_MAX 32
+
+const cmd_handler_entry_t cmds_budgets_entry;
+const cmd_handler_entry_t cmds_cmtpools_entry;
+const cmd_handler_entry_t cmds_cmttrace_entry;
+const cmd_handler_entry_t cmds_deadlines_entry;
+const cmd_handler_entry_t cmds_dwork_entry;
+const cmd_handler_entry_t cmds_msgprof_entry;
+const cmd_handler_entry_t cmds_periodic_entry;
+const cmd_handler_entry_t cmds_queues_entry;
+
+
+static void _show_budget_viol(const char* what, const cmt_budget_viol_t* rec) {
+    shell_printf("   %s ID:%02X  Hdlr:%08lX  Start:%10lu  Ran:%8luus  Budget:%6luus\n",
+        what, (unsigned int)rec->msg_id, (uint32_t)rec->hdlr, rec->t_start, rec->elapsed, rec->budget);
+}
+
+static void _cmttrace_dump_core(uint8_t corenum) {
+    int cnt = cmt_trace_count(corenum);
+    for (int n = 0; n < cnt; n++) {
+        cmt_trace_rec_t rec;
+        if (cmt_trace_get(corenum, n, &rec)) {
+            // Raw record bytes (little-endian) as hex, decoded by `tools/cmt_trace2json.py`
+            const uint8_t* b = (const uint8_t*)&rec;
+            shell_printf("CT %hhu ", corenum);
+            for (size_t i = 0; i < sizeof(rec); i++) {
+                shell_printf("%02X", b[i]);
+            }
+            shell_printf("\n");
+        }
+    }
+}
+
+static void _show_msgprof_hist(const cmt_msg_prof_t* prof) {
+    shell_printf("     ");
+    for (int b = 0; b < CMT_MSG_PROF_BUCKETS; b++) {
+        if (prof->hist[b]) {
+            if (b == CMT_MSG_PROF_BUCKETS - 1) {
+                shell_printf(" >=%luus:%u", (1ul << b), prof->hist[b]);
+            }
+            else {
+                shell_printf(" <%luus:%u", (2ul << b), prof->hist[b]);
+            }
+        }
+    }
+    shell_printf("\n");
+}
+
+static void _show_msgprof(uint8_t corenum, int top, bool hist) {
+    msg_id_t ids[MSGPROF_TOP_MAX];
+    int cnt = cmt_msg_prof_top(corenum, ids, top);
+    shell_printf("Core %hhu\n ID       Count    Total(us)  Min(us)  Avg(us)  Max(us)  Hdlr@Max\n", corenum);
+    for (int i = 0; i < cnt; i++) {
+        cmt_msg_prof_t prof;
+        if (cmt_msg_prof_get(corenum, ids[i], &prof)) {
+            uint32_t avg = (uint32_t)(prof.t_total / prof.count);
+            shell_printf(" %02X  %10lu  %11llu  %7lu  %7lu  %7lu  %08lX\n",
+                (unsigned int)ids[i], prof.count, prof.t_total, prof.t_min, avg, prof.t_max, (uint32_t)prof.hdlr_max);
+            if (hist) {
+                _show_msgprof_hist(&prof);
+            }
+        }
+    }
+}
+
+static int _exec_msgprof(int argc, char** argv, const char* unparsed) {
+    int top = MSGPROF_TOP_DEFAULT;
+    bool hist = false;
+    if (argc > 3) {
+        cmd_help_display(&cmds_msgprof_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (!cmt_msg_prof_enabled()) {
+        shell_printf("Message profiling is not built in (CMT_MSG_PROFILE).\n");
+        return (-1);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            cmt_msg_prof_reset();
+            shell_printf("Message profile reset.\n");
+            return (0);
+        }
+        else if (strcmp(argv[i], "-h") == 0) {
+            hist = true;
+        }
+        else {
+            bool success;
+            top = (int)uint_from_str(argv[i], &success);
+            if (!success || top < 1) {
+                shell_printf("Value error - '%s' is not a valid count.\n", argv[i]);
+                return (-1);
+            }
+            top = min(top, MSGPROF_TOP_MAX);
+        }
+    }
+    _show_msgprof(0, top, hist);
+    _show_msgprof(1, top, hist);
+
+    return (0);
+}
+
+static int _exec_cmtpools(int argc, char** argv, const char* unparsed) {
+    static const char* pnames[CMT_POOL_CNT] = { "Handlers", "Scheduled", "us-Timers" };
+    if (argc > 1) {
+        cmd_help_display(&cmds_cmtpools_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    shell_printf("Pool       Size  InUse  Peak\n");
+    for (int p = 0; p < CMT_POOL_CNT; p++) {
+        cmt_pool_stats_t stats;
+        if (cmt_pool_stats((cmt_pool_id_t)p, &stats)) {
+            shell_printf("%-9s  %4u  %5u  %4u\n", pnames[p], stats.size, stats.in_use, stats.peak);
+        }
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_cmtpools_entry = {
+    _exec_cmtpools,
+    5,
+    ".cmtpools",
+    "",
+    "List the CMT pool sizes with their current and peak usage.",
+};
+
+static int _exec_cmttrace(int argc, char** argv, const char* unparsed) {
+    if (argc > 2) {
+        cmd_help_display(&cmds_cmttrace_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (!cmt_trace_available()) {
+        shell_printf("Dispatch tracing is not built in (CMT_TRACE).\n");
+        return (-1);
+    }
+    if (argc == 1) {
+        bool enabled = cmt_trace_enable(false);
+        cmt_trace_enable(enabled);
+        shell_printf("Tracing: %s  Records: Core0:%d Core1:%d\n", (enabled ? "ON" : "OFF"), cmt_trace_count(0), cmt_trace_count(1));
+    }
+    else if (strcmp(argv[1], "on") == 0) {
+        cmt_trace_enable(true);
+    }
+    else if (strcmp(argv[1], "off") == 0) {
+        cmt_trace_enable(false);
+    }
+    else if (strcmp(argv[1], "clear") == 0) {
+        cmt_trace_clear();
+    }
+    else if (strcmp(argv[1], "dump") == 0) {
+        // Stop tracing so the rings don't change (or record the dump itself).
+        cmt_trace_enable(false);
+        shell_printf("CMTTRACE 1\n");
+        _cmttrace_dump_core(0);
+        _cmttrace_dump_core(1);
+        shell_printf("CMTTRACE END\n");
+    }
+    else {
+        cmd_help_display(&cmds_cmttrace_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_cmttrace_entry = {
+    _exec_cmttrace,
+    5,
+    ".cmttrace",
+    "[on|off|clear|dump]",
+    "Control the message dispatch trace. 'dump' stops the trace and lists the records.",
+};
+
+static int _exec_budgets(int argc, char** argv, const char* unparsed) {
+    if (argc > 3 || (argc == 2 && strcmp(argv[1], "-r") != 0)) {
+        cmd_help_display(&cmds_budgets_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (argc == 2) {
+        cmt_budget_viol_clear();
+        shell_printf("Budget violations cleared.\n");
+        return (0);
+    }
+    if (argc == 3) {
+        bool success;
+        uint id = uint_from_str(argv[1], &success);
+        if (!success || id >= MSG_ID_CNT) {
+            shell_printf("Value error - '%s' is not a valid message ID.\n", argv[1]);
+            return (-1);
+        }
+        uint budget = uint_from_str(argv[2], &success);
+        if (!success) {
+            shell_printf("Value error - '%s' is not a valid time.\n", argv[2]);
+            return (-1);
+        }
+        cmt_msg_budget_set((msg_id_t)id, budget);
+    }
+    for (uint8_t corenum = 0; corenum < 2; corenum++) {
+        shell_printf("Core %hhu  Violations: %lu\n", corenum, cmt_budget_viol_total(corenum));
+        int cnt = cmt_budget_viol_count(corenum);
+        for (int n = 0; n < cnt; n++) {
+            cmt_budget_viol_t rec;
+            if (cmt_budget_viol_get(corenum, n, &rec)) {
+                _show_budget_viol("     ", &rec);
+            }
+        }
+        cmt_budget_viol_t stuck;
+        uint32_t stuck_cnt = cmt_stuck_get(corenum, &stuck);
+        if (stuck_cnt > 0) {
+            shell_printf("  Stuck (>%dms): %lu\n", CMT_STUCK_MS, stuck_cnt);
+            _show_budget_viol("Last:", &stuck);
+        }
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_budgets_entry = {
+    _exec_budgets,
+    4,
+    ".budgets",
+    "[-r | id us]",
+    "List the handler time budget violations (most recent first) and stuck handlers. -r to clear. 'id us' sets the budget for a message ID (0 for none).",
+};
+
+static int _exec_deadlines(int argc, char** argv, const char* unparsed) {
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-r") != 0)) {
+        cmd_help_display(&cmds_deadlines_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (!cmt_deadline_stats_enabled()) {
+        shell_printf("Deadline statistics are not built in (CMT_DEADLINE_STATS).\n");
+        return (-1);
+    }
+    if (argc == 2) {
+        cmt_deadline_stats_reset();
+        shell_printf("Deadline statistics reset.\n");
+        return (0);
+    }
+    shell_printf("Core  ID       Count    Missed  LateMax(us)\n");
+    for (uint8_t corenum = 0; corenum < 2; corenum++) {
+        for (int id = 0; id < MSG_ID_CNT; id++) {
+            cmt_deadline_stats_t stats;
+            if (cmt_deadline_stats_get(corenum, (msg_id_t)id, &stats)) {
+                shell_printf(" %hhu    %02X  %10lu  %8lu  %11lu\n", corenum, (unsigned int)id, stats.count, stats.missed, stats.late_max);
+            }
+        }
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_deadlines_entry = {
+    _exec_deadlines,
+    4,
+    ".deadlines",
+    "[-r]",
+    "List the messages dispatched with a deadline and their deadline misses. -r to reset.",
+};
+
+static int _exec_dwork(int argc, char** argv, const char* unparsed) {
+    if (argc > 1) {
+        cmd_help_display(&cmds_dwork_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    shell_printf("Core  Source             ID      Posted   Coalesced/Dropped  Deadline(us)  Missed\n");
+    for (uint8_t corenum = 0; corenum < 2; corenum++) {
+        for (const cmt_dwork_slot_t* slot = cmt_dwork_slots(corenum); slot; slot = slot->next) {
+            shell_printf(" %hhu    %-16s  %02X  %10lu  %10lu C         %10lu  %6lu\n",
+                corenum, slot->name, (unsigned int)slot->id, slot->posted, slot->coalesced, slot->deadline_us, slot->missed);
+        }
+        for (const cmt_dwork_ring_t* ring = cmt_dwork_rings(corenum); ring; ring = ring->next) {
+            shell_printf(" %hhu    %-16s  %02X  %10lu  %10lu D         %10lu  %6lu\n",
+                corenum, ring->name, (unsigned int)ring->id, ring->head, ring->dropped, ring->deadline_us, ring->missed);
+        }
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_dwork_entry = {
+    _exec_dwork,
+    4,
+    ".dwork",
+    "",
+    "List the deferred work (interrupt) sources with their coalesced (C) or dropped (D) counts.",
+};
+
+const cmd_handler_entry_t cmds_msgprof_entry = {
+    _exec_msgprof,
+    5,
+    ".msgprof",
+    "[-r] [-h] [count]",
+    "List the messages using the most time (-h histogram). -r to reset.",
+};
+
+static int _exec_periodic(int argc, char** argv, const char* unparsed) {
+    if (argc > 1) {
+        cmd_help_display(&cmds_periodic_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    shell_printf("Core  Timer             Period(ms)  Policy  Active        Runs  Overruns   Skipped\n");
+    for (const cmt_periodic_t* pt = cmt_periodics(); pt; pt = pt->next) {
+        shell_printf(" %hhu    %-16s  %10lu  %-6s  %-6s  %10lu  %8lu  %8lu\n",
+            pt->corenum, pt->name, pt->period_ms, (pt->policy == CMT_PERIODIC_CATCHUP ? "Catch" : "Skip"),
+            (pt->active ? "Yes" : "No"), pt->runs, pt->overruns, pt->skipped);
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_periodic_entry = {
+    _exec_periodic,
+    4,
+    ".periodic",
+    "",
+    "List the periodic timers with their run, overrun, and skipped counts.",
+};
+
+static int _exec_queues(int argc, char** argv, const char* unparsed) {
+    static const char* qnames[MCQ_CNT] = { "Core0", "Core1", "Any", "C0-DL", "C1-DL" };
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-r") != 0)) {
+        cmd_help_display(&cmds_queues_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (argc == 2) {
+        multicore_queue_stats_reset();
+        shell_printf("Queue statistics reset.\n");
+        return (0);
+    }
+    shell_printf("Queue  Size  Level  HWM      Posted   Full  Dropped  Waited  BP-Events\n");
+    for (int q = 0; q < MCQ_CNT; q++) {
+        mc_queue_stats_t stats;
+        if (multicore_queue_stats((mc_queue_id_t)q, &stats)) {
+            shell_printf("%-5s  %4u  %5u  %3u  %10lu  %5lu  %7lu  %6lu  %9lu%s\n",
+                qnames[q], stats.size, stats.level, stats.hwm, stats.posted, stats.full,
+                stats.dropped, stats.waited, stats.bp_events, (stats.bp_asserted ? " (BP)" : ""));
+        }
+    }
+
+    return (0);
+}
+
+const cmd_handler_entry_t cmds_queues_entry = {
+    _exec_queues,
+    4,
+    ".queues",
+    "[-r]",
+    "List the message queue sizes, high-water marks, and full/dropped/backpressure counts. -r to reset.",
+};
+
+
+void cmtcmds_modinit(void) {
+    cmd_register(&cmds_budgets_entry);
+    cmd_register(&cmds_cmtpools_entry);
+    cmd_register(&cmds_cmttrace_entry);
+    cmd_register(&cmds_deadlines_entry);
+    cmd_register(&cmds_dwork_entry);
+    cmd_register(&cmds_msgprof_entry);
+    cmd_register(&cmds_periodic_entry);
+    cmd_register(&cmds_queues_entry);
+}
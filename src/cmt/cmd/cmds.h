@@ -0,0 +1,21 @@
+/**
+ * Shell Commands: Cooperative Multi-Tasking
+ *
+ * Commands to display the CMT operational information (message profile, etc.).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef CMDS_CMT_H_
+#define CMDS_CMT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void cmtcmds_modinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // CMDS_CMT_H_
@@ -9,6 +9,8 @@
 */
 #include "cmt.h"
 #include "cmt_heap.h"
+#include "cmt_dwork.h"
+#include "cmt_periodic.h"
 
 #include "system_defs.h"
 #include "board.h"
@@ -19,6 +21,8 @@
 #include "hardware/clocks.h"
 #include "hardware/pwm.h"
 #include "hardware/structs/nvic.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "pico/mutex.h"
 #include "pico/stdlib.h"
 #include "pico/time.h"
@@ -37,10 +41,35 @@ static volatile proc_status_accum_t _psa[2];         // One Proc Status Accumula
 static volatile proc_status_accum_t _psa_sec[2];     // Proc Status Accumulator per second for each core
 static volatile msg_id_t _msg_curlast[2];            // The current/last message processed for each core
 
-static volatile uint8_t _housekeep_rt;          // Incremented each ms. (0-15) Generates a Housekeeping msg every 16ms (62.5Hz)
-static volatile uint32_t _hkcnt;                // Incremented each Housekeeping msg (done in Core0)
-static volatile bool _housekeep0_msg_pending;   // Indicates that a Housekeeping msg has been posted and is pending for Core0
-static volatile bool _housekeep1_msg_pending;   // Indicates that a Housekeeping msg has been posted and is pending for Core1
+#if CMT_MSG_PROFILE
+static cmt_msg_prof_t _msg_prof[2][MSG_ID_CNT];      // Run time profile for each message ID for each core
+#endif
+static volatile bool _msg_prof_reset_req[2];         // Reset of the profile requested for each core
+
+#if CMT_DEADLINE_STATS
+static cmt_deadline_stats_t _deadline_stats[2][MSG_ID_CNT]; // Deadline misses for each message ID for each core
+#endif
+static volatile bool _deadline_reset_req[2];         // Reset of the deadline stats requested for each core
+
+#if CMT_TRACE
+static cmt_trace_rec_t _trace_ring[2][CMT_TRACE_ENTRIES]; // Dispatch trace ring for each core
+static volatile uint32_t _trace_widx[2];             // Next write index (free running) for each core
+#endif
+static volatile bool _trace_enabled;                 // Dispatch trace recording is enabled
+
+static uint32_t _msg_budget_us[MSG_ID_CNT];          // Handler time budget for each message ID (0 is none)
+static cmt_budget_viol_t _budget_viol[2][CMT_BUDGET_VIOL_ENTRIES]; // Recent budget violations for each core
+static volatile uint32_t _budget_viol_total[2];      // Number of budget violations (next record index) for each core
+static volatile bool _budget_clear_req[2];           // Clear of the budget violations requested for each core
+static uint32_t _budget_viol_logged[2];              // Budget violation total when last logged for each core
+static volatile msg_handler_fn _hdlr_cur[2];         // The handler each core is running (NULL when between handlers)
+static volatile msg_id_t _msg_id_cur[2];             // The message ID of the handler each core is running
+static volatile uint32_t _t_hdlr_start[2];           // Time (µs) the current handler was started for each core
+static volatile bool _stuck_flagged[2];              // The current handler has been recorded as stuck
+static cmt_budget_viol_t _stuck[2];                  // Last stuck handler detected for each core
+static volatile uint32_t _stuck_cnt[2];              // Number of stuck handlers detected for each core
+
+static cmt_periodic_t _hdlrs_verify_periodic;   // Periodic sanity check of the message handlers (Core1)
 
 /** @brief The message handler(s) list. One entry for each (possible) message ID. Contains pointer to first handler link-list entry. */
 cmt_msg_hdlr_ll_ent_t* cmt_msg_hdlrs[MSG_ID_CNT];
@@ -50,14 +79,32 @@ auto_init_mutex(sm_mutex);
 /** @brief Pointer to first entry of a linked list of scheduled messages and sleeps. */
 cmt_schmsgdata_ll_ent_t* cmt_smd_ll;
 
+/** @brief Microsecond timer entry (all of the timers are multiplexed on one hardware alarm). */
+typedef struct cmt_us_timer_ {
+    uint64_t t_due;         // Absolute time (µs since boot) the timer expires
+    uint16_t seq;           // Sequence number (upper part of the Timer ID)
+    uint8_t corenum;
+    bool in_use;
+    cmt_msg_t msg;          // Message gets copied into this
+    struct cmt_us_timer_* next;
+} cmt_us_timer_t;
+
+static cmt_us_timer_t _us_timers[CMT_US_TIMERS_MAX];
+static cmt_us_timer_t* _us_timer_ll;        // Pending timers, soonest first
+static uint16_t _us_timer_seq;
+static uint16_t _us_timers_in_use;
+static uint16_t _us_timers_peak;
+static spin_lock_t* _us_timer_lock;         // Guards the timers (used from both cores and the alarm irq)
+static int _us_alarm_num = -1;
+
 
 // ######################################################################################
 // Local Method Declarations                                                          ###
 // ######################################################################################
 
 static void _cmt_handle_sleep(cmt_msg_t* msg);
-static void _housekeep0_msg_hdlr(cmt_msg_t* msg);
-static void _housekeep1_msg_hdlr(cmt_msg_t* msg);
+static void _us_timers_run_due();
+static void _stuck_check(void);
 
 
 // ######################################################################################
@@ -65,14 +112,12 @@ static void _housekeep1_msg_hdlr(cmt_msg_t* msg);
 // ######################################################################################
 
 /**
- * @brief Recurring Interrupt Handler (1ms from PWM).
+ * @brief Recurring Interrupt Handler (about 1ms from PWM, see `cmt_modinit`).
  *
  * Handles the PWM 'wrap' recurring interrupt. This adjusts the time left in scheduled messages
  * (including our 'sleep') and posts a message to the appropriate core when time hits 0.
  *
- * This also posts a MSG_PERIODIC_RT message every 16ms (62.5Hz) that allows modules
- * to perform regular operations without having to set up scheduled messages or timers
- * of their own.
+ * This also checks for a core that is stuck in a message handler.
  *
  */
 static void _on_recurring_interrupt(void) {
@@ -95,52 +140,106 @@ static void _on_recurring_interrupt(void) {
             cmt_smd_ll = next;
         }
     }
-    _housekeep_rt = ((_housekeep_rt + 1) & 0x0F);
-    if (_housekeep_rt == 0) {
-        // We are at 16ms
-        cmt_msg_t msg;
-        if (!_housekeep0_msg_pending) {
-            _housekeep0_msg_pending = true;
-            cmt_msg_init2(&msg, MSG_PERIODIC_RT, _housekeep0_msg_hdlr);
-            post_to_core0(&msg);
-        }
-        if (!_housekeep1_msg_pending) {
-            _housekeep1_msg_pending = true;
-            cmt_msg_init2(&msg, MSG_PERIODIC_RT, _housekeep1_msg_hdlr);
-            post_to_core1(&msg);
-        }
-    }
+    _stuck_check();
     // Clear the interrupt flag that brought us here so it can occur again.
     pwm_clear_irq(CMT_PWM_RECINT_SLICE);
 }
 
 
+/**
+ * @brief Microsecond timer alarm handler.
+ *
+ * Posts the messages for the timers that are due and sets the alarm for the next timer.
+ *
+ * @param alarm_num The hardware alarm number (the one claimed for the µs timers)
+ */
+static void _on_us_alarm(uint alarm_num) {
+    uint32_t flags = spin_lock_blocking(_us_timer_lock);
+    _us_timers_run_due();
+    spin_unlock(_us_timer_lock, flags);
+}
+
+
 // ######################################################################################
 // Message Handlers                                                                   ###
 // ######################################################################################
 
-static void _housekeep0_msg_hdlr(cmt_msg_t* msg) {
-    // The Housekeeping message posted is being processed from the head of the queue,
-    // clear the pending flag so another message will be posted.
-    _housekeep0_msg_pending = false;
-    // Bump our overall count and do things at certain increments.
-    _hkcnt++;
-}
-
-static void _housekeep1_msg_hdlr(cmt_msg_t* msg) {
-    // The Housekeeping message posted is being processed from the head of the queue,
-    // clear the pending flag so another message will be posted.
-    _housekeep1_msg_pending = false;
-    if (_hkcnt % 1875 == 0) {
-        // About every 30 seconds (1875 * 0.016 = 30) do a sanity check so we can identify problems.
-        cmt_msg_hdlrs_verify();
-    }
+static void _hdlrs_verify_periodic_fn(cmt_periodic_t* pt) {
+    // Every 30 seconds do a sanity check so we can identify problems.
+    cmt_msg_hdlrs_verify();
 }
 
 // ######################################################################################
 // Local Methods                                                                      ###
 // ######################################################################################
 
+/**
+ * @brief Post the messages for the microsecond timers that are due, and set the alarm
+ * for the next one. Must be called with the `_us_timer_lock` held.
+ */
+static void _us_timers_run_due() {
+    while (_us_timer_ll) {
+        cmt_us_timer_t* t = _us_timer_ll;
+        if (t->t_due > time_us_64()) {
+            // Set the alarm for this one. If the time was missed while setting it, post it now.
+            if (!hardware_alarm_set_target(_us_alarm_num, from_us_since_boot(t->t_due))) {
+                break;
+            }
+            continue;
+        }
+        _us_timer_ll = t->next;
+        if (t->corenum == 0) {
+            post_to_core0(&t->msg);
+        }
+        else {
+            post_to_core1(&t->msg);
+        }
+        t->in_use = false;
+        _us_timers_in_use--;
+    }
+}
+
+static int32_t _schedule_core_msg_in_us(uint8_t core_num, uint32_t us, const cmt_msg_t* msg) {
+    int32_t id = -1;
+    uint64_t t_due = time_us_64() + us;
+    uint32_t flags = spin_lock_blocking(_us_timer_lock);
+    cmt_us_timer_t* t = NULL;
+    for (int i = 0; i < CMT_US_TIMERS_MAX; i++) {
+        if (!_us_timers[i].in_use) {
+            t = &_us_timers[i];
+            if (++_us_timer_seq == 0) {
+                _us_timer_seq = 1;  // Keep the IDs >0 (the sequence wraps)
+            }
+            id = (int32_t)(((uint32_t)_us_timer_seq << 8) | i);
+            break;
+        }
+    }
+    if (t) {
+        t->in_use = true;
+        if (++_us_timers_in_use > _us_timers_peak) {
+            _us_timers_peak = _us_timers_in_use;
+        }
+        t->seq = _us_timer_seq;
+        t->corenum = core_num;
+        t->t_due = t_due;
+        memcpy(&t->msg, msg, sizeof(cmt_msg_t));
+        // Insert it in time order (after others due at the same time)
+        cmt_us_timer_t** pnext = &_us_timer_ll;
+        while (*pnext && (*pnext)->t_due <= t_due) {
+            pnext = &(*pnext)->next;
+        }
+        t->next = *pnext;
+        *pnext = t;
+        if (_us_timer_ll == t) {
+            // It's the new first, so the alarm needs to be set for it.
+            _us_timers_run_due();
+        }
+    }
+    spin_unlock(_us_timer_lock, flags);
+
+    return (id);
+}
+
 static void _schedule_core_msg_in_ms(uint8_t core_num, int32_t ms, const cmt_msg_t* msg) {
     uint32_t flags = save_and_disable_interrupts();
     mutex_enter_blocking(&sm_mutex);
@@ -177,6 +276,143 @@ static void _schedule_core_msg_in_ms(uint8_t core_num, int32_t ms, const cmt_msg
     restore_interrupts_from_disabled(flags);
 }
 
+#if CMT_MSG_PROFILE
+static void _msg_prof_record(uint8_t corenum, const cmt_msg_t* msg, uint64_t t_this_msg) {
+    cmt_msg_prof_t* prof = &_msg_prof[corenum][msg->id];
+    uint32_t t = (t_this_msg > UINT32_MAX ? UINT32_MAX : (uint32_t)t_this_msg);
+    if (prof->count == 0 || t < prof->t_min) {
+        prof->t_min = t;
+    }
+    if (t >= prof->t_max) {
+        prof->t_max = t;
+        prof->hdlr_max = msg->hdlr;
+    }
+    prof->count++;
+    prof->t_total += t;
+    // Log2 bucket - bucket 0 is [0,2)µs, the last bucket catches everything longer.
+    int bucket = (t < 2 ? 0 : (31 - __builtin_clz(t)));
+    if (bucket >= CMT_MSG_PROF_BUCKETS) {
+        bucket = CMT_MSG_PROF_BUCKETS - 1;
+    }
+    if (prof->hist[bucket] < UINT16_MAX) {
+        prof->hist[bucket]++;
+    }
+}
+#endif
+
+static void _budget_violation(uint8_t corenum, msg_id_t id, msg_handler_fn hdlr, uint32_t t_start, uint32_t elapsed, uint32_t budget) {
+    uint32_t total = _budget_viol_total[corenum];
+    cmt_budget_viol_t* rec = &_budget_viol[corenum][total % CMT_BUDGET_VIOL_ENTRIES];
+    rec->t_start = t_start;
+    rec->elapsed = elapsed;
+    rec->hdlr = hdlr;
+    rec->budget = budget;
+    rec->msg_id = id;
+    _budget_viol_total[corenum] = total + 1;
+#if CMT_BUDGET_ACTION > 1
+    __breakpoint();
+#endif
+}
+
+#if CMT_BUDGET_ACTION > 0
+/**
+ * @brief Log the budget violations recorded since the last log (from the message loop).
+ */
+static void _budget_viol_log(uint8_t corenum) {
+    uint32_t total = _budget_viol_total[corenum];
+    uint32_t cnt = total - _budget_viol_logged[corenum];
+    if (cnt == 0) {
+        return;
+    }
+    _budget_viol_logged[corenum] = total;
+    const cmt_budget_viol_t* rec = &_budget_viol[corenum][(total - 1) % CMT_BUDGET_VIOL_ENTRIES];
+    debug_printf("CMT: Core%hhu %lu budget violation(s). Last: MsgID:%02X handler %08lX ran %luus (budget %luus)\n",
+        corenum, cnt, (unsigned int)rec->msg_id, (uint32_t)rec->hdlr, rec->elapsed, rec->budget);
+}
+#endif
+
+/**
+ * @brief Run a message handler, checking it against the budget for the message ID.
+ */
+static inline void _run_hdlr(uint8_t corenum, msg_handler_fn hdlr, cmt_msg_t* msg) {
+    msg_id_t id = msg->id;
+    uint32_t t_start = time_us_32();
+    _t_hdlr_start[corenum] = t_start;
+    _stuck_flagged[corenum] = false;
+    _msg_id_cur[corenum] = id;
+    _hdlr_cur[corenum] = hdlr;
+    hdlr(msg);
+    _hdlr_cur[corenum] = NULL_MSG_HDLR;
+    uint32_t elapsed = time_us_32() - t_start;
+    uint32_t budget = _msg_budget_us[id];
+    if (budget && elapsed > budget) {
+        _budget_violation(corenum, id, hdlr, t_start, elapsed, budget);
+    }
+}
+
+/**
+ * @brief Check for a core that has been in a handler too long (from the recurring interrupt).
+ */
+static void _stuck_check(void) {
+    uint32_t now = time_us_32();
+    for (uint8_t corenum = 0; corenum < 2; corenum++) {
+        msg_handler_fn hdlr = _hdlr_cur[corenum];
+        uint32_t elapsed = now - _t_hdlr_start[corenum];
+        if (hdlr && !_stuck_flagged[corenum] && elapsed > (CMT_STUCK_MS * 1000)) {
+            _stuck_flagged[corenum] = true;
+            cmt_budget_viol_t* rec = &_stuck[corenum];
+            rec->t_start = _t_hdlr_start[corenum];
+            rec->elapsed = elapsed;
+            rec->hdlr = hdlr;
+            rec->msg_id = _msg_id_cur[corenum];
+            rec->budget = _msg_budget_us[rec->msg_id];
+            _stuck_cnt[corenum]++;
+#if CMT_STUCK_PANIC
+            board_panic("!!! CMT: Core%hhu stuck in handler %08lX for MsgID:%02X !!!", corenum, (uint32_t)hdlr, (unsigned int)rec->msg_id);
+#endif
+        }
+    }
+}
+
+#if CMT_DEADLINE_STATS
+static void _deadline_record(uint8_t corenum, const cmt_msg_t* msg, uint32_t t_dispatch) {
+    cmt_deadline_stats_t* stats = &_deadline_stats[corenum][msg->id];
+    stats->count++;
+    int32_t late = (int32_t)(t_dispatch - msg->deadline);
+    if (late > 0) {
+        stats->missed++;
+        if ((uint32_t)late > stats->late_max) {
+            stats->late_max = (uint32_t)late;
+        }
+    }
+}
+#endif
+
+#if CMT_TRACE
+static void _trace_record(uint8_t corenum, const cmt_msg_t* msg, uint64_t t_start, uint64_t t_this_msg, uint16_t qdepth, uint8_t flags) {
+    msg_handler_fn hdlr = msg->hdlr;
+    if (hdlr == NULL_MSG_HDLR) {
+        // Use the first handler registered for this core
+        cmt_msg_hdlr_ll_ent_t* handler_entry = cmt_msg_hdlrs[msg->id];
+        while (handler_entry) {
+            if (handler_entry->corenum == corenum || handler_entry->corenum == MSG_HDLR_CORE_BOTH) {
+                hdlr = handler_entry->handler;
+                break;
+            }
+            handler_entry = handler_entry->next;
+        }
+    }
+    cmt_trace_rec_t* rec = &_trace_ring[corenum][_trace_widx[corenum] % CMT_TRACE_ENTRIES];
+    rec->t_start = (uint32_t)t_start;
+    rec->duration = (t_this_msg > UINT32_MAX ? UINT32_MAX : (uint32_t)t_this_msg);
+    rec->hdlr = (uint32_t)hdlr;
+    rec->msg_id = (uint8_t)msg->id;
+    rec->flags = (flags | (corenum & CMT_TRACE_FLG_CORE));
+    rec->qdepth = qdepth;
+    _trace_widx[corenum]++;
+}
+#endif
+
 static void _cmt_handle_sleep(cmt_msg_t* msg) {
     cmt_sleep_fn fn = msg->data.cmt_sleep.sleep_fn;
     if (fn) {
@@ -214,7 +450,7 @@ void cmt_msg_hdlr_add(msg_id_t id, msg_handler_fn hdlr) {
 void cmt_msg_hdlr_add_for_core(msg_id_t id, msg_handler_fn hdlr, uint corenum) {
     cmt_msg_hdlr_ll_ent_t* ent = cmt_alloc_mhllent();
     ent->handler = hdlr;
-    ent->corenum = corenum & 0x00000001; // Force to 0/1
+    ent->corenum = (corenum == MSG_HDLR_CORE_BOTH ? MSG_HDLR_CORE_BOTH : corenum & 0x00000001); // Force to 0/1 (or both)
     // Link it into the handler entries
     cmt_msg_hdlr_ll_ent_t* head = cmt_msg_hdlrs[id];
     ent->next = head;
@@ -249,6 +485,17 @@ void cmt_msg_hdlr_rm_for_core(msg_id_t id, msg_handler_fn hdlr, uint corenum) {
     }
 }
 
+bool cmt_msg_hdlr_exists(msg_id_t id, uint corenum) {
+    cmt_msg_hdlr_ll_ent_t* ent = (id < MSG_ID_CNT ? cmt_msg_hdlrs[id] : (cmt_msg_hdlr_ll_ent_t*)NULL);
+    while (ent) {
+        if (ent->corenum == corenum || ent->corenum == MSG_HDLR_CORE_BOTH) {
+            return (true);
+        }
+        ent = ent->next;
+    }
+    return (false);
+}
+
 void cmt_msg_hdlrs_verify() {
     // Verify the handlers list
     //cmt_msg_hdlr_ll_ent_t* cmt_msg_hdlrs[MSG_ID_CNT];
@@ -267,6 +514,8 @@ void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum) {
     if (corenum < 2) {
         volatile proc_status_accum_t* psa_sec = &_psa_sec[corenum];
         psas->retrieved = psa_sec->retrieved;
+        psas->retrieved_any = psa_sec->retrieved_any;
+        psas->t_active_any = psa_sec->t_active_any;
         psas->t_active = psa_sec->t_active;
         psas->msg_longest = psa_sec->msg_longest;
         psas->t_msg_longest = psa_sec->t_msg_longest;
@@ -275,6 +524,175 @@ void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum) {
     }
 }
 
+bool cmt_msg_prof_enabled() {
+    return (CMT_MSG_PROFILE != 0);
+}
+
+bool cmt_msg_prof_get(uint8_t corenum, msg_id_t id, cmt_msg_prof_t* prof) {
+    bool handled = false;
+#if CMT_MSG_PROFILE
+    if (corenum < 2 && id < MSG_ID_CNT) {
+        memcpy(prof, &_msg_prof[corenum][id], sizeof(cmt_msg_prof_t));
+        handled = (prof->count > 0);
+    }
+#endif
+    return (handled);
+}
+
+int cmt_msg_prof_top(uint8_t corenum, msg_id_t* ids, int max) {
+    int cnt = 0;
+#if CMT_MSG_PROFILE
+    if (corenum < 2) {
+        // Insertion sort into the caller's list, largest total time first.
+        for (int id = 0; id < MSG_ID_CNT; id++) {
+            uint64_t t_total = _msg_prof[corenum][id].t_total;
+            if (_msg_prof[corenum][id].count == 0) {
+                continue;
+            }
+            int i = cnt;
+            while (i > 0 && _msg_prof[corenum][ids[i - 1]].t_total < t_total) {
+                if (i < max) {
+                    ids[i] = ids[i - 1];
+                }
+                i--;
+            }
+            if (i < max) {
+                ids[i] = (msg_id_t)id;
+                if (cnt < max) {
+                    cnt++;
+                }
+            }
+        }
+    }
+#endif
+    return (cnt);
+}
+
+bool cmt_pool_stats(cmt_pool_id_t pool, cmt_pool_stats_t* stats) {
+    if (pool == CMT_POOL_US_TIMERS) {
+        stats->size = CMT_US_TIMERS_MAX;
+        stats->in_use = _us_timers_in_use;
+        stats->peak = _us_timers_peak;
+        return (true);
+    }
+    return (cmt_heap_stats(pool, stats));
+}
+
+void cmt_msg_budget_set(msg_id_t id, uint32_t budget_us) {
+    if (id < MSG_ID_CNT) {
+        _msg_budget_us[id] = budget_us;
+    }
+}
+
+uint32_t cmt_msg_budget_get(msg_id_t id) {
+    return (id < MSG_ID_CNT ? _msg_budget_us[id] : 0);
+}
+
+uint32_t cmt_budget_viol_total(uint8_t corenum) {
+    return (_budget_viol_total[corenum & 0x01]);
+}
+
+int cmt_budget_viol_count(uint8_t corenum) {
+    uint32_t total = _budget_viol_total[corenum & 0x01];
+    return ((int)(total < CMT_BUDGET_VIOL_ENTRIES ? total : CMT_BUDGET_VIOL_ENTRIES));
+}
+
+bool cmt_budget_viol_get(uint8_t corenum, int n, cmt_budget_viol_t* rec) {
+    corenum &= 0x01;
+    if (n < 0 || n >= cmt_budget_viol_count(corenum)) {
+        return (false);
+    }
+    uint32_t idx = (_budget_viol_total[corenum] - 1 - (uint32_t)n) % CMT_BUDGET_VIOL_ENTRIES;
+    memcpy(rec, &_budget_viol[corenum][idx], sizeof(cmt_budget_viol_t));
+    return (true);
+}
+
+void cmt_budget_viol_clear() {
+    _budget_clear_req[0] = true;
+    _budget_clear_req[1] = true;
+}
+
+uint32_t cmt_stuck_get(uint8_t corenum, cmt_budget_viol_t* rec) {
+    corenum &= 0x01;
+    uint32_t cnt = _stuck_cnt[corenum];
+    if (cnt > 0) {
+        memcpy(rec, &_stuck[corenum], sizeof(cmt_budget_viol_t));
+    }
+    return (cnt);
+}
+
+void cmt_msg_deadline_in_us(cmt_msg_t* msg, uint32_t us) {
+    uint32_t deadline = time_us_32() + us;
+    msg->deadline = (deadline ? deadline : 1); // 0 is 'no deadline'
+}
+
+bool cmt_deadline_stats_enabled() {
+    return (CMT_DEADLINE_STATS != 0);
+}
+
+bool cmt_deadline_stats_get(uint8_t corenum, msg_id_t id, cmt_deadline_stats_t* stats) {
+    bool dispatched = false;
+#if CMT_DEADLINE_STATS
+    if (corenum < 2 && id < MSG_ID_CNT) {
+        memcpy(stats, &_deadline_stats[corenum][id], sizeof(cmt_deadline_stats_t));
+        dispatched = (stats->count > 0);
+    }
+#endif
+    return (dispatched);
+}
+
+void cmt_deadline_stats_reset() {
+    _deadline_reset_req[0] = true;
+    _deadline_reset_req[1] = true;
+}
+
+void cmt_msg_prof_reset() {
+    _msg_prof_reset_req[0] = true;
+    _msg_prof_reset_req[1] = true;
+}
+
+bool cmt_trace_available() {
+    return (CMT_TRACE != 0);
+}
+
+bool cmt_trace_enable(bool enable) {
+    bool was = _trace_enabled;
+    _trace_enabled = (enable && CMT_TRACE != 0);
+    return (was);
+}
+
+void cmt_trace_clear() {
+    bool was = cmt_trace_enable(false);
+#if CMT_TRACE
+    _trace_widx[0] = 0;
+    _trace_widx[1] = 0;
+#endif
+    cmt_trace_enable(was);
+}
+
+int cmt_trace_count(uint8_t corenum) {
+    int cnt = 0;
+#if CMT_TRACE
+    if (corenum < 2) {
+        cnt = (int)min(_trace_widx[corenum], CMT_TRACE_ENTRIES);
+    }
+#endif
+    return (cnt);
+}
+
+bool cmt_trace_get(uint8_t corenum, int n, cmt_trace_rec_t* rec) {
+    bool exists = false;
+#if CMT_TRACE
+    int cnt = cmt_trace_count(corenum);
+    if (n >= 0 && n < cnt) {
+        uint32_t first = _trace_widx[corenum] - cnt;
+        memcpy(rec, &_trace_ring[corenum][(first + n) % CMT_TRACE_ENTRIES], sizeof(cmt_trace_rec_t));
+        exists = true;
+    }
+#endif
+    return (exists);
+}
+
 void cmt_run_after_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data) {
     // For 'run after', we schedule ourself a sleep message with the `sleep_fn`
     // and `user_data` as the data.
@@ -286,6 +704,61 @@ void cmt_run_after_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data) {
     schedule_msg_in_ms(ms, &sleep_msg);
 }
 
+int32_t cmt_run_after_us(uint32_t us, cmt_sleep_fn sleep_fn, void* user_data) {
+    cmt_msg_t sleep_msg;
+    cmt_msg_init2(&sleep_msg, MSG_CMT_SLEEP, _cmt_handle_sleep);
+    sleep_msg.data.cmt_sleep.sleep_fn = sleep_fn;
+    sleep_msg.data.cmt_sleep.user_data = user_data;
+    return (schedule_msg_in_us(us, &sleep_msg));
+}
+
+int32_t schedule_core0_msg_in_us(uint32_t us, const cmt_msg_t* msg) {
+    return (_schedule_core_msg_in_us(0, us, msg));
+}
+
+int32_t schedule_core1_msg_in_us(uint32_t us, const cmt_msg_t* msg) {
+    return (_schedule_core_msg_in_us(1, us, msg));
+}
+
+int32_t schedule_msg_in_us(uint32_t us, const cmt_msg_t* msg) {
+    return (_schedule_core_msg_in_us((uint8_t)get_core_num(), us, msg));
+}
+
+int32_t cmt_us_timer_cancel(int32_t timer_id) {
+    int32_t remaining = -1;
+    uint idx = ((uint32_t)timer_id & 0xFF);
+    if (timer_id <= 0 || idx >= CMT_US_TIMERS_MAX) {
+        return (remaining);
+    }
+    uint32_t flags = spin_lock_blocking(_us_timer_lock);
+    cmt_us_timer_t* t = &_us_timers[idx];
+    if (t->in_use && t->seq == (uint16_t)((uint32_t)timer_id >> 8)) {
+        cmt_us_timer_t** pnext = &_us_timer_ll;
+        while (*pnext && *pnext != t) {
+            pnext = &(*pnext)->next;
+        }
+        if (*pnext) {
+            bool was_first = (_us_timer_ll == t);
+            *pnext = t->next;
+            t->in_use = false;
+            _us_timers_in_use--;
+            uint64_t now = time_us_64();
+            remaining = (t->t_due > now ? (int32_t)(t->t_due - now) : 0);
+            if (was_first) {
+                if (_us_timer_ll) {
+                    _us_timers_run_due();
+                }
+                else {
+                    hardware_alarm_cancel(_us_alarm_num);
+                }
+            }
+        }
+    }
+    spin_unlock(_us_timer_lock, flags);
+
+    return (remaining);
+}
+
 void schedule_core0_msg_in_ms(int32_t ms, const cmt_msg_t* msg) {
     _schedule_core_msg_in_ms(0, ms, msg);
 }
@@ -423,6 +896,10 @@ void message_loop(msg_handler_fn fstart) {
             psa->retrieved = 0;
             psa_sec->t_active = psa->t_active;
             psa->t_active = 0;
+            psa_sec->retrieved_any = psa->retrieved_any;
+            psa->retrieved_any = 0;
+            psa_sec->t_active_any = psa->t_active_any;
+            psa->t_active_any = 0;
             #if PICO_RP2350
             psa_sec->interrupt_status = nvic_hw->iser[corenum]; // On RP2350 this is an array[2]
             #else
@@ -434,6 +911,28 @@ void message_loop(msg_handler_fn fstart) {
             psa->t_msg_longest = 0;
             psa_sec->ts_psa = psa->ts_psa;
             psa->ts_psa = t_start;
+#if CMT_BUDGET_ACTION > 0
+            _budget_viol_log(corenum);
+#endif
+        }
+        // Reset the message profile if requested
+        if (_msg_prof_reset_req[corenum]) {
+#if CMT_MSG_PROFILE
+            memset(_msg_prof[corenum], 0, sizeof(_msg_prof[corenum]));
+#endif
+            _msg_prof_reset_req[corenum] = false;
+        }
+        if (_budget_clear_req[corenum]) {
+            _budget_viol_total[corenum] = 0;
+            _budget_viol_logged[corenum] = 0;
+            _stuck_cnt[corenum] = 0;
+            _budget_clear_req[corenum] = false;
+        }
+        if (_deadline_reset_req[corenum]) {
+#if CMT_DEADLINE_STATS
+            memset(_deadline_stats[corenum], 0, sizeof(_deadline_stats[corenum]));
+#endif
+            _deadline_reset_req[corenum] = false;
         }
 
         // If this is Core-0, check the inter-core fifo to see if there is something from
@@ -443,22 +942,44 @@ void message_loop(msg_handler_fn fstart) {
                 // Yes...
                 debug_trace("runon_core0 executing\n");
                 const cmt_msg_t* c1msg = (const cmt_msg_t*)multicore_fifo_pop_blocking_inline();
+#if CMT_TRACE
+                uint64_t t_runon = now_us();
+#endif
                 // There should be a handler, as it shouldn't have been sent here otherwise.
                 if (c1msg->hdlr != NULL_MSG_HDLR) {
-                    c1msg->hdlr(&msg);
+                    // Pass the Core-1 message, as the handler may return values in it.
+                    _run_hdlr(corenum, c1msg->hdlr, (cmt_msg_t*)c1msg);
+                }
+#if CMT_TRACE
+                if (_trace_enabled) {
+                    _trace_record(corenum, c1msg, t_runon, now_us() - t_runon, 0, CMT_TRACE_FLG_RUNON);
                 }
+#endif
                 debug_trace("runon_core0 returning\n");
                 multicore_fifo_push_blocking_inline((uint32_t)c1msg);
             }
         }
-        if (get_msg_function(&msg)) {
+        // Deferred work (from interrupt handlers) is taken ahead of the queued messages,
+        // then messages with a deadline (earliest first), then the core's queue.
+        // When there is nothing for this core, take work from the shared queue.
+        bool from_any = false;
+        if (cmt_dwork_get(corenum, &msg) || get_core_deadline_msg_nowait(corenum, &msg)
+            || get_msg_function(&msg) || (from_any = get_coreany_msg_nowait(&msg))) {
             psa->retrieved += 1; // A message was retrieved, count it
+#if CMT_DEADLINE_STATS
+            if (msg.deadline != 0) {
+                _deadline_record(corenum, &msg, (uint32_t)t_start);
+            }
+#endif
+#if CMT_TRACE
+            uint16_t qdepth = (_trace_enabled ? (uint16_t)get_core_msg_queue_level(corenum) : 0);
+#endif
             _msg_curlast[corenum] = msg.id;
             // cmt_msg_hdlrs_verify(); // Check the handlers lookup table
             // Find the handler
             //  Does the message designate a handler?
             if (msg.hdlr != NULL_MSG_HDLR) {
-                msg.hdlr(&msg);
+                _run_hdlr(corenum, msg.hdlr, &msg);
                 // cmt_msg_hdlrs_verify(); // Check the handlers lookup table
             }
             if (!msg.abort) {
@@ -466,7 +987,7 @@ void message_loop(msg_handler_fn fstart) {
                 while (!msg.abort && handler_entry) {
                     if (handler_entry->corenum == corenum || handler_entry->corenum == MSG_HDLR_CORE_BOTH) {
                         // cmt_msg_hdlrs_verify(); // Check the handlers lookup table
-                        handler_entry->handler(&msg);
+                        _run_hdlr(corenum, handler_entry->handler, &msg);
                         // cmt_msg_hdlrs_verify(); // Check the handlers lookup table
                     }
                     handler_entry = handler_entry->next;
@@ -476,22 +997,41 @@ void message_loop(msg_handler_fn fstart) {
             uint64_t now = now_us();
             uint64_t t_this_msg = now - t_start;
             psa->t_active += t_this_msg;
+            if (from_any) {
+                psa->retrieved_any += 1;
+                psa->t_active_any += t_this_msg;
+            }
             // Update the 'longest' message if needed
             if (t_this_msg > psa->t_msg_longest) {
                 psa->t_msg_longest = t_this_msg;
                 psa->msg_longest = msg.id;
             }
+#if CMT_MSG_PROFILE
+            _msg_prof_record(corenum, &msg, t_this_msg);
+#endif
+#if CMT_TRACE
+            if (_trace_enabled) {
+                _trace_record(corenum, &msg, t_start, t_this_msg, qdepth, 0);
+            }
+#endif
+        }
+        else {
+            tight_loop_contents();  // Nothing to do (a no-op on the device, a yield on a host)
         }
     } while (1);
 }
 
 void cmt_modinit() {
-    // Clear out the message handler table
+    // Clear out the message handler table and set the default handler time budgets
     for (int i = 0; i < MSG_ID_CNT; i++) {
         cmt_msg_hdlrs[i] = (cmt_msg_hdlr_ll_ent_t*)NULL;
+        _msg_budget_us[i] = CMT_MSG_BUDGET_DEFAULT_US;
     }
-    // PWM is used to generate a 100µs interrupt that is used for
-    // scheduled messages, sleep, and the regular housekeeping message.
+    // The 'started' handlers do the (one time) module initialization.
+    _msg_budget_us[MSG_LOOP_STARTED] = 0;
+    // PWM is used to generate a recurring interrupt that is used for
+    // scheduled messages and sleep. It is 1001 counts of clk_sys/150, so it is
+    // 1ms at 150MHz, but about 1.2ms at 125MHz (the periodic timers use µs time).
     // (the PWM outputs are not directed to GPIO pins)
     //
     pwm_config cfg = pwm_get_default_config();
@@ -521,6 +1061,16 @@ void cmt_modinit() {
     cmt_smd_ll = (cmt_schmsgdata_ll_ent_t*)NULL;
     mutex_exit(&sm_mutex);
 
+    // Check the message handlers every 30 seconds (on Core1).
+    cmt_periodic_init(&_hdlrs_verify_periodic, "hdlrs_verify", Seconds_ms(30), 0, CMT_PERIODIC_SKIP, _hdlrs_verify_periodic_fn, NULL, 1);
+    cmt_periodic_start(&_hdlrs_verify_periodic);
+
+    // The microsecond timers are multiplexed on a hardware alarm.
+    _us_timer_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    _us_timer_ll = NULL;
+    _us_alarm_num = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(_us_alarm_num, _on_us_alarm);
+
     // Enable the PWM and interrupts from it.
     irq_set_enabled(PWM_DEFAULT_IRQ_NUM(), true);
     pwm_set_enabled(CMT_PWM_RECINT_SLICE, true);
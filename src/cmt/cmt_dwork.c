@@ -0,0 +1,165 @@
+/**
+ * Cooperative Multi-Tasking - Deferred Work from Interrupt Handlers.
+ *
+ * Registration of the deferred work sources and taking the work for the message loops.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+
+#include "cmt_dwork.h"
+
+#include "board.h"
+
+#include "pico/stdlib.h"
+
+// ######################################################################################
+// Data                                                                               ###
+// ######################################################################################
+
+volatile bool cmt_dwork_pending[2];
+
+static cmt_dwork_slot_t* _slots[2];   // Registered slots for each core
+static cmt_dwork_ring_t* _rings[2];   // Registered rings for each core
+static bool _rings_first[2];          // Look at the rings before the slots next time
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+/**
+ * @brief Set the deadline on the message for work from a source with a deadline.
+ *
+ * @return true If the deadline has already passed (the work is late)
+ */
+static bool _set_deadline(cmt_msg_t* msg, uint32_t t_post, uint32_t deadline_us) {
+    uint32_t deadline = t_post + deadline_us;
+    msg->deadline = (deadline ? deadline : 1); // 0 is 'no deadline'
+    return ((int32_t)(time_us_32() - deadline) > 0);
+}
+
+/**
+ * @brief Take the work from the first slot (of a core) that has been posted to.
+ *
+ * @return true If there was work (it's in the message)
+ */
+static bool _slot_take(uint8_t corenum, cmt_msg_t* msg) {
+    for (cmt_dwork_slot_t* slot = _slots[corenum]; slot; slot = slot->next) {
+        uint32_t posted = slot->posted;
+        if (posted != slot->taken) {
+            __dmb();
+            cmt_msg_init_ctrl(msg, slot->id, slot->hdlr, (slot->id == MSG_EXEC));
+            msg->data.value32u = slot->value;
+            if (slot->deadline_us && _set_deadline(msg, slot->t_post, slot->deadline_us)) {
+                slot->missed++;
+            }
+            slot->coalesced += (posted - slot->taken - 1);
+            slot->taken = posted;
+            return (true);
+        }
+    }
+    return (false);
+}
+
+/**
+ * @brief Take the next entry from the first ring (of a core) that isn't empty.
+ *
+ * @return true If there was work (it's in the message)
+ */
+static bool _ring_take(uint8_t corenum, cmt_msg_t* msg) {
+    for (cmt_dwork_ring_t* ring = _rings[corenum]; ring; ring = ring->next) {
+        uint32_t tail = ring->tail;
+        if (ring->head != tail) {
+            __dmb();
+            cmt_msg_init_ctrl(msg, ring->id, ring->hdlr, (ring->id == MSG_EXEC));
+            msg->data.value32u = ring->buf[tail & ring->mask];
+            if (ring->deadline_us && _set_deadline(msg, ring->t_post, ring->deadline_us)) {
+                ring->missed++;
+            }
+            __dmb();
+            ring->tail = tail + 1;
+            return (true);
+        }
+    }
+    return (false);
+}
+
+
+// ######################################################################################
+// Public Methods                                                                     ###
+// ######################################################################################
+
+void cmt_dwork_slot_init(cmt_dwork_slot_t* slot, const char* name, msg_id_t id, msg_handler_fn hdlr, uint8_t corenum) {
+    slot->name = name;
+    slot->id = id;
+    slot->hdlr = hdlr;
+    slot->corenum = corenum & 0x01;
+    slot->posted = 0;
+    slot->value = 0;
+    slot->taken = 0;
+    slot->coalesced = 0;
+    slot->deadline_us = 0;
+    slot->t_post = 0;
+    slot->missed = 0;
+    uint32_t flags = save_and_disable_interrupts();
+    slot->next = _slots[slot->corenum];
+    _slots[slot->corenum] = slot;
+    restore_interrupts_from_disabled(flags);
+}
+
+void cmt_dwork_ring_init(cmt_dwork_ring_t* ring, uint32_t* buf, uint32_t size, const char* name, msg_id_t id, msg_handler_fn hdlr, uint8_t corenum) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        board_panic("!!! cmt_dwork_ring_init: Size (%lu) must be a power of 2 !!!", size);
+    }
+    ring->name = name;
+    ring->id = id;
+    ring->hdlr = hdlr;
+    ring->corenum = corenum & 0x01;
+    ring->buf = buf;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->deadline_us = 0;
+    ring->t_post = 0;
+    ring->missed = 0;
+    uint32_t flags = save_and_disable_interrupts();
+    ring->next = _rings[ring->corenum];
+    _rings[ring->corenum] = ring;
+    restore_interrupts_from_disabled(flags);
+}
+
+bool cmt_dwork_get(uint8_t corenum, cmt_msg_t* msg) {
+    // Like `cmt_exec_init`, work delivered as MSG_EXEC is only handled by its handler.
+    if (!cmt_dwork_pending[corenum]) {
+        return (false);
+    }
+    // Clear the pending flag before looking, so a post made while looking isn't missed.
+    cmt_dwork_pending[corenum] = false;
+    __dmb();
+    // The slots and the rings take turns, so that a slot that is posted to all the time
+    // (like a character ready interrupt) can't keep the rings from being taken.
+    bool rings_first = _rings_first[corenum];
+    bool got = (rings_first ? _ring_take(corenum, msg) : _slot_take(corenum, msg));
+    if (got) {
+        _rings_first[corenum] = !rings_first;
+    }
+    else {
+        got = (rings_first ? _slot_take(corenum, msg) : _ring_take(corenum, msg));
+    }
+    if (got) {
+        // There may be more work. Look again next time.
+        cmt_dwork_pending[corenum] = true;
+    }
+    return (got);
+}
+
+const cmt_dwork_slot_t* cmt_dwork_slots(uint8_t corenum) {
+    return (_slots[corenum & 0x01]);
+}
+
+const cmt_dwork_ring_t* cmt_dwork_rings(uint8_t corenum) {
+    return (_rings[corenum & 0x01]);
+}
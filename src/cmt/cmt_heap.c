@@ -17,17 +17,19 @@
 
 #include <stdio.h>
 
-/* Enough entries for 4 handlers for each possible message (of course, they can be used as needed) */
-#define CMT_MHLLENT_CNT (256*4)
+/* Sized for the handler registrations actually made (CMT_MHLLENT_CNT in cmt.h) */
 cmt_msg_hdlr_ll_ent_t mhllent_pool[CMT_MHLLENT_CNT];
 cmt_msg_hdlr_ll_ent_t* mhllent_free;
+static uint16_t _mhllent_in_use;
+static uint16_t _mhllent_peak;
 /** @brief `smllent_mutex` is used for allocating and freeing scheduled msg link-list entries. */
 auto_init_mutex(mhllent_mutex);
 
-/* Allow for 32 outstanding scheduled messages (includes 'sleep') */
-#define CMT_SCHEDULED_MESSAGES_MAX 32
+/* Outstanding scheduled messages (includes 'sleep') (CMT_SCHEDULED_MESSAGES_MAX in cmt.h) */
 cmt_schmsgdata_ll_ent_t smdllent_pool[CMT_SCHEDULED_MESSAGES_MAX]; // Global for debugging
 cmt_schmsgdata_ll_ent_t* smdllent_free; // Global for debugging
+static uint16_t _smdllent_in_use;
+static uint16_t _smdllent_peak;
 /** @brief `smllent_mutex` is used for allocating and freeing scheduled msg link-list entries. */
 auto_init_mutex(smllent_mutex);
 
@@ -37,9 +39,12 @@ cmt_msg_hdlr_ll_ent_t* cmt_alloc_mhllent() {
     mutex_enter_blocking(&mhllent_mutex);
     cmt_msg_hdlr_ll_ent_t* ent = mhllent_free;
     if (ent == (cmt_msg_hdlr_ll_ent_t*)NULL) {
-        board_panic("!!! cmt_alloc_mhllent - Out of Message Handler LL entries. !!!");
+        board_panic("!!! cmt_alloc_mhllent - Out of Message Handler LL entries (CMT_MHLLENT_CNT: %d). !!!", CMT_MHLLENT_CNT);
     }
     mhllent_free = ent->next;
+    if (++_mhllent_in_use > _mhllent_peak) {
+        _mhllent_peak = _mhllent_in_use;
+    }
     ent->in_use = true;
     ent->next = (cmt_msg_hdlr_ll_ent_t*)NULL;
     mutex_exit(&mhllent_mutex);
@@ -53,6 +58,7 @@ void cmt_return_mhllent(cmt_msg_hdlr_ll_ent_t* mhllent) {
         mhllent->in_use = false;
         mhllent->next = mhllent_free;
         mhllent_free = mhllent;
+        _mhllent_in_use--;
     }
     mutex_exit(&mhllent_mutex);
 }
@@ -71,9 +77,12 @@ cmt_schmsgdata_ll_ent_t* cmt_alloc_smdllent() {
                 i, msg->id, msg->hdlr, smd->corenum, smd->ms_requested, smd->remaining, (void*)ent, (void*)ent->next, (char)(ent->in_use ? 'Y' : 'N'));
             ent++;
         }
-        board_panic("\n!!! cmt_alloc_smdllent - Out of Scheduled Message Data LL entries. !!!");
+        board_panic("\n!!! cmt_alloc_smdllent - Out of Scheduled Message Data LL entries (CMT_SCHEDULED_MESSAGES_MAX: %d). !!!", CMT_SCHEDULED_MESSAGES_MAX);
     }
     smdllent_free = ent->next;
+    if (++_smdllent_in_use > _smdllent_peak) {
+        _smdllent_peak = _smdllent_in_use;
+    }
     ent->in_use = true;
     ent->next = (cmt_schmsgdata_ll_ent_t*)NULL;
     mutex_exit(&smllent_mutex);
@@ -89,6 +98,7 @@ void cmt_return_smdllent(cmt_schmsgdata_ll_ent_t* smdllent) {
     smdllent->in_use = false;
     smdllent->next = smdllent_free;
     smdllent_free = smdllent;
+    _smdllent_in_use--;
     mutex_exit(&smllent_mutex);
 }
 
@@ -105,6 +115,24 @@ cmt_msg_hdlr_ll_ent_t* cmt_check_mhllent(cmt_msg_hdlr_ll_ent_t* ent, int ref_val
 }
 
 
+bool cmt_heap_stats(cmt_pool_id_t pool, cmt_pool_stats_t* stats) {
+    switch (pool) {
+        case CMT_POOL_HDLRS:
+            stats->size = CMT_MHLLENT_CNT;
+            stats->in_use = _mhllent_in_use;
+            stats->peak = _mhllent_peak;
+            return (true);
+        case CMT_POOL_SCHMSGS:
+            stats->size = CMT_SCHEDULED_MESSAGES_MAX;
+            stats->in_use = _smdllent_in_use;
+            stats->peak = _smdllent_peak;
+            return (true);
+        default:
+            return (false);
+    }
+}
+
+
 void cmt_heap_modinit() {
     // Link all of our entries into the free lists.
     mhllent_free = &mhllent_pool[0];
@@ -114,7 +142,11 @@ void cmt_heap_modinit() {
         mhllent_pool[i + 1].in_use = false;
         mhllent_pool[i + 1].next = (cmt_msg_hdlr_ll_ent_t*)NULL;
     }
+    _mhllent_in_use = 0;
+    _mhllent_peak = 0;
     smdllent_free = &smdllent_pool[0];
+    _smdllent_in_use = 0;
+    _smdllent_peak = 0;
     for (int i = 0; i < (CMT_SCHEDULED_MESSAGES_MAX - 1); i++) {
         smdllent_pool[i].in_use = false;
         smdllent_pool[i].next = &smdllent_pool[i + 1];
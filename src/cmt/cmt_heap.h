@@ -16,6 +16,7 @@ extern "C" {
 #endif
 
 #include "cmt_t.h"
+#include "cmt.h"
 
 #include "pico/stdlib.h"
 
@@ -85,6 +86,15 @@ extern void cmt_return_smdllent(cmt_schmsgdata_ll_ent_t* smllent);
  */
 extern cmt_msg_hdlr_ll_ent_t* cmt_check_mhllent(cmt_msg_hdlr_ll_ent_t* ent, int ref_value1, int ref_value2);
 
+/**
+ * @brief Get the usage of one of the heap pools (handler or scheduled message entries).
+ *
+ * @param pool CMT_POOL_HDLRS or CMT_POOL_SCHMSGS
+ * @param stats Pointer to the stats structure to fill in
+ * @return true If the pool is one of the heap pools
+ */
+extern bool cmt_heap_stats(cmt_pool_id_t pool, cmt_pool_stats_t* stats);
+
 extern void cmt_heap_modinit();
 
 #ifdef __cplusplus
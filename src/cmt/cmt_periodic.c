@@ -0,0 +1,177 @@
+/**
+ * Cooperative Multi-Tasking - Periodic Timers.
+ *
+ * Counts the periodic timer expirations (from a hardware alarm set for the next one due)
+ * and runs the timer functions from the deferred work of the timer's core.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+
+#include "cmt_periodic.h"
+
+#include "board.h"
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/stdlib.h"
+
+// ######################################################################################
+// Data                                                                               ###
+// ######################################################################################
+
+static cmt_periodic_t* _periodics;          // Registered timers
+static cmt_periodic_t* _periodic_tbl[CMT_PERIODIC_MAX]; // Registered timers by index (the posted value)
+static uint _periodic_cnt;
+static spin_lock_t* _periodic_lock;         // Guards the expiration times and the alarm (both cores and the alarm irq)
+static int _periodic_alarm_num = -1;
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+/**
+ * @brief Count the expirations of the timers that are due, and set the alarm for the
+ * next one. Must be called with the `_periodic_lock` held.
+ */
+static void _periodics_run_due(void) {
+    while (true) {
+        uint64_t now = time_us_64();
+        uint64_t t_first = UINT64_MAX;
+        for (cmt_periodic_t* pt = _periodics; pt; pt = pt->next) {
+            if (!pt->active) {
+                continue;
+            }
+            if (pt->t_next <= now) {
+                // Keep the phase. The next is from when this was due, not from now. If
+                // more than one period has passed, each of them is an expiration.
+                uint64_t period_us = (uint64_t)pt->period_ms * 1000;
+                uint64_t n = ((now - pt->t_next) / period_us) + 1;
+                pt->t_next += (n * period_us);
+                pt->expirations += (uint32_t)n;
+                cmt_dwork_post(&pt->slot, pt->index);
+            }
+            if (pt->t_next < t_first) {
+                t_first = pt->t_next;
+            }
+        }
+        if (t_first == UINT64_MAX) {
+            hardware_alarm_cancel(_periodic_alarm_num);
+            break;
+        }
+        // If the time was missed while setting the alarm, count it now.
+        if (!hardware_alarm_set_target(_periodic_alarm_num, from_us_since_boot(t_first))) {
+            break;
+        }
+    }
+}
+
+
+// ######################################################################################
+// Interrupt Handlers                                                                 ###
+// ######################################################################################
+
+/**
+ * @brief Periodic timer alarm handler.
+ *
+ * @param alarm_num The hardware alarm number (the one claimed for the periodic timers)
+ */
+static void _on_periodic_alarm(uint alarm_num) {
+    uint32_t flags = spin_lock_blocking(_periodic_lock);
+    _periodics_run_due();
+    spin_unlock(_periodic_lock, flags);
+}
+
+
+// ######################################################################################
+// Message Handlers                                                                   ###
+// ######################################################################################
+
+static void _handle_periodic(cmt_msg_t* msg) {
+    cmt_periodic_t* pt = _periodic_tbl[msg->data.value32u % CMT_PERIODIC_MAX];
+    uint32_t expirations = pt->expirations;
+    uint32_t due = expirations - pt->handled;
+    pt->handled = expirations;
+    if (!pt->active || due == 0) {
+        return;
+    }
+    uint32_t runs = 1;
+    if (due > 1) {
+        pt->overruns += (due - 1);
+        runs = (pt->policy == CMT_PERIODIC_CATCHUP ? due : 1);
+        if (runs > CMT_PERIODIC_CATCHUP_MAX) {
+            runs = CMT_PERIODIC_CATCHUP_MAX;
+        }
+        pt->skipped += (due - runs);
+    }
+    while (runs-- > 0 && pt->active) {
+        pt->runs++;
+        pt->fn(pt);
+    }
+}
+
+
+// ######################################################################################
+// Public Methods                                                                     ###
+// ######################################################################################
+
+void cmt_periodic_init(cmt_periodic_t* pt, const char* name, uint32_t period_ms, uint32_t phase_ms,
+    cmt_periodic_policy_t policy, cmt_periodic_fn fn, void* user_data, uint8_t corenum) {
+    if (period_ms == 0) {
+        board_panic("!!! cmt_periodic_init: '%s' period must be > 0 !!!", name);
+    }
+    pt->name = name;
+    pt->fn = fn;
+    pt->user_data = user_data;
+    pt->period_ms = period_ms;
+    pt->phase_ms = phase_ms;
+    pt->policy = policy;
+    pt->corenum = corenum & 0x01;
+    pt->active = false;
+    pt->t_next = 0;
+    pt->expirations = 0;
+    pt->handled = 0;
+    pt->runs = 0;
+    pt->overruns = 0;
+    pt->skipped = 0;
+    uint32_t flags = save_and_disable_interrupts();
+    if (_periodic_cnt >= CMT_PERIODIC_MAX) {
+        restore_interrupts_from_disabled(flags);
+        board_panic("!!! cmt_periodic_init: Too many periodic timers (CMT_PERIODIC_MAX: %d) !!!", CMT_PERIODIC_MAX);
+    }
+    pt->index = (uint8_t)_periodic_cnt;
+    _periodic_tbl[_periodic_cnt++] = pt;
+    if (_periodic_alarm_num < 0) {
+        // The timers are multiplexed on a hardware alarm (claimed with the first timer).
+        _periodic_lock = spin_lock_instance(spin_lock_claim_unused(true));
+        _periodic_alarm_num = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(_periodic_alarm_num, _on_periodic_alarm);
+    }
+    restore_interrupts_from_disabled(flags);
+    cmt_dwork_slot_init(&pt->slot, name, MSG_PERIODIC_RT, _handle_periodic, pt->corenum);
+    flags = spin_lock_blocking(_periodic_lock);
+    pt->next = _periodics;
+    __dmb();
+    _periodics = pt;
+    spin_unlock(_periodic_lock, flags);
+}
+
+void cmt_periodic_start(cmt_periodic_t* pt) {
+    uint32_t flags = spin_lock_blocking(_periodic_lock);
+    pt->handled = pt->expirations;
+    pt->t_next = time_us_64() + ((uint64_t)(pt->phase_ms ? pt->phase_ms : pt->period_ms) * 1000);
+    pt->active = true;
+    _periodics_run_due();   // Sets the alarm if this is now the next one due
+    spin_unlock(_periodic_lock, flags);
+}
+
+void cmt_periodic_stop(cmt_periodic_t* pt) {
+    // The alarm might still be set for it. When it goes off the alarm is set for the next.
+    pt->active = false;
+}
+
+const cmt_periodic_t* cmt_periodics(void) {
+    return (_periodics);
+}
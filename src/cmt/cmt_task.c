@@ -0,0 +1,122 @@
+/**
+ * Cooperative Multi-Tasking - Tasks (stackless coroutines).
+ *
+ * Runs task functions from messages posted to the task's core.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+
+#include "cmt_task.h"
+#include "cmt.h"
+
+#include "board.h"
+
+#include "pico/stdlib.h"
+
+// ######################################################################################
+// Local Method Declarations                                                          ###
+// ######################################################################################
+
+static void _post_task_msg(cmt_task_t* task);
+static void _task_run(cmt_task_t* task);
+
+
+// ######################################################################################
+// Run-After/Delay/Sleep Methods                                                      ###
+// ######################################################################################
+
+static void _task_sleep_done(void* user_data) {
+    _task_run((cmt_task_t*)user_data);
+}
+
+
+// ######################################################################################
+// Message Handlers                                                                   ###
+// ######################################################################################
+
+static void _handle_task_run(cmt_msg_t* msg) {
+    _task_run((cmt_task_t*)msg->data.ptr);
+}
+
+
+// ######################################################################################
+// Local Methods                                                                      ###
+// ######################################################################################
+
+static void _post_task_msg(cmt_task_t* task) {
+    cmt_msg_t msg;
+    cmt_msg_init_ctrl(&msg, MSG_CMT_TASK, _handle_task_run, true);
+    msg.data.ptr = task;
+    if (task->corenum == 0) {
+        post_to_core0(&msg);
+    }
+    else {
+        post_to_core1(&msg);
+    }
+}
+
+static void _task_run(cmt_task_t* task) {
+    if (!task->running) {
+        return; // A stray resume after the task ended.
+    }
+    cmt_pt_state_t state = task->fn(task);
+    switch (state) {
+        case CMT_PT_YIELDED:
+            // Go to the back of the queue so the waiting messages get processed.
+            _post_task_msg(task);
+            break;
+        case CMT_PT_ENDED:
+            task->running = false;
+            if (task->done_fn) {
+                task->done_fn(task);
+            }
+            break;
+        case CMT_PT_WAITING:
+        default:
+            // Something else will resume it.
+            break;
+    }
+}
+
+
+// ######################################################################################
+// Public Methods                                                                     ###
+// ######################################################################################
+
+void cmt_task_start(cmt_task_t* task, cmt_task_fn fn, cmt_task_done_fn done_fn, void* user_data) {
+    if (task->running) {
+        board_panic("!!! cmt_task_start: Task is already running !!!");
+    }
+    task->lc = 0;
+    task->corenum = (uint8_t)get_core_num();
+    task->timed_out = false;
+    task->fn = fn;
+    task->done_fn = done_fn;
+    task->user_data = user_data;
+    task->result = 0;
+    task->t_wait = 0;
+    task->running = true;
+    _post_task_msg(task);
+}
+
+void cmt_task_resume(cmt_task_t* task) {
+    _post_task_msg(task);
+}
+
+void cmt_task_resume_after_ms(cmt_task_t* task, int32_t ms) {
+    // `cmt_run_after_ms` schedules on the calling core, which is the task's core
+    // (this is called from within the task function).
+    cmt_run_after_ms(ms, _task_sleep_done, task);
+}
+
+void cmt_task_resume_hdlr(cmt_msg_t* msg) {
+    cmt_task_t* task = (cmt_task_t*)msg->data.ptr;
+    if (task->corenum == get_core_num()) {
+        _task_run(task);
+    }
+    else {
+        _post_task_msg(task);
+    }
+}
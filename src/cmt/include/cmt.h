@@ -21,6 +21,141 @@ extern "C" {
 
 #include "pico.h"
 
+/**
+ * @brief Per-message-ID profiling of the message handler run time.
+ *
+ * Enabled by defining `CMT_MSG_PROFILE=1` (done for the debug builds). It costs
+ * about 28KB of RAM (one entry for each possible message ID for each core).
+ */
+#ifndef CMT_MSG_PROFILE
+#define CMT_MSG_PROFILE 0
+#endif
+
+/**
+ * @brief Per-message-ID deadline statistics (count, misses and lateness).
+ *
+ * Enabled by defining `CMT_DEADLINE_STATS=1` (done for the debug builds). It costs
+ * about 6KB of RAM (one entry for each possible message ID for each core). The
+ * deadline ordering of the messages doesn't depend on it.
+ */
+#ifndef CMT_DEADLINE_STATS
+#define CMT_DEADLINE_STATS 0
+#endif
+
+/** @brief Number of log2 buckets in a message profile histogram. */
+#define CMT_MSG_PROF_BUCKETS 16
+
+/**
+ * @brief Message dispatch trace recorder.
+ *
+ * Enabled by defining `CMT_TRACE=1`. Each core records the messages it dispatches into
+ * its own ring of `CMT_TRACE_ENTRIES` records (16 bytes each). The rings can be dumped
+ * (`.cmttrace dump`) and converted to a Chrome/Perfetto trace with `tools/cmt_trace2json.py`.
+ */
+#ifndef CMT_TRACE
+#define CMT_TRACE 0
+#endif
+#ifndef CMT_TRACE_ENTRIES
+#define CMT_TRACE_ENTRIES 256
+#endif
+
+/**
+ * @brief CMT pool sizes (entries).
+ *
+ * The pools are statically allocated. The sizes can be set for a build. Use the peak
+ * usage (`cmt_pool_stats`, `.cmtpools` command) measured with all of the modules running
+ * to size them. Running out of a pool is a panic.
+ *
+ * CMT_MHLLENT_CNT: Message handler registrations (`cmt_msg_hdlr_add`)
+ * CMT_SCHEDULED_MESSAGES_MAX: Outstanding scheduled messages (including `cmt_run_after_ms`)
+ */
+#ifndef CMT_MHLLENT_CNT
+#define CMT_MHLLENT_CNT 32
+#endif
+#ifndef CMT_SCHEDULED_MESSAGES_MAX
+#define CMT_SCHEDULED_MESSAGES_MAX 32
+#endif
+
+/**
+ * @brief Number of microsecond timers that can be pending at one time.
+ *
+ * The microsecond timers are multiplexed on one hardware alarm.
+ */
+#ifndef CMT_US_TIMERS_MAX
+#define CMT_US_TIMERS_MAX 16
+#endif
+
+/**
+ * @brief Message handler time budgets.
+ *
+ * Each handler run for a message is timed. If it runs longer than the budget for the
+ * message ID, a violation is recorded (with the handler address). The budget for an ID
+ * is `CMT_MSG_BUDGET_DEFAULT_US` until it is set with `cmt_msg_budget_set` (0 is no budget).
+ * The default is no budget, so budgets are set for the IDs that have a time requirement.
+ *
+ * `CMT_BUDGET_ACTION` is what else is done for a violation:
+ *  0: Nothing (record only)
+ *  1: Log them (`debug_printf`). The core logs the violations recorded since the last
+ *     log once a second (from its message loop, not from the handler that was over)
+ *  2: Log them and break (`__breakpoint`) for an attached debugger when it occurs
+ */
+#ifndef CMT_MSG_BUDGET_DEFAULT_US
+#define CMT_MSG_BUDGET_DEFAULT_US 0
+#endif
+#ifndef CMT_BUDGET_ACTION
+    #if defined(DEBUG_MODE) && (DEBUG_MODE != 0)
+        #define CMT_BUDGET_ACTION 1
+    #else
+        #define CMT_BUDGET_ACTION 0
+    #endif
+#endif
+/** @brief Number of budget violations kept (per core). */
+#ifndef CMT_BUDGET_VIOL_ENTRIES
+#define CMT_BUDGET_VIOL_ENTRIES 16
+#endif
+
+/**
+ * @brief Stuck handler watchdog.
+ *
+ * The 1ms recurring interrupt checks how long each core has been in the current handler.
+ * If it is longer than `CMT_STUCK_MS` the core is recorded as stuck (once for a handler run).
+ * If `CMT_STUCK_PANIC` is set, it panics (showing the handler) instead.
+ */
+#ifndef CMT_STUCK_MS
+#define CMT_STUCK_MS 500
+#endif
+#ifndef CMT_STUCK_PANIC
+#define CMT_STUCK_PANIC 0
+#endif
+
+/** @brief Trace record flag: The core number (0|1) */
+#define CMT_TRACE_FLG_CORE  0x01
+/** @brief Trace record flag: Handler was run for the other core (`runon_core0`) */
+#define CMT_TRACE_FLG_RUNON 0x02
+
+/**
+ * @brief Identifies a CMT pool.
+ * @ingroup cmt
+ */
+typedef enum CMT_POOL_ID_ {
+    CMT_POOL_HDLRS = 0,     // Message handler registrations
+    CMT_POOL_SCHMSGS,       // Scheduled messages
+    CMT_POOL_US_TIMERS,     // Microsecond timers
+    CMT_POOL_CNT,
+} cmt_pool_id_t;
+
+/**
+ * @brief CMT pool usage.
+ *
+ * @param size The number of entries
+ * @param in_use The number of entries currently in use
+ * @param peak The most entries that have been in use
+ */
+typedef struct cmt_pool_stats_ {
+    uint16_t size;
+    uint16_t in_use;
+    uint16_t peak;
+} cmt_pool_stats_t;
 
 typedef struct cmt_sm_counts_ {
     uint16_t total;
@@ -33,11 +168,89 @@ typedef struct _PROC_STATUS_ACCUM_ {
     volatile uint64_t ts_psa;                       // Timestamp of last PS Accumulator/sec update
     volatile uint64_t t_active;
     volatile uint32_t retrieved;
+    volatile uint32_t retrieved_any;                // Messages taken from the shared (either core) queue
+    volatile uint64_t t_active_any;                 // Time spent handling messages from the shared queue
     volatile uint32_t interrupt_status;
     volatile msg_id_t msg_longest;
     volatile uint64_t t_msg_longest;
 } proc_status_accum_t;
 
+/**
+ * @brief Run time profile for a message ID on a core.
+ *
+ * Times are in microseconds and cover all of the handlers run for a message.
+ * Histogram bucket `n` counts the messages that took [2^n, 2^(n+1)) µs
+ * (bucket 0 also counts 0µs, the last bucket counts everything longer).
+ *
+ * @param t_total Total time
+ * @param count Number of messages handled
+ * @param t_min Shortest time
+ * @param t_max Longest time
+ * @param hdlr_max The handler set on the message that took the longest (for MSG_EXEC)
+ * @param hist Histogram of the times (log2 buckets)
+ */
+typedef struct cmt_msg_prof_ {
+    uint64_t t_total;
+    uint32_t count;
+    uint32_t t_min;
+    uint32_t t_max;
+    msg_handler_fn hdlr_max;
+    uint16_t hist[CMT_MSG_PROF_BUCKETS];
+} cmt_msg_prof_t;
+
+/**
+ * @brief Deadline statistics for a message ID on a core.
+ *
+ * A message misses its deadline if it is dispatched after its deadline.
+ *
+ * @param count Number of messages with a deadline dispatched
+ * @param missed Number of those that were dispatched after their deadline
+ * @param late_max The most (µs) a message was late
+ */
+typedef struct cmt_deadline_stats_ {
+    uint32_t count;
+    uint32_t missed;
+    uint32_t late_max;
+} cmt_deadline_stats_t;
+
+/**
+ * @brief Message handler time budget violation (or stuck handler) record.
+ *
+ * @param t_start Time (µs since boot, low 32 bits) the handler was started
+ * @param elapsed Time (µs) the handler ran (for a stuck handler, when it was detected)
+ * @param hdlr The handler
+ * @param budget The budget (µs) for the message ID
+ * @param msg_id The message ID
+ */
+typedef struct cmt_budget_viol_ {
+    uint32_t t_start;
+    uint32_t elapsed;
+    msg_handler_fn hdlr;
+    uint32_t budget;
+    msg_id_t msg_id;
+} cmt_budget_viol_t;
+
+/**
+ * @brief Message dispatch trace record.
+ *
+ * This is the binary format of the ring entries (and of the dump). All values are little-endian.
+ *
+ * @param t_start Time (µs since boot, low 32 bits) the dispatch started
+ * @param duration Time (µs) used by the handler(s)
+ * @param hdlr Address of the handler set on the message, or the first registered handler
+ * @param msg_id The message ID
+ * @param flags CMT_TRACE_FLG_xxx values
+ * @param qdepth Number of messages still in the core's queue when this one was retrieved
+ */
+typedef struct cmt_trace_rec_ {
+    uint32_t t_start;
+    uint32_t duration;
+    uint32_t hdlr;
+    uint8_t msg_id;
+    uint8_t flags;
+    uint16_t qdepth;
+} cmt_trace_rec_t;
+
 /**
  * @brief The Current/Last message processed for a core.
  *
@@ -100,6 +313,18 @@ extern void cmt_msg_hdlr_rm(msg_id_t id, msg_handler_fn hdlr);
  */
 extern void cmt_msg_hdlr_rm_for_core(msg_id_t id, msg_handler_fn hdlr, uint corenum);
 
+/**
+ * @brief Indicates if a handler is registered for a message on a core.
+ * @ingroup cmt
+ *
+ * For a message that is only worth posting when a module has registered for it.
+ *
+ * @param id The message ID
+ * @param corenum The core number (a handler for both cores counts)
+ * @return true A handler is registered
+ */
+extern bool cmt_msg_hdlr_exists(msg_id_t id, uint corenum);
+
 /**
  * @brief Verify that all of the message handler entries are valid.
  * @ingroup cmt
@@ -145,6 +370,205 @@ extern bool cmt_message_loops_running();
  */
 extern void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum);
 
+/**
+ * @brief Indicates if the per-message-ID profiling is built in.
+ * @ingroup cmt
+ *
+ * @return true Profiling is available (`CMT_MSG_PROFILE` is set)
+ */
+extern bool cmt_msg_prof_enabled();
+
+/**
+ * @brief Get the run time profile for a message ID on a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param id The message ID
+ * @param prof Pointer to a profile structure to fill with values
+ * @return true If the message has been handled (at least once) since the last reset
+ */
+extern bool cmt_msg_prof_get(uint8_t corenum, msg_id_t id, cmt_msg_prof_t* prof);
+
+/**
+ * @brief Get the message IDs that have used the most (total) time on a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param ids Array to fill with the message IDs (largest total time first)
+ * @param max The maximum number of IDs to return (size of `ids`)
+ * @return int The number of IDs filled in
+ */
+extern int cmt_msg_prof_top(uint8_t corenum, msg_id_t* ids, int max);
+
+/**
+ * @brief Reset the message profiles for both cores.
+ * @ingroup cmt
+ *
+ * The reset is performed by each core's message loop (before it handles the next message),
+ * so it is safe to call from either core.
+ */
+extern void cmt_msg_prof_reset();
+
+/**
+ * @brief Get the usage of a CMT pool.
+ * @ingroup cmt
+ *
+ * @param pool The pool
+ * @param stats Pointer to the stats structure to fill in
+ * @return true If the pool ID is valid
+ */
+extern bool cmt_pool_stats(cmt_pool_id_t pool, cmt_pool_stats_t* stats);
+
+/**
+ * @brief Set a deadline on a message (µs from now).
+ * @ingroup cmt
+ *
+ * A message with a deadline that is posted to a core is taken ahead of the messages
+ * without one (earliest deadline first). Set this just before posting.
+ *
+ * @param msg The message
+ * @param us Microseconds from now the message should be dispatched by
+ */
+extern void cmt_msg_deadline_in_us(cmt_msg_t* msg, uint32_t us);
+
+/**
+ * @brief Get the deadline statistics for a message ID on a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param id The message ID
+ * @param stats Pointer to a stats structure to fill with values
+ * @return true If a message with a deadline has been dispatched since the last reset
+ * @return false If not, or the statistics aren't built in (`CMT_DEADLINE_STATS`)
+ */
+extern bool cmt_deadline_stats_get(uint8_t corenum, msg_id_t id, cmt_deadline_stats_t* stats);
+
+/**
+ * @brief Indicates if the deadline statistics are built in.
+ * @ingroup cmt
+ *
+ * @return true The statistics are available (`CMT_DEADLINE_STATS` is set)
+ */
+extern bool cmt_deadline_stats_enabled();
+
+/**
+ * @brief Reset the deadline statistics for both cores.
+ * @ingroup cmt
+ *
+ * The reset is performed by each core's message loop, like `cmt_msg_prof_reset`.
+ */
+extern void cmt_deadline_stats_reset();
+
+/**
+ * @brief Set the handler time budget for a message ID.
+ * @ingroup cmt
+ *
+ * @param id The message ID
+ * @param budget_us The time (µs) each handler for the message should finish within (0 for no budget)
+ */
+extern void cmt_msg_budget_set(msg_id_t id, uint32_t budget_us);
+
+/**
+ * @brief Get the handler time budget for a message ID.
+ * @ingroup cmt
+ *
+ * @param id The message ID
+ * @return uint32_t The budget (µs), 0 if none
+ */
+extern uint32_t cmt_msg_budget_get(msg_id_t id);
+
+/**
+ * @brief Total number of handler time budget violations for a core (since the last clear).
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @return uint32_t The number of violations
+ */
+extern uint32_t cmt_budget_viol_total(uint8_t corenum);
+
+/**
+ * @brief Number of budget violation records available for a core (up to `CMT_BUDGET_VIOL_ENTRIES`).
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @return int The number of records
+ */
+extern int cmt_budget_viol_count(uint8_t corenum);
+
+/**
+ * @brief Get a budget violation record for a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param n The record number, 0 is the most recent
+ * @param rec Pointer to a record to fill in
+ * @return true If the record exists
+ */
+extern bool cmt_budget_viol_get(uint8_t corenum, int n, cmt_budget_viol_t* rec);
+
+/**
+ * @brief Clear the budget violation records and the stuck handler records for both cores.
+ * @ingroup cmt
+ *
+ * The clear is performed by each core's message loop, like `cmt_msg_prof_reset`.
+ */
+extern void cmt_budget_viol_clear();
+
+/**
+ * @brief Get the last stuck handler detected for a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param rec Pointer to a record to fill in
+ * @return uint32_t The number of times a stuck handler was detected for the core (rec is only filled if >0)
+ */
+extern uint32_t cmt_stuck_get(uint8_t corenum, cmt_budget_viol_t* rec);
+
+/**
+ * @brief Enable/disable the message dispatch trace recording.
+ * @ingroup cmt
+ *
+ * Recording is off at start-up. The recording should be disabled before reading the records.
+ *
+ * @param enable True to record, False to stop recording
+ * @return true If recording was enabled before this call
+ */
+extern bool cmt_trace_enable(bool enable);
+
+/**
+ * @brief Indicates if the message dispatch trace is built in.
+ * @ingroup cmt
+ *
+ * @return true Tracing is available (`CMT_TRACE` is set)
+ */
+extern bool cmt_trace_available();
+
+/**
+ * @brief Clear the message dispatch trace records for both cores.
+ * @ingroup cmt
+ */
+extern void cmt_trace_clear();
+
+/**
+ * @brief Number of trace records available for a core (up to `CMT_TRACE_ENTRIES`).
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @return int The number of records
+ */
+extern int cmt_trace_count(uint8_t corenum);
+
+/**
+ * @brief Get a trace record for a core.
+ * @ingroup cmt
+ *
+ * @param corenum The core number (0|1)
+ * @param n The record number, 0 is the oldest available
+ * @param rec Pointer to a record to fill in
+ * @return true If the record exists
+ */
+extern bool cmt_trace_get(uint8_t corenum, int n, cmt_trace_rec_t* rec);
+
 /**
  * @brief Run a method after a period of milliseconds.
  * @ingroup cmt
@@ -278,6 +702,62 @@ extern bool scheduled_msg_exists2(msg_id_t sched_msg_id, msg_handler_fn hdlr);
  */
 extern cmt_sm_counts_t scheduled_msgs_waiting();
 
+/**
+ * @brief Run (call) a function after a number of microseconds.
+ * @ingroup cmt
+ *
+ * Like `cmt_run_after_ms`, but with microsecond resolution (backed by a hardware alarm).
+ * The function is run from the message loop of the calling core, so the time is the
+ * minimum time. It can be later if the core is busy with other messages.
+ *
+ * @param us Microseconds to wait
+ * @param sleep_fn Function to call
+ * @param user_data Data to pass to the function
+ * @return int32_t Timer ID (>0) that can be used to cancel, or -1 if no timer is available
+ */
+extern int32_t cmt_run_after_us(uint32_t us, cmt_sleep_fn sleep_fn, void* user_data);
+
+/**
+ * @brief Schedule a message to be posted to Core 0 after a number of microseconds.
+ * @ingroup cmt
+ *
+ * @param us Microseconds to wait
+ * @param msg The message to post (it is copied)
+ * @return int32_t Timer ID (>0) that can be used to cancel, or -1 if no timer is available
+ */
+extern int32_t schedule_core0_msg_in_us(uint32_t us, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to be posted to Core 1 after a number of microseconds.
+ * @ingroup cmt
+ *
+ * @param us Microseconds to wait
+ * @param msg The message to post (it is copied)
+ * @return int32_t Timer ID (>0) that can be used to cancel, or -1 if no timer is available
+ */
+extern int32_t schedule_core1_msg_in_us(uint32_t us, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to be posted to the calling core after a number of microseconds.
+ * @ingroup cmt
+ *
+ * @param us Microseconds to wait
+ * @param msg The message to post (it is copied)
+ * @return int32_t Timer ID (>0) that can be used to cancel, or -1 if no timer is available
+ */
+extern int32_t schedule_msg_in_us(uint32_t us, const cmt_msg_t* msg);
+
+/**
+ * @brief Cancel a microsecond timer.
+ * @ingroup cmt
+ *
+ * Typically used to cancel a timeout when the operation completes first.
+ *
+ * @param timer_id The ID returned when the timer was scheduled
+ * @return int32_t Microseconds remaining, or -1 if the timer had already expired (or wasn't found)
+ */
+extern int32_t cmt_us_timer_cancel(int32_t timer_id);
+
 /**
  * @brief Enter into a message processing loop.
  * @ingroup cmt
@@ -0,0 +1,232 @@
+/**
+ * Cooperative Multi-Tasking - Deferred Work from Interrupt Handlers.
+ *
+ * Interrupt handlers hand work to a core's message loop through a deferred work
+ * source rather than posting to the core's queue. Posting never disables interrupts,
+ * never takes a lock, and never panics - it is a few stores.
+ *
+ * There are two kinds of sources:
+ *  Slot: Repeated posts before the work is taken collapse into one (the latest value is
+ *        delivered). Used for 'something is ready' events (character ready, periodic tick).
+ *  Ring: Each post is delivered (in order) until the ring is full, then posts are dropped.
+ *
+ * Each source must have a single producer (one IRQ source) and is consumed by the message
+ * loop of the core it is registered for. The message loop takes deferred work ahead of
+ * the messages in its queue, and handles it as a message with the source's ID and handler
+ * (`data.value32u` is the posted value).
+ *
+ * A source can be given a deadline (µs from the post). The work is then delivered as a
+ * message with that deadline, so late handling is recorded as a deadline miss.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _CMT_DWORK_H_
+#define _CMT_DWORK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cmt_t.h"
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+/**
+ * @brief Coalescing deferred work slot.
+ *
+ * @param name Name for status display
+ * @param id The message ID to deliver the work as
+ * @param hdlr The handler to set on the message (or NULL to use the registered handlers)
+ * @param corenum The core that takes the work
+ * @param posted Number of posts (incremented by the producer)
+ * @param value Value of the latest post
+ * @param taken The `posted` count when the work was last taken
+ * @param coalesced Number of posts that were collapsed into another
+ * @param deadline_us Deadline (µs from the post) for handling the work, or 0 for none
+ * @param t_post Time (µs, low 32 bits) of the latest post (if there is a deadline)
+ * @param missed Number of times the work was taken after its deadline
+ */
+typedef struct CMT_DWORK_SLOT_ {
+    const char* name;
+    msg_id_t id;
+    msg_handler_fn hdlr;
+    uint8_t corenum;
+    volatile uint32_t posted;
+    volatile uint32_t value;
+    uint32_t taken;
+    uint32_t coalesced;
+    uint32_t deadline_us;
+    volatile uint32_t t_post;
+    uint32_t missed;
+    struct CMT_DWORK_SLOT_* next;
+} cmt_dwork_slot_t;
+
+/**
+ * @brief Deferred work ring (each post is delivered).
+ *
+ * @param name Name for status display
+ * @param id The message ID to deliver the work as
+ * @param hdlr The handler to set on the message (or NULL to use the registered handlers)
+ * @param corenum The core that takes the work
+ * @param buf The value buffer (size is a power of 2)
+ * @param mask Buffer size - 1
+ * @param head Number of posts accepted (producer)
+ * @param tail Number of posts taken (consumer)
+ * @param dropped Number of posts dropped because the ring was full
+ * @param deadline_us Deadline (µs from the post) for handling the work, or 0 for none
+ * @param t_post Time (µs, low 32 bits) of the post that made the ring non-empty (if there is a deadline)
+ * @param missed Number of times the work was taken after its deadline
+ */
+typedef struct CMT_DWORK_RING_ {
+    const char* name;
+    msg_id_t id;
+    msg_handler_fn hdlr;
+    uint8_t corenum;
+    uint32_t* buf;
+    uint32_t mask;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    uint32_t deadline_us;
+    volatile uint32_t t_post;
+    uint32_t missed;
+    struct CMT_DWORK_RING_* next;
+} cmt_dwork_ring_t;
+
+/** @brief Set by a post to indicate that a core has deferred work to check for. */
+extern volatile bool cmt_dwork_pending[2];
+
+/**
+ * @brief Post to a deferred work slot. Safe to call from an interrupt handler.
+ * @ingroup cmt
+ *
+ * @param slot The slot (registered with `cmt_dwork_slot_init`)
+ * @param value Value to deliver (replaces the value of a post not yet taken)
+ */
+static inline void cmt_dwork_post(cmt_dwork_slot_t* slot, uint32_t value) {
+    if (slot->deadline_us) {
+        slot->t_post = time_us_32();
+    }
+    slot->value = value;
+    __dmb();
+    slot->posted++;
+    cmt_dwork_pending[slot->corenum] = true;
+}
+
+/**
+ * @brief Post to a deferred work ring. Safe to call from an interrupt handler.
+ * @ingroup cmt
+ *
+ * @param ring The ring (registered with `cmt_dwork_ring_init`)
+ * @param value Value to deliver
+ * @return true If posted, false if the ring was full (counted as dropped)
+ */
+static inline bool cmt_dwork_ring_post(cmt_dwork_ring_t* ring, uint32_t value) {
+    uint32_t head = ring->head;
+    if (head - ring->tail > ring->mask) {
+        ring->dropped++;
+        return (false);
+    }
+    if (ring->deadline_us && head == ring->tail) {
+        // The deadline of the waiting work is measured from the oldest post (conservative).
+        ring->t_post = time_us_32();
+    }
+    ring->buf[head & ring->mask] = value;
+    __dmb();
+    ring->head = head + 1;
+    cmt_dwork_pending[ring->corenum] = true;
+    return (true);
+}
+
+/**
+ * @brief Initialize and register a deferred work slot.
+ * @ingroup cmt
+ *
+ * This must be done before the slot is posted to (not from an interrupt handler).
+ *
+ * @param slot The slot to initialize (must stay valid)
+ * @param name Name for status display
+ * @param id The message ID to deliver the work as
+ * @param hdlr The handler to set on the message (or NULL to use the registered handlers)
+ * @param corenum The core to deliver the work to
+ */
+extern void cmt_dwork_slot_init(cmt_dwork_slot_t* slot, const char* name, msg_id_t id, msg_handler_fn hdlr, uint8_t corenum);
+
+/**
+ * @brief Initialize and register a deferred work ring.
+ * @ingroup cmt
+ *
+ * This must be done before the ring is posted to (not from an interrupt handler).
+ *
+ * @param ring The ring to initialize (must stay valid)
+ * @param buf The value buffer (must stay valid)
+ * @param size The number of entries in the buffer (must be a power of 2)
+ * @param name Name for status display
+ * @param id The message ID to deliver the work as
+ * @param hdlr The handler to set on the message (or NULL to use the registered handlers)
+ * @param corenum The core to deliver the work to
+ */
+extern void cmt_dwork_ring_init(cmt_dwork_ring_t* ring, uint32_t* buf, uint32_t size, const char* name, msg_id_t id, msg_handler_fn hdlr, uint8_t corenum);
+
+/**
+ * @brief Set the deadline for the work posted to a slot.
+ * @ingroup cmt
+ *
+ * @param slot The slot
+ * @param deadline_us Microseconds from the post the work should be handled by (0 for none)
+ */
+static inline void cmt_dwork_slot_deadline(cmt_dwork_slot_t* slot, uint32_t deadline_us) {
+    slot->deadline_us = deadline_us;
+}
+
+/**
+ * @brief Set the deadline for the work posted to a ring.
+ * @ingroup cmt
+ *
+ * @param ring The ring
+ * @param deadline_us Microseconds from the post the work should be handled by (0 for none)
+ */
+static inline void cmt_dwork_ring_deadline(cmt_dwork_ring_t* ring, uint32_t deadline_us) {
+    ring->deadline_us = deadline_us;
+}
+
+/**
+ * @brief Get the next deferred work for a core as a message.
+ * @ingroup cmt
+ *
+ * Used by the message loop. The slots and the rings take turns (when both have work), so
+ * neither can keep the other from being taken.
+ *
+ * @param corenum The core (must be the calling core)
+ * @param msg Message to fill in
+ * @return true If there was work
+ */
+extern bool cmt_dwork_get(uint8_t corenum, cmt_msg_t* msg);
+
+/**
+ * @brief Get the first registered deferred work slot for a core (for status display).
+ * @ingroup cmt
+ *
+ * @param corenum The core
+ * @return cmt_dwork_slot_t* The first slot (follow `next`), or NULL
+ */
+extern const cmt_dwork_slot_t* cmt_dwork_slots(uint8_t corenum);
+
+/**
+ * @brief Get the first registered deferred work ring for a core (for status display).
+ * @ingroup cmt
+ *
+ * @param corenum The core
+ * @return cmt_dwork_ring_t* The first ring (follow `next`), or NULL
+ */
+extern const cmt_dwork_ring_t* cmt_dwork_rings(uint8_t corenum);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _CMT_DWORK_H_
@@ -0,0 +1,152 @@
+/**
+ * Cooperative Multi-Tasking - Periodic Timers.
+ *
+ * A periodic timer runs a function on a core every period (milliseconds). The
+ * expirations are kept on a fixed phase from when the timer was started (the next
+ * expiration is always the last expiration plus the period), so a late run doesn't
+ * move the following ones. The times are kept in microseconds (`time_us_64`), and the
+ * expirations are counted by a hardware alarm that is set for the next timer due, so the
+ * periods are real milliseconds and don't drift. The expirations are handed to the core
+ * as deferred work, so there is no list insert each period.
+ *
+ * If the core doesn't get to a timer before it expires again, the expirations that
+ * were missed are counted as overruns, and the timer's policy determines whether the
+ * function is run once (skip) or once for each expiration (catch-up).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _CMT_PERIODIC_H_
+#define _CMT_PERIODIC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cmt_dwork.h"
+
+/** @brief Maximum number of periodic timers that can be registered. */
+#ifndef CMT_PERIODIC_MAX
+#define CMT_PERIODIC_MAX 16
+#endif
+
+/** @brief Maximum number of runs made for one catch-up (the rest are skipped). */
+#ifndef CMT_PERIODIC_CATCHUP_MAX
+#define CMT_PERIODIC_CATCHUP_MAX 8
+#endif
+
+/**
+ * @brief What to do when a periodic timer expired more than once before it was run.
+ * @ingroup cmt
+ */
+typedef enum CMT_PERIODIC_POLICY_ {
+    CMT_PERIODIC_SKIP = 0,  // Run once (the missed expirations are skipped)
+    CMT_PERIODIC_CATCHUP,   // Run once for each expiration (up to CMT_PERIODIC_CATCHUP_MAX)
+} cmt_periodic_policy_t;
+
+struct CMT_PERIODIC_;
+
+/**
+ * @brief Function prototype for a periodic timer function.
+ * @ingroup cmt
+ *
+ * @param pt The periodic timer (`user_data` is available from it)
+ */
+typedef void (*cmt_periodic_fn)(struct CMT_PERIODIC_* pt);
+
+/**
+ * @brief Periodic timer.
+ *
+ * The timer is owned by the caller, and must stay valid (it stays registered).
+ *
+ * @param name Name for status display
+ * @param fn The function to run each period
+ * @param user_data Timer specific data
+ * @param period_ms The period in milliseconds
+ * @param phase_ms Milliseconds from the start to the first expiration
+ * @param policy What to do about missed expirations
+ * @param corenum The core the function is run on
+ * @param index The registration index (the value posted to the slot)
+ * @param active True while the timer is started
+ * @param t_next Time (µs since boot) of the next expiration (set by the alarm handler)
+ * @param expirations Number of expirations (incremented by the interrupt handler)
+ * @param handled The `expirations` count when the timer was last run
+ * @param runs Number of times the function was run
+ * @param overruns Number of expirations that occurred before the previous one was run
+ * @param skipped Number of expirations that the function was not run for
+ * @param slot The deferred work slot used to deliver the expirations
+ */
+typedef struct CMT_PERIODIC_ {
+    const char* name;
+    cmt_periodic_fn fn;
+    void* user_data;
+    uint32_t period_ms;
+    uint32_t phase_ms;
+    cmt_periodic_policy_t policy;
+    uint8_t corenum;
+    uint8_t index;
+    volatile bool active;
+    volatile uint64_t t_next;
+    volatile uint32_t expirations;
+    uint32_t handled;
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t skipped;
+    cmt_dwork_slot_t slot;
+    struct CMT_PERIODIC_* next;
+} cmt_periodic_t;
+
+/**
+ * @brief Initialize and register a periodic timer. It isn't started.
+ * @ingroup cmt
+ *
+ * This is done once for a timer (not from an interrupt handler).
+ *
+ * @param pt The timer to initialize (must stay valid)
+ * @param name Name for status display
+ * @param period_ms The period in milliseconds (>0)
+ * @param phase_ms Milliseconds from the start to the first expiration (0 for one period)
+ * @param policy What to do about missed expirations
+ * @param fn The function to run each period
+ * @param user_data Timer specific data
+ * @param corenum The core to run the function on
+ */
+extern void cmt_periodic_init(cmt_periodic_t* pt, const char* name, uint32_t period_ms, uint32_t phase_ms,
+    cmt_periodic_policy_t policy, cmt_periodic_fn fn, void* user_data, uint8_t corenum);
+
+/**
+ * @brief Start (or restart) a periodic timer.
+ * @ingroup cmt
+ *
+ * The first expiration is `phase_ms` from now, then every `period_ms` after that.
+ * The counters are not cleared.
+ *
+ * @param pt The timer (initialized with `cmt_periodic_init`)
+ */
+extern void cmt_periodic_start(cmt_periodic_t* pt);
+
+/**
+ * @brief Stop a periodic timer.
+ * @ingroup cmt
+ *
+ * An expiration that is waiting to be run is dropped.
+ *
+ * @param pt The timer
+ */
+extern void cmt_periodic_stop(cmt_periodic_t* pt);
+
+/**
+ * @brief Get the first registered periodic timer (for status display).
+ * @ingroup cmt
+ *
+ * @return cmt_periodic_t* The first timer (follow `next`), or NULL
+ */
+extern const cmt_periodic_t* cmt_periodics(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _CMT_PERIODIC_H_
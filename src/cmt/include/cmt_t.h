@@ -32,7 +32,7 @@ typedef enum MSG_ID_ {
     MSG_LOOP_STARTED,
     MSG_HWRT_STARTED,
     MSG_APPS_STARTED,
-    MSG_PERIODIC_RT,        // Periodic Repeating Time - Every 16ms (62.5Hz)
+    MSG_PERIODIC_RT,        // Periodic timer expiration (`cmt_periodic`, the timer is the data).
     MSG_CMT_SLEEP,
     MSG_EXEC,               // General purpose message that can be used when specifying a handler.
     MSG_CONFIG_CHANGED,
@@ -40,12 +40,15 @@ typedef enum MSG_ID_ {
     MSG_SW_ACTION,
     MSG_SW_DEBOUNCE,
     MSG_SW_LONGPRESS_DELAY,
+    MSG_CMT_TASK,           // Run a CMT Task (the task is the data).
     //
     // Hardware-Runtime (HWRT) messages 0x60 - 0xBF
     MSG_HWRT_NOOP = 0x60,
     MSG_HWRT_TEST,
     MSG_ROTARY_CHG,
     MSG_STDIO_CHAR_READY,
+    MSG_DSK_WRITE_DONE,     // SD card finished programming written data (the status is the data).
+    MSG_DSK_IO_DONE,        // SD card asynchronous read/write finished (the status is the data).
     //
     // Application functionality (APP) messages 0xC0 - 0xFF
     MSG_APP_NOOP = 0xC0,
@@ -118,6 +121,7 @@ typedef union MSG_DATA_VALUE_ msg_data_value_t;
  * @param abort Controls whether the next registered handler should be run.
  * @param n The message number (set by the posting system)
  * @param t The millisecond time msg was posted (set by the posting system)
+ * @param deadline The µs time (low 32 bits of µs since boot) the message should be dispatched by, or 0 for none
  */
 typedef struct CMT_MSG_ {
     msg_id_t id;
@@ -126,6 +130,7 @@ typedef struct CMT_MSG_ {
     msg_handler_fn hdlr;
     uint32_t n;
     uint32_t t;
+    uint32_t deadline;
 } cmt_msg_t;
 
 static inline void cmt_msg_init_ctrl(cmt_msg_t* msg, msg_id_t id, msg_handler_fn hdlr, bool abort);
@@ -160,6 +165,7 @@ static inline void cmt_msg_init(cmt_msg_t* msg, msg_id_t id) {
     msg->abort = false;
     msg->n = 0;
     msg->t = 0;
+    msg->deadline = 0;
 }
 
 /**
@@ -187,6 +193,7 @@ static inline void cmt_msg_init2(cmt_msg_t* msg, msg_id_t id, msg_handler_fn hdl
     msg->abort = false;
     msg->n = 0;
     msg->t = 0;
+    msg->deadline = 0;
 }
 
 /**
@@ -210,6 +217,7 @@ static inline void cmt_msg_init_ctrl(cmt_msg_t* msg, msg_id_t id, msg_handler_fn
     msg->abort = abort;
     msg->n = 0;
     msg->t = 0;
+    msg->deadline = 0;
 }
 
 /**
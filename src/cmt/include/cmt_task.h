@@ -0,0 +1,183 @@
+/**
+ * Cooperative Multi-Tasking - Tasks (stackless coroutines).
+ *
+ * A task is a function that runs as a series of message handler invocations. It can
+ * give up the core at a wait point (yield, sleep, wait for a condition, wait for a
+ * completion) and continues after that wait point the next time it is run. This allows
+ * long operations (disk operations for example) to be written as straight-line code
+ * without freezing the core's message loop.
+ *
+ * The tasks are 'protothreads'. They do not have their own stack, so local variables
+ * are NOT preserved across a wait point. Values that are needed after a wait point must
+ * be kept in the task (`user_data`, `result`) or be static.
+ *
+ * The continuation point is kept using a `switch` statement, so a wait point macro
+ * cannot be used inside of a `switch` in the task function, and only one wait point
+ * macro can be used on a source line.
+ *
+ * Example:
+ * @code
+ * static cmt_pt_state_t _copy_task(cmt_task_t* task) {
+ *     CMT_PT_BEGIN(task);
+ *     _start_read();
+ *     CMT_PT_WAIT_UNTIL_MS(task, _read_done(), 500);
+ *     if (task->timed_out) {
+ *         CMT_PT_EXIT(task);
+ *     }
+ *     CMT_PT_SLEEP_MS(task, 10);
+ *     ...
+ *     CMT_PT_END(task);
+ * }
+ * @endcode
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _CMT_TASK_H_
+#define _CMT_TASK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cmt_t.h"
+#include "picoutil.h"
+
+/**
+ * @brief The state returned by a task function each time it is run.
+ * @ingroup cmt
+ */
+typedef enum CMT_PT_STATE_ {
+    CMT_PT_WAITING = 0,     // Waiting to be resumed (`cmt_task_resume`)
+    CMT_PT_YIELDED,         // Run again after the messages currently in the queue
+    CMT_PT_ENDED,           // The task has finished
+} cmt_pt_state_t;
+
+struct CMT_TASK_;
+
+/**
+ * @brief Function prototype for a task function.
+ * @ingroup cmt
+ *
+ * @param task The task being run
+ * @return cmt_pt_state_t The state of the task (use the CMT_PT_xxx macros)
+ */
+typedef cmt_pt_state_t (*cmt_task_fn)(struct CMT_TASK_* task);
+
+/**
+ * @brief Function prototype for the function called when a task ends.
+ * @ingroup cmt
+ *
+ * @param task The task that ended
+ */
+typedef void (*cmt_task_done_fn)(struct CMT_TASK_* task);
+
+/**
+ * @brief Task control block.
+ *
+ * The task is owned by the caller, and must stay valid until the task has ended.
+ *
+ * @param lc The local continuation (source line of the wait point to continue from)
+ * @param corenum The core the task runs on (the core it was started from)
+ * @param running True from `cmt_task_start` until the task ends
+ * @param timed_out Set by `CMT_PT_WAIT_UNTIL_MS` if the condition wasn't met in time
+ * @param fn The task function
+ * @param done_fn Function to call when the task ends (or NULL)
+ * @param user_data Task specific data
+ * @param result Task specific result value
+ * @param t_wait Millisecond time the current timed wait started
+ */
+typedef struct CMT_TASK_ {
+    uint16_t lc;
+    uint8_t corenum;
+    volatile bool running;
+    bool timed_out;
+    cmt_task_fn fn;
+    cmt_task_done_fn done_fn;
+    void* user_data;
+    int32_t result;
+    uint32_t t_wait;
+} cmt_task_t;
+
+/** @brief Start of the task function body. */
+#define CMT_PT_BEGIN(task) switch ((task)->lc) { case 0:
+
+/** @brief End of the task function body. */
+#define CMT_PT_END(task) } (task)->lc = 0; return (CMT_PT_ENDED)
+
+/** @brief End the task now. */
+#define CMT_PT_EXIT(task) do { (task)->lc = 0; return (CMT_PT_ENDED); } while (0)
+
+/** @brief Let the messages currently in the queue be processed, then continue. */
+#define CMT_PT_YIELD(task) do { (task)->lc = __LINE__; return (CMT_PT_YIELDED); case __LINE__:; } while (0)
+
+/** @brief Wait (yielding) until the condition is true. */
+#define CMT_PT_WAIT_UNTIL(task, cond) do { (task)->lc = __LINE__; case __LINE__: if (!(cond)) { return (CMT_PT_YIELDED); } } while (0)
+
+/**
+ * @brief Wait (yielding) until the condition is true, or the time (ms) is up.
+ * `task->timed_out` indicates which.
+ */
+#define CMT_PT_WAIT_UNTIL_MS(task, cond, ms) do { \
+    (task)->t_wait = now_ms(); (task)->timed_out = false; (task)->lc = __LINE__; case __LINE__: \
+    if (!(cond)) { if (now_ms() - (task)->t_wait < (uint32_t)(ms)) { return (CMT_PT_YIELDED); } (task)->timed_out = true; } \
+    } while (0)
+
+/** @brief Wait until `cmt_task_resume` is called for the task (from a completion handler, for example). */
+#define CMT_PT_WAIT_RESUME(task) do { (task)->lc = __LINE__; return (CMT_PT_WAITING); case __LINE__:; } while (0)
+
+/** @brief Sleep for a number of milliseconds (other messages are processed). */
+#define CMT_PT_SLEEP_MS(task, ms) do { cmt_task_resume_after_ms((task), (ms)); CMT_PT_WAIT_RESUME(task); } while (0)
+
+/**
+ * @brief Start a task on the calling core.
+ * @ingroup cmt
+ *
+ * The task function is first run from a message, not from within this call.
+ *
+ * @param task The task control block to use (owned by the caller)
+ * @param fn The task function
+ * @param done_fn Function to call when the task ends (or NULL)
+ * @param user_data Task specific data
+ */
+extern void cmt_task_start(cmt_task_t* task, cmt_task_fn fn, cmt_task_done_fn done_fn, void* user_data);
+
+/**
+ * @brief Resume a task that is waiting in `CMT_PT_WAIT_RESUME`.
+ * @ingroup cmt
+ *
+ * This can be called from either core. The task is run on its own core.
+ *
+ * @param task The task to resume
+ */
+extern void cmt_task_resume(cmt_task_t* task);
+
+/**
+ * @brief Resume a task after a number of milliseconds.
+ * @ingroup cmt
+ *
+ * Used by `CMT_PT_SLEEP_MS`.
+ *
+ * @param task The task to resume
+ * @param ms The number of milliseconds
+ */
+extern void cmt_task_resume_after_ms(cmt_task_t* task, int32_t ms);
+
+/**
+ * @brief Message handler that resumes the task in `msg->data.ptr`.
+ * @ingroup cmt
+ *
+ * This can be used as the handler of a completion message so that the task is
+ * continued when the message is processed.
+ *
+ * @param msg The message with the task pointer as its data
+ */
+extern void cmt_task_resume_hdlr(cmt_msg_t* msg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _CMT_TASK_H_
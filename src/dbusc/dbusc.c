@@ -11,7 +11,7 @@
 
 #include "board.h"
 #include "cmt_t.h"
-#include "msgpost.h"
+#include "cmt_dwork.h"
 #include "pio_sm.h"
 #include "shell.h"
 
@@ -27,6 +27,18 @@ static pio_sm_pocfg _cb_monrd_pocfg;
 static pio_sm_pocfg _cb_monwr_pocfg;
 static pio_sm_pocfg _cb_waitclr_pocfg;
 
+// Bus requests from the PIO irq handlers. Every request must be handled, so these
+// are rings (not coalescing slots). The Host is held in WAIT until a request is handled,
+// so only one or two should ever be waiting.
+#define DBUSC_REQ_RING_SIZE 8
+static uint32_t _rdreq_buf[DBUSC_REQ_RING_SIZE];
+static uint32_t _wrreq_buf[DBUSC_REQ_RING_SIZE];
+static cmt_dwork_ring_t _rdreq_ring;
+static cmt_dwork_ring_t _wrreq_ring;
+// The Host is held in WAIT while a request waits, so they are handled ahead of other work
+// and late handling is recorded as a deadline miss.
+#define DBUSC_REQ_DEADLINE_US 100
+
 // ====================================================================
 // Local/Private Method Declarations
 // ====================================================================
@@ -77,12 +89,9 @@ void __isr _irq_pio_rdreq_handler() {
     io_rw_32 pio_irqbits = _cb_monrd_pocfg.pio->irq;
     pio_interrupt_clear(_cb_monrd_pocfg.pio, PIO_RDRQ_IRQ);
     //
-    // Initialize and post the message
+    // Defer the handling to the APP core
     //
-    cmt_msg_t msg;
-    cmt_exec_init(&msg, _rdreq_handler);
-    msg.data.value32u = pio_irqbits;
-    postAPPMsg(&msg);
+    cmt_dwork_ring_post(&_rdreq_ring, pio_irqbits);
 }
 
 /**
@@ -93,12 +102,9 @@ void __isr _irq_pio_wrreq_handler() {
     io_rw_32 pio_irqbits = _cb_monrd_pocfg.pio->irq;
     pio_interrupt_clear(_cb_monwr_pocfg.pio, PIO_WRRQ_IRQ);
     //
-    // Initialize and post the message
+    // Defer the handling to the APP core
     //
-    cmt_msg_t msg;
-    cmt_exec_init(&msg, _wrreq_handler);
-    msg.data.value32u = pio_irqbits;
-    postAPPMsg(&msg);
+    cmt_dwork_ring_post(&_wrreq_ring, pio_irqbits);
 }
 
 
@@ -236,6 +242,11 @@ int dbusc_modinit() {
     if (_cb_waitclr_pocfg.offset < 0) {
         return (_cb_waitclr_pocfg.offset); // Indicate error
     }
+    // Set up the deferred work rings the irq handlers post the requests to (APP core)
+    cmt_dwork_ring_init(&_rdreq_ring, _rdreq_buf, DBUSC_REQ_RING_SIZE, "dbusc_rdreq", MSG_EXEC, _rdreq_handler, 1);
+    cmt_dwork_ring_init(&_wrreq_ring, _wrreq_buf, DBUSC_REQ_RING_SIZE, "dbusc_wrreq", MSG_EXEC, _wrreq_handler, 1);
+    cmt_dwork_ring_deadline(&_rdreq_ring, DBUSC_REQ_DEADLINE_US);
+    cmt_dwork_ring_deadline(&_wrreq_ring, DBUSC_REQ_DEADLINE_US);
     // Set up for the interrupts generated by the PIOs
     irq_set_exclusive_handler(PIO_RD_REQ_IRQ, _irq_pio_rdreq_handler); // Set the IRQ handler
     irq_set_enabled(PIO_RD_REQ_IRQ, false); // Disable the IRQ for now
@@ -12,7 +12,10 @@
 #include "dskops.h"
 
 #include "board.h"
-#include "multicore.h" // Some of the disk commands must be run on Core0
+#include "crc.h"
+#include "msgpost.h"
+#include "multicore.h" // The disk operations are run on Core0 (RPC)
+#include "picoutil.h"
 #include "util.h"
 
 #include "shell.h"
@@ -24,6 +27,45 @@
 
 /** @brief Ctrl-C is Reset Disk */
 #define CMD_RESET_DISK_CHAR '\003'
+/** @brief Number of directory entries read (on Core0) for each `ls` request */
+#define LS_ENTRIES_PER_READ 8
+/** @brief Default number of KB run through each CRC16 kernel by `sdcrc` */
+#define SDCRC_KB_DEFAULT 64
+/** @brief Maximum number of KB for `sdcrc` (it runs in the shell's handler) */
+#define SDCRC_KB_MAX 1024
+/** @brief Default number of sectors read by `sdrd` */
+#define SDRD_SECTORS_DEFAULT 64
+/** @brief Sectors read by each `sdrd` asynchronous read (the buffer size) */
+#define SDRD_BUF_SECTORS 4
+
+/**
+ * @brief State of an `ls` in progress. Shared between the cores.
+ */
+typedef struct ls_state_ {
+    DIR dir;
+    FILINFO finfo[LS_ENTRIES_PER_READ];
+    const char* dirpath;
+    FRESULT fr;
+    int cnt;
+    int total;
+    bool started;
+    bool done;
+} ls_state_t;
+
+/**
+ * @brief State of an `sdrd` in progress. Shared between the cores.
+ */
+typedef struct sdrd_state_ {
+    uint8_t buf[SDRD_BUF_SECTORS * 512];
+    uint32_t sector;    // Next sector to read
+    uint32_t left;      // Sectors left to read
+    uint32_t count;     // Sectors in the read in progress
+    uint32_t total;     // Sectors requested
+    uint16_t crc;       // CRC16 of the data read
+    uint64_t t_start;
+    uint64_t t_total;
+    int status;
+} sdrd_state_t;
 
 // ====================================================================
 // Data Section
@@ -31,11 +73,25 @@
 
 static volatile bool _modinit_called;
 
+static ls_state_t _ls;
+static volatile bool _ls_active;
+
+static sdrd_state_t _sdrd;
+static volatile bool _sdrd_active;
+
 // ====================================================================
 // Local/Private Method/Structure Declarations
 // ====================================================================
 
 static const cmd_handler_entry_t _cmds_ls_entry;
+static const cmd_handler_entry_t _cmds_sdclk_entry;
+static const cmd_handler_entry_t _cmds_sdcrc_entry;
+static const cmd_handler_entry_t _cmds_sdrd_entry;
+static const cmd_handler_entry_t _cmds_sdstats_entry;
+
+static void _handle_sdrd_done(cmt_msg_t* msg);
+static void _ls_read_done(cmt_msg_t* msg, rpc_status_t status, void* user_data);
+static void _reset_disk_done(cmt_msg_t* msg, rpc_status_t status, void* user_data);
 
 
 // ====================================================================
@@ -45,8 +101,9 @@ static const cmd_handler_entry_t _cmds_ls_entry;
 static void _handle_cc_reset_disk(char c) {
     // ^C is used to reset the disks (for example when cards are changed).
     // This must be run on Core0.
-    dsk_reset_sd_c1();
-    shell_puts("\ndisk reset\n");
+    if (dsk_reset_sd_c1(_reset_disk_done, NULL) < 0) {
+        shell_printferr("\ndisk reset could not be requested\n");
+    }
 }
 
 
@@ -70,71 +127,158 @@ static void _delay_action(void* data) {
 // ====================================================================
 
 /**
- * @brief Handle our Housekeeping tasks. This is triggered every ~16ms.
+ * @brief Read the next group of directory entries for the `ls` command.
  *
- * Triggered at 62.5Hz, so 625 times is 10 seconds.
+ * The SD must be accessed from Core0, so this is run there as an RPC. The entries
+ * are returned in the `ls` state (the message data pointer) and displayed on Core1.
  *
- * @param msg Nothing important in the message.
+ * @param msg The message with a pointer to the `ls` state.
  */
-static void _handle_housekeeping(cmt_msg_t* msg) {
-    static uint cnt = 0;
-
-    cnt++;
-}
-
-/**
- * @brief The `ls` command must be run on Core0, so it is handled here.
- *
- * @param msg No parameters for this yet.
- */
-static void _handle_ls(cmt_msg_t* msg) {
+static void _handle_ls_read(cmt_msg_t* msg) {
+    ls_state_t* ls = (ls_state_t*)msg->data.ptr;
     FRESULT fr;
-    DIR dir;
-    FILINFO finfo;
-    // Open the root dir
-    char* dirpath = "/";
-    fr = f_opendir(&dir, dirpath);
-    if (fr != FR_OK) {
-        const char* rerr = FRESULT_str(fr);
-        shell_printferr("Cannon open dir: '%s'  FR: %u - %s\n", dirpath, (uint32_t)fr, rerr);
-        goto _finally;
+    ls->cnt = 0;
+    if (!ls->started) {
+        ls->started = true;
+        fr = f_findfirst(&ls->dir, &ls->finfo[0], ls->dirpath, "*");
     }
-    // Get the first file
-    fr = f_findfirst(&dir, &finfo, dirpath, "*");
-    int cnt = 1;
-    const char* eol = "";
-    do {
-        if (fr == FR_NO_FILE || (fr == FR_OK && !finfo.fname[0])) {
-            if (cnt == 1) {
-                shell_printf("No Files");
-            }
+    else {
+        fr = f_findnext(&ls->dir, &ls->finfo[0]);
+    }
+    while (true) {
+        if (fr == FR_NO_FILE || (fr == FR_OK && !ls->finfo[ls->cnt].fname[0])) {
+            ls->fr = FR_OK;
+            ls->done = true;
             break;
         }
         if (fr != FR_OK) {
-            const char* rerr = FRESULT_str(fr);
-            shell_printferr("Cannot read dir (nf): '%s'  FR: %u - %s\n", dirpath, (uint32_t)fr, rerr);
-            goto _finally;
+            ls->fr = fr;
+            ls->done = true;
+            break;
         }
-        if (finfo.fattrib & AM_DIR) {
-            strcat((char*)&finfo.fname, "/");
+        if (++ls->cnt == LS_ENTRIES_PER_READ) {
+            break;
         }
-        eol = (++cnt % 4 == 0 ? "\n" : "");
-        shell_printf("%-18s%s", finfo.fname, eol);
-        // Get the rest...
-        fr = f_findnext(&dir, &finfo);
+        fr = f_findnext(&ls->dir, &ls->finfo[ls->cnt]);
     }
-    while (true);
-    if (!*eol) {
-        shell_printf("\n");
+    if (ls->done && ls->dir.obj.fs) {
+        // Only close it if it was opened (FATFS clears the FS pointer if the open fails)
+        f_closedir(&ls->dir);
     }
-_finally:
-    return;
+}
+
+/**
+ * @brief Report the end of an `sdrd` (run on Core1).
+ *
+ * @param msg Nothing important in the message (the results are in the `sdrd` state).
+ */
+static void _handle_sdrd_report(cmt_msg_t* msg) {
+    sdrd_state_t* rd = &_sdrd;
+    uint32_t read = rd->total - rd->left;
+    if (rd->status != 0) {
+        shell_printferr("Read failed at sector %lu (error %d)\n", rd->sector, rd->status);
+    }
+    shell_printf("Read %lu sectors in %lu us: %lu KB/s  CRC16: 0x%04X\n", read, (uint32_t)rd->t_total,
+        (uint32_t)(((uint64_t)read * 512 * ONE_SECOND_US) / 1024 / (rd->t_total ? rd->t_total : 1)), rd->crc);
+    _sdrd_active = false;
+}
+
+/**
+ * @brief Finish an `sdrd` and have the results shown (on Core1).
+ */
+static void _sdrd_finish(sdrd_state_t* rd, int status) {
+    rd->t_total = now_us() - rd->t_start;
+    rd->status = status;
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, _handle_sdrd_report);
+    post_to_core1(&msg);
+}
+
+/**
+ * @brief Start the next asynchronous read of an `sdrd` (run on Core0).
+ *
+ * The Core0 message loop keeps running while the card and the DMA are waited for.
+ *
+ * @param msg Nothing important in the message.
+ */
+static void _handle_sdrd_next(cmt_msg_t* msg) {
+    sdrd_state_t* rd = &_sdrd;
+    rd->count = (rd->left < SDRD_BUF_SECTORS ? rd->left : SDRD_BUF_SECTORS);
+    int rc = dsk_sd_read_async(rd->buf, rd->sector, rd->count, _handle_sdrd_done);
+    if (rc != 0) {
+        _sdrd_finish(rd, rc);
+    }
+}
+
+/**
+ * @brief An `sdrd` asynchronous read finished (MSG_DSK_IO_DONE, run on Core0).
+ *
+ * @param msg The status of the read is in `data.status`
+ */
+static void _handle_sdrd_done(cmt_msg_t* msg) {
+    sdrd_state_t* rd = &_sdrd;
+    if (msg->data.status != 0) {
+        _sdrd_finish(rd, msg->data.status);
+        return;
+    }
+    update_crc16(&rd->crc, (const char*)rd->buf, rd->count * 512);
+    rd->sector += rd->count;
+    rd->left -= rd->count;
+    if (rd->left == 0) {
+        _sdrd_finish(rd, 0);
+        return;
+    }
+    _handle_sdrd_next(msg);
 }
 
 // ====================================================================
 // Local/Private Methods
 // ====================================================================
 
+static void _reset_disk_done(cmt_msg_t* msg, rpc_status_t status, void* user_data) {
+    if (status == RPC_TIMEOUT) {
+        shell_printferr("\ndisk reset timed out\n");
+    }
+    else if (msg->data.fr != FR_OK) {
+        const char* rerr = FRESULT_str(msg->data.fr);
+        shell_printferr("\ndisk reset failed  FR: %u - %s\n", (uint32_t)msg->data.fr, rerr);
+    }
+    else {
+        shell_puts("\ndisk reset\n");
+    }
+}
+
+static void _ls_read_done(cmt_msg_t* msg, rpc_status_t status, void* user_data) {
+    ls_state_t* ls = (ls_state_t*)user_data;
+    for (int i = 0; i < ls->cnt; i++) {
+        FILINFO* finfo = &ls->finfo[i];
+        if (finfo->fattrib & AM_DIR) {
+            strcat((char*)&finfo->fname, "/");
+        }
+        ls->total++;
+        shell_printf("%-18s%s", finfo->fname, (ls->total % 4 == 0 ? "\n" : ""));
+    }
+    if (!ls->done) {
+        // Get the next group of entries.
+        if (rpc_on_core(0, msg, _ls_read_done, ls, 0) < 0) {
+            shell_printferr("\nCannot continue listing (no RPC available)\n");
+            _ls_active = false;
+        }
+        return;
+    }
+    if (ls->fr != FR_OK) {
+        const char* rerr = FRESULT_str(ls->fr);
+        shell_printferr("Cannot read dir: '%s'  FR: %u - %s\n", ls->dirpath, (uint32_t)ls->fr, rerr);
+    }
+    else if (ls->total == 0) {
+        shell_printf("No Files\n");
+    }
+    else if (ls->total % 4 != 0) {
+        shell_printf("\n");
+    }
+    _ls_active = false;
+}
+
 static int _exec_ls(int argc, char** argv, const char* unparsed) {
     int retval = -1; // Set up for an error
     if (argc > 2) {
@@ -145,15 +289,169 @@ static int _exec_ls(int argc, char** argv, const char* unparsed) {
     if (argc > 1) {
         // The arg is '-a' to list all.
     }
-    // This must be run on Core0. Set up a message for it.
+    if (_ls_active) {
+        shell_printferr("A listing is already in progress.\n");
+        goto _finally;
+    }
+    // The directory is read on Core0 (a group of entries at a time) and
+    // displayed here as each group is returned.
+    memset(&_ls, 0, sizeof(_ls));
+    _ls.dirpath = "/";
     cmt_msg_t msg;
-    cmt_exec_init(&msg, _handle_ls);
-    runon_core0(&msg);
+    cmt_exec_init(&msg, _handle_ls_read);
+    msg.data.ptr = &_ls;
+    if (rpc_on_core(0, &msg, _ls_read_done, &_ls, 0) < 0) {
+        shell_printferr("Cannot list the directory (no RPC available).\n");
+        goto _finally;
+    }
+    _ls_active = true;
     retval = 0;
 _finally:
     return (retval);
 }
 
+static int _exec_sdclk(int argc, char** argv, const char* unparsed) {
+    if (argc > 1) {
+        cmd_help_display(&_cmds_sdclk_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    dsk_sd_clock_info_t info;
+    if (!dsk_sd_clock_info(&info)) {
+        shell_printferr("The SD card isn't initialized.\n");
+        return (-1);
+    }
+    shell_printf("SPI clock: %lu kHz  (probed: %lu kHz  max: %lu kHz)\n",
+        info.rate / 1000, info.rate_max / 1000, info.rate_cfg / 1000);
+    shell_printf("CRC errors: %lu  Rate drops: %lu  Probe failures: %lu\n", info.crc_errors, info.rate_drops, info.probe_fails);
+    return (0);
+}
+static void _sdstats_print_op(const char* name, const sd_stats_op_t* op) {
+    if (op->count == 0) {
+        return;
+    }
+    shell_printf("%-6s %8lu %5lu %8lu %8lu ", name, op->count, op->errors,
+        (uint32_t)(op->total_us / op->count), op->max_us);
+    // Histogram: count of each (non-empty) bin, with the bin's upper bound in us
+    for (int i = 0; i < SD_STATS_HIST_BINS; i++) {
+        if (op->hist[i]) {
+            if (i == SD_STATS_HIST_BINS - 1) {
+                shell_printf(" >=%lu:%lu", (1ul << i), op->hist[i]);
+            }
+            else {
+                shell_printf(" <%lu:%lu", (2ul << i), op->hist[i]);
+            }
+        }
+    }
+    shell_printf("\n");
+}
+
+static int _exec_sdstats(int argc, char** argv, const char* unparsed) {
+    static const char* cmd_names[SD_STATS_CMD_CNT] = { "CMD17", "CMD18", "CMD24", "CMD25", "CMD13", "CMD12", "Other" };
+    static sd_stats_t stats;
+    static sd_cache_stats_t cstats;
+    if (argc > 2 || (argc > 1 && strcmp(argv[1], "-r") != 0)) {
+        cmd_help_display(&_cmds_sdstats_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (!dsk_sd_stats(&stats, (argc > 1)) || !dsk_sd_cache_stats(&cstats, (argc > 1))) {
+        shell_printferr("The SD card isn't available.\n");
+        return (-1);
+    }
+    shell_printf("Op        Count  Errs   Avg us   Max us  Latency (<us:count)\n");
+    for (int i = 0; i < SD_STATS_CMD_CNT; i++) {
+        _sdstats_print_op(cmd_names[i], &stats.cmd[i]);
+    }
+    _sdstats_print_op("Read", &stats.read);
+    _sdstats_print_op("Write", &stats.write);
+    shell_printf("Busy: %lu waits %llu us  Token wait: %llu us  Timeouts: %lu\n", stats.busy_waits,
+        stats.busy_us, stats.token_us, stats.timeouts);
+    shell_printf("CRC errors: %lu  CRC retries: %lu  Command retries: %lu\n", stats.crc_errors,
+        stats.crc_retries, stats.cmd_retries);
+    uint32_t lookups = cstats.hits + cstats.misses;
+    shell_printf("Cache: %lu/%lu used %lu dirty  Hits: %lu (%lu%%)  Misses: %lu  Evictions: %lu\n",
+        cstats.used, cstats.size, cstats.dirty, cstats.hits, (lookups ? (cstats.hits * 100) / lookups : 0),
+        cstats.misses, cstats.evictions);
+    shell_printf("Cache writes: %lu  Write-backs: %lu (%lu flushes, %lu errors)  Bypassed: %lu\n",
+        cstats.writes, cstats.writebacks, cstats.flushes, cstats.write_errors, cstats.bypassed);
+    return (0);
+}
+
+static int _exec_sdcrc(int argc, char** argv, const char* unparsed) {
+    static const struct {
+        const char* name;
+        uint16_t (*fn)(uint16_t crc, const uint8_t* data, size_t length);
+    } kernels[] = {
+        { "bytewise", crc16_bytewise },
+        { "slice-4", crc16_slice4 },
+        { "slice-8", crc16_slice8 },
+    };
+    static uint8_t block[512];
+    uint32_t kb = SDCRC_KB_DEFAULT;
+    if (argc > 2) {
+        cmd_help_display(&_cmds_sdcrc_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (argc > 1) {
+        bool ok;
+        kb = (uint32_t)uint_from_str(argv[1], &ok);
+        if (!ok || kb == 0 || kb > SDCRC_KB_MAX) {
+            shell_printferr("KB must be 1 to %d.\n", SDCRC_KB_MAX);
+            return (-1);
+        }
+    }
+    for (int i = 0; i < sizeof(block); i++) {
+        block[i] = (uint8_t)(i * 37 + 11);
+    }
+    uint32_t blocks = (kb * 1024) / sizeof(block);
+    uint16_t ref = 0;
+    for (int k = 0; k < ARRAY_ELEMENT_COUNT(kernels); k++) {
+        uint16_t crc = 0;
+        uint64_t t = now_us();
+        for (uint32_t b = 0; b < blocks; b++) {
+            crc ^= kernels[k].fn(0, block, sizeof(block));
+        }
+        t = now_us() - t;
+        if (k == 0) {
+            ref = crc;
+        }
+        shell_printf("%-9s %6lu KB/s  (%lu us for %lu KB)%s\n", kernels[k].name,
+            (uint32_t)(((uint64_t)kb * ONE_SECOND_US) / (t ? t : 1)), (uint32_t)t, kb,
+            (crc == ref ? "" : "  MISMATCH"));
+    }
+    return (0);
+}
+
+static int _exec_sdrd(int argc, char** argv, const char* unparsed) {
+    if (argc < 2 || argc > 3) {
+        cmd_help_display(&_cmds_sdrd_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    bool ok;
+    uint32_t sector = (uint32_t)uint_from_str(argv[1], &ok);
+    uint32_t count = SDRD_SECTORS_DEFAULT;
+    if (ok && argc > 2) {
+        count = (uint32_t)uint_from_str(argv[2], &ok);
+    }
+    if (!ok || count == 0) {
+        cmd_help_display(&_cmds_sdrd_entry, HELP_DISP_USAGE);
+        return (-1);
+    }
+    if (_sdrd_active) {
+        shell_printferr("A read is in progress.\n");
+        return (-1);
+    }
+    _sdrd_active = true;
+    _sdrd.sector = sector;
+    _sdrd.left = count;
+    _sdrd.total = count;
+    _sdrd.crc = 0;
+    _sdrd.status = 0;
+    _sdrd.t_start = now_us();
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, _handle_sdrd_next);
+    post_to_core0(&msg);
+    return (0);
+}
 
 // ====================================================================
 // Public Methods
@@ -172,6 +470,38 @@ static const cmd_handler_entry_t _cmds_ls_entry = {
     "List the files in the current directory.",
 };
 
+static const cmd_handler_entry_t _cmds_sdclk_entry = {
+    _exec_sdclk,
+    4,
+    "sdclk",
+    "",
+    "Show the SD card SPI clock rate and CRC error counts.",
+};
+
+static const cmd_handler_entry_t _cmds_sdcrc_entry = {
+    _exec_sdcrc,
+    4,
+    "sdcrc",
+    "[KB]",
+    "Benchmark the SD CRC16 kernels (KB through each, default 64).",
+};
+
+static const cmd_handler_entry_t _cmds_sdrd_entry = {
+    _exec_sdrd,
+    4,
+    "sdrd",
+    "sector [count]",
+    "Read SD card sectors (default 64) with asynchronous reads (the message loops keep running). Shows the time and the CRC16 of the data.",
+};
+
+static const cmd_handler_entry_t _cmds_sdstats_entry = {
+    _exec_sdstats,
+    4,
+    "sdstats",
+    "[-r]",
+    "Show the SD card command/transfer telemetry and sector cache statistics (-r to reset them after).",
+};
+
 
 void diskcmds_modinit(void) {
     if (_modinit_called) {
@@ -180,6 +510,10 @@ void diskcmds_modinit(void) {
     _modinit_called = true;
 
     cmd_register(&_cmds_ls_entry);
+    cmd_register(&_cmds_sdclk_entry);
+    cmd_register(&_cmds_sdcrc_entry);
+    cmd_register(&_cmds_sdrd_entry);
+    cmd_register(&_cmds_sdstats_entry);
 
     // Register a handler for Ctrl-C to remount the SD Card
     // (same as disk-reset on CP/M)
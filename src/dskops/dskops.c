@@ -16,11 +16,16 @@
 #include "diskio.h"
 
 #include "board.h"
+#include "cmt.h"
 #include "cmt_t.h"
+#include "cmt_dwork.h"
+#include "cmt_periodic.h"
+#include "cmt_task.h"
 #include "debug_support.h"
 #include "hw_config.h"
 #include "msgpost.h"
 #include "multicore.h"
+#include "sd_cache.h"
 #include "sd_card.h"
 
 #include "pico/types.h" // 'uint' and other standard types
@@ -29,6 +34,17 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/** @brief Number of attempts to initialize the card when mounting from a task */
+#define DSK_MOUNT_INIT_TRIES 5
+/** @brief Time (ms) between card initialization attempts when mounting from a task */
+#define DSK_MOUNT_INIT_RETRY_MS 100
+/** @brief Period (ms) of the SD service (write completion, idle stop and read-ahead) */
+#define DSK_SD_SERVICE_MS 2
+/** @brief Sectors read ahead by each run of the SD stream service */
+#define DSK_SD_READ_AHEAD_PER_RUN 2
+/** @brief Period (ms) of writing back the dirty sectors of the SD sector cache */
+#define DSK_SD_CACHE_FLUSH_MS 1000
+
 // ====================================================================
 // Data Section
 // ====================================================================
@@ -40,6 +56,19 @@ static FATFS _fs;
 static char* _drive;
 static bool _mounted;
 
+static cmt_task_t _mount_task;
+static int _mount_tries;
+
+/** @brief Reset requested from Core-1 (`dsk_reset_sd_c1`) */
+static volatile bool _reset_c1_active;
+static rpc_done_fn _reset_c1_done_fn;
+static void* _reset_c1_user_data;
+
+static cmt_periodic_t _sd_service_pt;
+static cmt_periodic_t _sd_cache_flush_pt;
+
+static cmt_dwork_slot_t _sd_async_dma_slot;
+
 /**
  * @brief Shared/common buffer to hold file name/path values.
  */
@@ -49,6 +78,7 @@ static char _filepath[MAX_PATH+1]; // allow for a NULL terminator
 // Local/Private Method Declarations
 // ====================================================================
 
+static void _handle_sd_async_step(cmt_msg_t* msg);
 
 
 // ====================================================================
@@ -65,22 +95,118 @@ static char _filepath[MAX_PATH+1]; // allow for a NULL terminator
 static void _delay_action(void* data) {
 }
 
+/**
+ * @brief Service the SD card: complete a write that the card has finished programming,
+ * stop a streamed transfer that has been idle, and read ahead a few sectors of an open
+ * read. Run by a periodic timer.
+ *
+ * The service is short (a couple of sectors), so the core isn't held up.
+ *
+ * @param pt The periodic timer
+ */
+static void _sd_service(cmt_periodic_t* pt) {
+    sd_service(_sdc, DSK_SD_READ_AHEAD_PER_RUN);
+}
+
+/**
+ * @brief Write back the dirty sectors of the SD sector cache. Run by a periodic timer,
+ * so that written data doesn't stay in the cache for long if FATFS doesn't sync.
+ *
+ * Skipped while an asynchronous transfer is in progress (the card can't be used, so the
+ * write-back would only fail and be counted as a write error). It's done on the next run.
+ *
+ * @param pt The periodic timer
+ */
+static void _sd_cache_flush(cmt_periodic_t* pt) {
+    if (_sdc->async_op != SD_ASYNC_NONE) {
+        return;
+    }
+    sd_cache_flush(_sdc);
+}
+
+/**
+ * @brief Called by the SD driver when written data has been programmed by the card.
+ *
+ * Posts MSG_DSK_WRITE_DONE (to Core-0) with the status (0 or SD_BLOCK_DEVICE_ERROR_xxx),
+ * if a module has registered a handler for it (otherwise it would only fill the queue).
+ *
+ * @param sdc The SD card
+ * @param status The status of the write
+ */
+static void _sd_write_done(sd_card_t* sdc, int status) {
+    if (!cmt_msg_hdlr_exists(MSG_DSK_WRITE_DONE, 0)) {
+        return;
+    }
+    cmt_msg_t msg;
+    cmt_msg_init(&msg, MSG_DSK_WRITE_DONE);
+    msg.data.status = status;
+    post_to_core0_nowait(&msg);
+}
+
+/**
+ * @brief Called by the SD driver to have the asynchronous transfer advanced.
+ *
+ * A DMA completion (from the IRQ) is delivered as deferred work, so it is taken ahead
+ * of other messages. Polling the card is posted as a message, so the other messages
+ * are processed between the polls.
+ *
+ * @param sdc The SD card
+ * @param poll The driver is polling the card (rather than a DMA completion)
+ */
+static void _sd_async_kick(sd_card_t* sdc, bool poll) {
+    if (poll) {
+        cmt_msg_t msg;
+        cmt_exec_init(&msg, _handle_sd_async_step);
+        post_to_core0(&msg);
+    }
+    else {
+        cmt_dwork_post(&_sd_async_dma_slot, 0);
+    }
+}
+
+/**
+ * @brief Called by the SD driver when an asynchronous transfer finishes.
+ *
+ * Posts MSG_DSK_IO_DONE (to Core-0) with the status, to the requester's handler.
+ *
+ * @param sdc The SD card
+ * @param status The status of the transfer
+ * @param user_data The requester's handler (or NULL)
+ */
+static void _sd_async_done(sd_card_t* sdc, int status, void* user_data) {
+    msg_handler_fn hdlr = (msg_handler_fn)user_data;
+    cmt_msg_t msg;
+    cmt_msg_init_ctrl(&msg, MSG_DSK_IO_DONE, hdlr, (hdlr != NULL_MSG_HDLR));
+    msg.data.status = status;
+    post_to_core0(&msg);
+}
+
 
 // ====================================================================
 // Message Handler Methods
 // ====================================================================
 
 /**
- * @brief Handle Housekeeping tasks. This is triggered every ~16ms.
- *
- * For reference, 625 times is 10 seconds.
+ * @brief Advance the asynchronous SD transfer.
  *
  * @param msg Nothing important in the message.
  */
-static void _handle_housekeeping(cmt_msg_t* msg) {
-    static uint cnt = 0;
+static void _handle_sd_async_step(cmt_msg_t* msg) {
+    sd_async_step(_sdc);
+}
 
-    cnt++;
+/**
+ * @brief Report the end of a reset requested from Core-1 (run on Core-1).
+ *
+ * @param msg The FRESULT of the reset is in `data.fr`
+ */
+static void _handle_reset_c1_done(cmt_msg_t* msg) {
+    rpc_done_fn done_fn = _reset_c1_done_fn;
+    void* user_data = _reset_c1_user_data;
+    _reset_c1_active = false;
+    if (done_fn) {
+        done_fn(msg, RPC_DONE, user_data);
+    }
 }
 
 
@@ -88,6 +214,64 @@ static void _handle_housekeeping(cmt_msg_t* msg) {
 // Local/Private Methods
 // ====================================================================
 
+/**
+ * @brief Mount the file system of an initialized card.
+ *
+ * @return FRESULT FR_OK if mounted, FR_NOT_READY if there isn't a card, or the error
+ */
+static FRESULT _mount_fs() {
+    FRESULT res;
+    if (!sd_card_detect(_sdc)) {
+        res = FR_NOT_READY;
+    }
+    else if (_fs.fs_type == 0) {
+        res = f_mount(&_fs, _drive, 1);
+        if (FR_OK != res) {
+            error_printf(false, "Could not mount SD: (Error: %d)\n", res);
+        }
+    }
+    else {
+        _mounted = true;
+        res = FR_OK;
+    }
+    return (res);
+}
+
+/**
+ * @brief Task to mount the SD card, retrying the card initialization with a
+ * delay between attempts rather than blocking the core.
+ *
+ * Only the delays between the attempts (and between the initialization and the
+ * mount) let other messages run. An attempt at initializing the card (`sd_init`,
+ * which waits for the card to be ready) and the mount of the file system (which
+ * reads the boot sector and the FSINFO) each run to completion.
+ *
+ * The FRESULT is left in `task->result`.
+ */
+static cmt_pt_state_t _mount_task_fn(cmt_task_t* task) {
+    CMT_PT_BEGIN(task);
+    task->result = FR_OK;
+    if (_mounted) {
+        CMT_PT_EXIT(task);
+    }
+    _mount_tries = 0;
+    while (_mount_tries < DSK_MOUNT_INIT_TRIES) {
+        _mount_tries++;
+        if ((sd_init(_sdc) & (STA_NOINIT | STA_NODISK)) == 0) {
+            break;
+        }
+        CMT_PT_SLEEP_MS(task, DSK_MOUNT_INIT_RETRY_MS);
+    }
+    if (_sdc->m_Status & (STA_NOINIT | STA_NODISK)) {
+        task->result = FR_NOT_READY;
+        CMT_PT_EXIT(task);
+    }
+    // Let other messages be processed before reading the file system.
+    CMT_PT_YIELD(task);
+    task->result = (_mounted ? FR_OK : _mount_fs());
+    CMT_PT_END(task);
+}
+
 
 // ====================================================================
 // Public Methods
@@ -99,6 +283,50 @@ char* dsk_get_shared_path_buf() {
     return _filepath;
 }
 
+bool dsk_sd_clock_info(dsk_sd_clock_info_t* info) {
+    if (!_sdc || (_sdc->m_Status & STA_NOINIT)) {
+        return (false);
+    }
+    info->rate = _sdc->spi_rate;
+    info->rate_max = _sdc->spi_rate_max;
+    info->rate_cfg = _sdc->spi->baud_rate;
+    info->crc_errors = _sdc->crc_errors;
+    info->rate_drops = _sdc->rate_drops;
+    info->probe_fails = _sdc->probe_fails;
+    return (true);
+}
+
+int dsk_sd_read_async(uint8_t* buf, uint32_t sector, uint32_t count, msg_handler_fn done_hdlr) {
+    // The transfer goes around the sector cache, so write back what it holds.
+    int rc = sd_cache_flush(_sdc);
+    if (rc != SD_BLOCK_DEVICE_ERROR_NONE) {
+        return (rc);
+    }
+    return (sd_read_blocks_async(_sdc, buf, sector, count, _sd_async_done, (void*)done_hdlr));
+}
+
+int dsk_sd_write_async(const uint8_t* buf, uint32_t sector, uint32_t count, msg_handler_fn done_hdlr) {
+    // The transfer goes around the sector cache, so drop its copies of the sectors.
+    sd_cache_discard(_sdc, sector, count);
+    return (sd_write_blocks_async(_sdc, buf, sector, count, _sd_async_done, (void*)done_hdlr));
+}
+
+bool dsk_sd_stats(sd_stats_t* stats, bool reset) {
+    if (!_sdc) {
+        return (false);
+    }
+    sd_stats_get(_sdc, stats, reset);
+    return (true);
+}
+
+bool dsk_sd_cache_stats(sd_cache_stats_t* stats, bool reset) {
+    if (!_modinit_called) {
+        return (false);
+    }
+    sd_cache_stats_get(stats, reset);
+    return (true);
+}
+
 FRESULT dsk_mount_sd() {
     FRESULT res = FR_NOT_ENABLED;
     if (_mounted) {
@@ -106,23 +334,19 @@ FRESULT dsk_mount_sd() {
     }
     else {
         sd_init(_sdc);
-        if (!sd_card_detect(_sdc)) {
-            res = FR_NOT_READY;
-        }
-        else if (_fs.fs_type == 0) {
-            res = f_mount(&_fs, _drive, 1);
-            if (FR_OK != res) {
-                error_printf(false, "Could not mount SD: (Error: %d)\n", res);
-            }
-        }
-        else {
-            _mounted = true;
-            res = FR_OK;
-        }
+        res = _mount_fs();
     }
     return (res);
 }
 
+bool dsk_mount_sd_start(cmt_task_done_fn done_fn) {
+    if (_mount_task.running) {
+        return (false);
+    }
+    cmt_task_start(&_mount_task, _mount_task_fn, done_fn, NULL);
+    return (true);
+}
+
 FRESULT dsk_reset_sd() {
     FRESULT fr = dsk_unmount_sd();
     if (fr == FR_OK) {
@@ -131,18 +355,48 @@ FRESULT dsk_reset_sd() {
     return (fr);
 }
 
+static void _boot_mount_done(cmt_task_t* task) {
+    FRESULT fr = (FRESULT)task->result;
+    if (fr != FR_OK) {
+        const char* rerr = FRESULT_str(fr);
+        debug_tprintf("Cannot mount SD  FR: %u - %s\n", (uint32_t)fr, rerr);
+    }
+}
+
+static void _reset_c1_report(FRESULT fr) {
+    cmt_msg_t msg;
+    cmt_exec_init(&msg, _handle_reset_c1_done);
+    msg.data.fr = fr;
+    post_to_core1(&msg);
+}
+
+static void _reset_c1_mount_done(cmt_task_t* task) {
+    _reset_c1_report((FRESULT)task->result);
+}
+
 static void _handle_reset_sd(cmt_msg_t* msg) {
-    FRESULT fr = dsk_reset_sd();
-    msg->data.fr = fr;
-    return;
+    FRESULT fr = dsk_unmount_sd();
+    if (fr != FR_OK) {
+        _reset_c1_report(fr);
+    }
+    else if (!dsk_mount_sd_start(_reset_c1_mount_done)) {
+        _reset_c1_report(FR_LOCKED);    // A mount is already in progress
+    }
 }
 
-FRESULT dsk_reset_sd_c1() {
-    // Reset the SD - called from Core-1
+int32_t dsk_reset_sd_c1(rpc_done_fn done_fn, void* user_data) {
+    // Reset the SD - called from Core-1. The SD is run from Core-0, and the card
+    // initialization is retried by the mount task, so Core-0 isn't held up.
+    if (_reset_c1_active) {
+        return (-1);
+    }
+    _reset_c1_active = true;
+    _reset_c1_done_fn = done_fn;
+    _reset_c1_user_data = user_data;
     cmt_msg_t msg;
     cmt_exec_init(&msg, _handle_reset_sd);
-    runon_core0(&msg);
-    return (msg.data.fr);
+    post_to_core0(&msg);
+    return (0);
 }
 
 FRESULT dsk_unmount_sd() {
@@ -150,6 +404,18 @@ FRESULT dsk_unmount_sd() {
 
     if (_fs.fs_type != 0) {
         res = f_unmount(_drive);
+        int rc = sd_cache_flush(_sdc);
+        sd_sync(_sdc);  // Stop a streamed transfer
+        if (rc == SD_BLOCK_DEVICE_ERROR_NONE || !sd_card_detect(_sdc)) {
+            sd_cache_invalidate(_sdc);  // The card might be changed
+        }
+        else {
+            // Keep the dirty sectors, so the data isn't lost (the next flush retries them)
+            error_printf(false, "Could not write back the SD cache: (Error: %d)\n", rc);
+            if (res == FR_OK) {
+                res = FR_DISK_ERR;
+            }
+        }
         _fs.fs_type = 0;
         _sdc->m_Status |= STA_NOINIT | STA_NODISK;
         _sdc->card_type = SDCARD_NONE;
@@ -169,15 +435,18 @@ void dskops_modinit() {
     }
     sd_init_driver();
     _sdc = sd_get_by_num(0);
+    _sdc->write_done = _sd_write_done;
+    _sdc->async_kick = _sd_async_kick;
+    cmt_dwork_slot_init(&_sd_async_dma_slot, "sd_dma", MSG_EXEC, _handle_sd_async_step, 0);
     _drive = "0:";
     _fs.fs_type = 0;
+    cmt_periodic_init(&_sd_service_pt, "dsk", DSK_SD_SERVICE_MS, 0, CMT_PERIODIC_SKIP, _sd_service, NULL, 0);
+    cmt_periodic_start(&_sd_service_pt);
+    cmt_periodic_init(&_sd_cache_flush_pt, "dskc", DSK_SD_CACHE_FLUSH_MS, 0, CMT_PERIODIC_SKIP, _sd_cache_flush, NULL, 0);
+    cmt_periodic_start(&_sd_cache_flush_pt);
 
-    // Mount the disk
-    FRESULT fr = dsk_mount_sd();
-    if (fr != FR_OK) {
-        const char* rerr = FRESULT_str(fr);
-        debug_tprintf("Cannot mount SD  FR: %u - %s\n", (uint32_t)fr, rerr);
-    }
+    // Mount the disk (from the mount task, so the card initialization retries don't block)
+    dsk_mount_sd_start(_boot_mount_done);
 
     _modinit_called = true;
 }
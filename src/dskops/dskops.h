@@ -14,6 +14,18 @@
  * is performed. If the caller intends to keep the result for an extended period (possibly
  * across disk/file method calls) a different buffer should be used.
  *
+ * SD writes return when the card has accepted the data. When the card has finished
+ * programming it, MSG_DSK_WRITE_DONE is posted to Core-0 with the status (`data.status`)
+ * if a module has registered a (Core-0) handler for it. A sync (f_sync/f_close) waits for it.
+ *
+ * Sectors can also be read/written asynchronously (`dsk_sd_read_async`/`dsk_sd_write_async`).
+ * The transfer is run by messages on Core-0 as the card and the DMA become ready, so the
+ * message loop keeps running, and MSG_DSK_IO_DONE is posted when it finishes.
+ *
+ * FATFS reads/writes of a few sectors (FAT, directory, partial file sectors) go through a
+ * write-back sector cache. The dirty sectors are written to the card on a sync (f_sync/f_close),
+ * every second, and when the card is unmounted.
+ *
  * Copyright 2023-26 AESilky
  * SPDX-License-Identifier: MIT License
  *
@@ -27,10 +39,29 @@ extern "C" {
 #include "ff.h"
 #include "f_util.h"
 #include "ff_stdio.h"
+#include "sd_cache.h"
+#include "sd_card.h"
+
+#include "cmt_task.h"
+#include "multicore.h"
+
+#include <stdbool.h>
 
 /** @brief As on 'classic' DOS = 260 */
 #define MAX_PATH 260
 
+/**
+ * @brief SD Card SPI clock rate and CRC error information.
+ */
+typedef struct dsk_sd_clock_info_ {
+    uint32_t rate;          // Data transfer rate (Hz)
+    uint32_t rate_max;      // Highest rate that passed the probe at initialization (Hz)
+    uint32_t rate_cfg;      // Configured (maximum) rate (Hz)
+    uint32_t crc_errors;    // Reads/writes that failed with a CRC error
+    uint32_t rate_drops;    // Times the rate was lowered because of CRC errors
+    uint32_t probe_fails;   // Times the rate probe couldn't be run (the rate was left low)
+} dsk_sd_clock_info_t;
+
 /**
  * @brief Get the module supplied File Name/Path buffer.
  *
@@ -41,12 +72,123 @@ extern "C" {
  */
 extern char* dsk_get_shared_path_buf();
 
+/**
+ * @brief Get the SD Card SPI clock rate and CRC error information.
+ *
+ * The rate is negotiated when the card is initialized, and lowered if CRC errors occur.
+ * If the probe's reference read fails, the lowest rate is used and the probe is retried
+ * on the next mount.
+ *
+ * @param info Structure to fill in
+ * @return true The card is initialized (the information is valid)
+ * @return false The card isn't initialized
+ */
+extern bool dsk_sd_clock_info(dsk_sd_clock_info_t* info);
+
+/**
+ * @brief Get the SD Card performance telemetry.
+ *
+ * Per command class (CMD17/18/24/25/13/12) and for block reads/writes: counts, errors,
+ * and latency (total, maximum and a log2 histogram). Also the time spent waiting for the
+ * card (busy and read data tokens), timeouts, command retries, and CRC errors/retries.
+ * This tells a slow card (busy/token time) from a slow driver (the rest of the latency).
+ *
+ * @param stats Structure to fill in
+ * @param reset Reset the telemetry after getting it
+ * @return true The telemetry is available
+ * @return false The module isn't initialized
+ */
+extern bool dsk_sd_stats(sd_stats_t* stats, bool reset);
+
+/**
+ * @brief Get the SD sector cache statistics.
+ *
+ * Hits, misses, evictions and write-backs of the cache that FATFS reads/writes go
+ * through, and the number of sectors cached and dirty now.
+ *
+ * @param stats Structure to fill in
+ * @param reset Reset the counts after getting them
+ * @return true The statistics are available
+ * @return false The module isn't initialized
+ */
+extern bool dsk_sd_cache_stats(sd_cache_stats_t* stats, bool reset);
+
 extern FRESULT dsk_mount_sd();
 
+/**
+ * @brief Start reading SD card sectors without waiting for the card.
+ *
+ * When the read finishes MSG_DSK_IO_DONE is posted to Core-0 with the status
+ * (0 or SD_BLOCK_DEVICE_ERROR_xxx) in `data.status`. A CRC error isn't retried (the
+ * SPI rate has been lowered, so the read can be retried).
+ *
+ * Only one transfer can be in progress. Until it finishes other SD card driver calls
+ * fail with SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK, and a FATFS file operation finishes it
+ * first (waiting for the card). A DMA that doesn't complete times out (NO_RESPONSE).
+ * The dirty sectors of the sector cache are written back (waiting for the card) first.
+ * Must be called from Core-0. The `sdrd` shell command uses it.
+ *
+ * @param buf Buffer for the data (count * 512 bytes, must stay valid until done)
+ * @param sector First sector
+ * @param count Number of sectors
+ * @param done_hdlr Handler for the MSG_DSK_IO_DONE (or NULL to use the registered handlers)
+ * @return int 0 if started, otherwise SD_BLOCK_DEVICE_ERROR_xxx
+ */
+extern int dsk_sd_read_async(uint8_t* buf, uint32_t sector, uint32_t count, msg_handler_fn done_hdlr);
+
+/**
+ * @brief Start writing SD card sectors without waiting for the card.
+ *
+ * As `dsk_sd_read_async`. The status includes an error completing an earlier write.
+ * The sector cache's copies of the sectors are dropped.
+ *
+ * @param buf The data (count * 512 bytes, must stay valid until done)
+ * @param sector First sector
+ * @param count Number of sectors
+ * @param done_hdlr Handler for the MSG_DSK_IO_DONE (or NULL to use the registered handlers)
+ * @return int 0 if started, otherwise SD_BLOCK_DEVICE_ERROR_xxx
+ */
+extern int dsk_sd_write_async(const uint8_t* buf, uint32_t sector, uint32_t count, msg_handler_fn done_hdlr);
+
+/**
+ * @brief Start mounting the SD card from a CMT Task.
+ *
+ * Unlike `dsk_mount_sd`, the card initialization is retried with a delay between the
+ * attempts, and the core's message loop continues to run while waiting between them.
+ * Each attempt, and the mount of the file system, still runs to completion. When the
+ * mount finishes the `done_fn` is called (on the calling core) with the FRESULT
+ * in `task->result`.
+ *
+ * @param done_fn Function to call when the mount finishes (or NULL)
+ * @return true The mount was started
+ * @return false A mount is already in progress
+ */
+extern bool dsk_mount_sd_start(cmt_task_done_fn done_fn);
+
 extern FRESULT dsk_reset_sd();
 
-extern FRESULT dsk_reset_sd_c1();
+/**
+ * @brief Reset (unmount and mount) the SD card from Core-1.
+ *
+ * The card is unmounted on Core-0 and mounted by the mount task (`dsk_mount_sd_start`),
+ * so the card initialization is retried without holding up Core-0. The `done_fn` is
+ * called on Core-1 (with RPC_DONE) when it completes. The FRESULT is in `msg->data.fr`.
+ *
+ * @param done_fn Function to call on completion (or NULL)
+ * @param user_data Data passed to the `done_fn`
+ * @return int32_t 0 if the reset was started, or -1 if one is already in progress
+ */
+extern int32_t dsk_reset_sd_c1(rpc_done_fn done_fn, void* user_data);
 
+/**
+ * @brief Unmount the SD card.
+ *
+ * The SD sector cache is written back and then emptied (the card might be changed). If
+ * the write-back fails while the card is still present, the cache is kept (so the data
+ * isn't lost) and FR_DISK_ERR is returned.
+ *
+ * @return FRESULT FR_OK if the card was unmounted (or wasn't mounted), or the error
+ */
 extern FRESULT dsk_unmount_sd();
 
 
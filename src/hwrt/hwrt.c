@@ -39,7 +39,6 @@ static volatile bool _attn_flag;
 static void _gpio_irq_handler(uint gpio, uint32_t events);
 
 // Message handler methods...
-static void _handle_housekeeping(cmt_msg_t* msg);
 static void _handle_hwrt_test(cmt_msg_t* msg);
 static void _handle_apps_started(cmt_msg_t* msg);
 
@@ -74,19 +73,6 @@ static void _handle_apps_started(cmt_msg_t* msg) {
 
 }
 
-/**
- * @brief Handle HW Runtime Housekeeping tasks. This is triggered every ~16ms.
- *
- * For reference, 625 times is 10 seconds.
- *
- * @param msg Nothing important in the message.
- */
-static void _handle_housekeeping(cmt_msg_t* msg) {
-    static uint cnt = 0;
-
-    cnt++;
-}
-
 static void _handle_hwrt_test(cmt_msg_t* msg) {
     // Test `scheduled_msg_ms` error
     static int times = 1;
@@ -185,7 +171,6 @@ static void _hwrt_started(cmt_msg_t* msg) {
 //    dskops_modinit();
 
     cmt_msg_hdlr_add(MSG_APPS_STARTED, _handle_apps_started);
-    cmt_msg_hdlr_add(MSG_PERIODIC_RT, _handle_housekeeping);
     cmt_msg_hdlr_add(MSG_HWRT_TEST, _handle_hwrt_test);
 
     // Starting Core-1 will run the `core1_main`.
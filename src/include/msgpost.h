@@ -16,11 +16,16 @@ extern "C" {
 
 #include "cmt_t.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 // Define functional names for the 'Core' message queue functions (Camel-case to help flag as macros).
 #define postHWRTMsg( pmsg )                     post_to_core0( pmsg )
 #define postHWRTMsgDiscardable( pmsg )          post_to_core0_nowait( pmsg )
 #define postAPPMsg( pmsg )                      post_to_core1( pmsg )
 #define postAPPMsgDiscardable( pmsg )           post_to_core1_nowait( pmsg )
+#define postANYMsg( pmsg )                      post_to_coreany( pmsg )
+#define postANYMsgDiscardable( pmsg )           post_to_coreany_nowait( pmsg )
 
 /**
  * @brief Post a message to Core 0 (using the Core 0 queues).
@@ -55,6 +60,20 @@ extern bool post_to_core0_nowait(const cmt_msg_t* msg);
  */
 extern void post_to_core1(const cmt_msg_t* msg);
 
+/**
+ * @brief Post a message to Core 0, waiting up to a time limit for room in the queue.
+ * @ingroup multicore
+ *
+ * For producers that can tolerate a short delay rather than losing a message. Waiting is
+ * only done when called from Core 1 (Core 0's queue can only be emptied by Core 0), and
+ * must not be done from an interrupt handler.
+ *
+ * @param msg The message to post.
+ * @param timeout_us Maximum time (µs) to wait for room
+ * @returns true if message was posted.
+ */
+extern bool post_to_core0_wait(const cmt_msg_t* msg, uint32_t timeout_us);
+
 /**
  * @brief Post a message to Core 1 (using the Core 1 queue). Do not wait if it can't be posted.
  * @ingroup multicore
@@ -68,6 +87,44 @@ extern void post_to_core1(const cmt_msg_t* msg);
  */
 extern bool post_to_core1_nowait(const cmt_msg_t* msg);
 
+/**
+ * @brief Post a message to Core 1, waiting up to a time limit for room in the queue.
+ * @ingroup multicore
+ *
+ * For producers that can tolerate a short delay rather than losing a message. Waiting is
+ * only done when called from Core 0 (Core 1's queue can only be emptied by Core 1), and
+ * must not be done from an interrupt handler.
+ *
+ * @param msg The message to post.
+ * @param timeout_us Maximum time (µs) to wait for room
+ * @returns true if message was posted.
+ */
+extern bool post_to_core1_wait(const cmt_msg_t* msg, uint32_t timeout_us);
+
+/**
+ * @brief Post a message to the shared (either core) queue.
+ * @ingroup multicore
+ *
+ * The message is handled by whichever core takes it first. The message loops take from
+ * the shared queue when their own queue is empty, so the work goes to a core that has
+ * time for it. Use this for work that doesn't depend on the core it runs on. The message
+ * should have a handler set, or the registered handlers should be registered for
+ * both cores (`MSG_HDLR_CORE_BOTH`), as handlers registered for a single core are only
+ * run when that core takes the message.
+ *
+ * @param msg The message to post.
+ */
+extern void post_to_coreany(const cmt_msg_t* msg);
+
+/**
+ * @brief Post a message to the shared (either core) queue. Do not wait if it can't be posted.
+ * @ingroup multicore
+ *
+ * @param msg The message to post.
+ * @returns true if message was posted.
+ */
+extern bool post_to_coreany_nowait(const cmt_msg_t* msg);
+
 
 
 #ifdef __cplusplus
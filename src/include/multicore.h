@@ -15,6 +15,10 @@ extern "C" {
 
 #include "msgpost.h"
 
+#include "pico/types.h" // 'uint' and other standard types
+
+#include <stdint.h>
+
 /**
  * @file multicore.h
  * @defgroup multicore multicore
@@ -37,6 +41,137 @@ extern "C" {
  *
 */
 
+/**
+ * @brief Message queue sizes (entries).
+ *
+ * These can be set for a build. Use the queue high-water marks (`multicore_queue_stats`,
+ * `.queues` command) measured under load to size them.
+ */
+#ifndef CORE0_QUEUE_ENTRIES
+#define CORE0_QUEUE_ENTRIES 64
+#endif
+#ifndef CORE1_QUEUE_ENTRIES
+#define CORE1_QUEUE_ENTRIES 64
+#endif
+#ifndef COREANY_QUEUE_ENTRIES
+#define COREANY_QUEUE_ENTRIES 32
+#endif
+
+/**
+ * @brief Deadline queue size (entries) for each core.
+ *
+ * Messages posted to a core with a deadline are kept in deadline order in the core's
+ * deadline queue and are taken ahead of its (FIFO) queue, earliest deadline first.
+ * If the deadline queue is full, the message is posted to the core's FIFO queue.
+ */
+#ifndef MC_DEADLINE_QUEUE_ENTRIES
+#define MC_DEADLINE_QUEUE_ENTRIES 16
+#endif
+
+/** @brief Queue level (percent of size) at which backpressure is asserted */
+#ifndef MC_QUEUE_BP_HIGH_PCT
+#define MC_QUEUE_BP_HIGH_PCT 75
+#endif
+/** @brief Queue level (percent of size) at which backpressure is released */
+#ifndef MC_QUEUE_BP_LOW_PCT
+#define MC_QUEUE_BP_LOW_PCT 25
+#endif
+
+/**
+ * @brief Panic if a message can't be posted (queue full) with `post_to_coreN`.
+ *
+ * Only done for debug builds (and can be turned off at run time with `no_qadd_panic`).
+ * Otherwise the message is discarded and counted in the queue's `full` count.
+ */
+#ifndef MC_QUEUE_FULL_PANIC
+    #if defined(DEBUG_MODE) && (DEBUG_MODE != 0)
+        #define MC_QUEUE_FULL_PANIC 1
+    #else
+        #define MC_QUEUE_FULL_PANIC 0
+    #endif
+#endif
+
+/**
+ * @brief Identifies a message queue.
+ * @ingroup multicore
+ */
+typedef enum MC_QUEUE_ID_ {
+    MCQ_CORE0 = 0,
+    MCQ_CORE1,
+    MCQ_ANY,
+    MCQ_CORE0_DL,           // Core 0 deadline queue
+    MCQ_CORE1_DL,           // Core 1 deadline queue
+    MCQ_CNT,
+} mc_queue_id_t;
+
+/**
+ * @brief Message queue statistics.
+ * @ingroup multicore
+ *
+ * The counts are kept under the queue's lock, so they are consistent with the queue.
+ *
+ * @param size The number of entries
+ * @param level The number of messages currently in the queue
+ * @param hwm The high-water mark (most messages that have been in the queue)
+ * @param posted Number of messages posted
+ * @param full Number of posts that found the queue full
+ * @param dropped Number of messages that couldn't be posted (lost, or the caller was told)
+ * @param waited Number of posts that had to wait (`post_to_coreN_wait`)
+ * @param bp_events Number of times backpressure was asserted
+ * @param bp_asserted Backpressure is currently asserted
+ */
+typedef struct mc_queue_stats_ {
+    uint16_t size;
+    uint16_t level;
+    uint16_t hwm;
+    uint32_t posted;
+    uint32_t full;
+    uint32_t dropped;
+    uint32_t waited;
+    uint32_t bp_events;
+    bool bp_asserted;
+} mc_queue_stats_t;
+
+/**
+ * @brief Function prototype for a backpressure notification.
+ * @ingroup multicore
+ *
+ * Called when a queue reaches MC_QUEUE_BP_HIGH_PCT full (asserted) and when it drains to
+ * MC_QUEUE_BP_LOW_PCT (released). This is called from the context that posted or took the
+ * message, which can be an interrupt handler or either core, so it must be short
+ * (set a flag, pause a source).
+ *
+ * @param qid The queue
+ * @param asserted True when the producers should slow down, false when they can resume
+ */
+typedef void (*mc_backpressure_fn)(mc_queue_id_t qid, bool asserted);
+
+/** @brief Maximum number of cross-core RPC requests that can be in-flight at one time. */
+#ifndef RPC_INFLIGHT_MAX
+#define RPC_INFLIGHT_MAX 8
+#endif
+
+/**
+ * @brief Completion status of a cross-core RPC request.
+ * @ingroup multicore
+ */
+typedef enum RPC_STATUS_ {
+    RPC_DONE = 0,       // The handler ran. Results are in the message.
+    RPC_TIMEOUT,        // The handler didn't complete in time. The message contents are not valid.
+} rpc_status_t;
+
+/**
+ * @brief Function prototype for a cross-core RPC completion function.
+ * @ingroup multicore
+ *
+ * This is called on the core that made the request.
+ *
+ * @param msg The request message, as updated by the handler (valid during the call only)
+ * @param status The completion status
+ * @param user_data The `user_data` value given with the request
+ */
+typedef void (*rpc_done_fn)(cmt_msg_t* msg, rpc_status_t status, void* user_data);
+
 /**
  * @brief Get a message for Core 0 (from the Core 0 queue). Block until a message can be read.
  *
@@ -69,6 +204,31 @@ extern void get_core1_msg_blocking(cmt_msg_t* msg);
  */
 extern bool get_core1_msg_nowait(cmt_msg_t* msg);
 
+/**
+ * @brief Get a message from the shared (either core) queue. Do not block if there aren't any.
+ *
+ * @param msg Pointer to a buffer for the message.
+ * @return true If a message was retrieved.
+ */
+extern bool get_coreany_msg_nowait(cmt_msg_t* msg);
+
+/**
+ * @brief Get the earliest deadline message from a core's deadline queue. Do not block if there aren't any.
+ *
+ * @param corenum The core number (0|1)
+ * @param msg Pointer to a buffer for the message.
+ * @return true If a message was retrieved.
+ */
+extern bool get_core_deadline_msg_nowait(uint8_t corenum, cmt_msg_t* msg);
+
+/**
+ * @brief Get the number of messages waiting in a core's queue.
+ *
+ * @param corenum The core number (0|1)
+ * @return uint The number of messages in the queue
+ */
+extern uint get_core_msg_queue_level(uint8_t corenum);
+
 /**
  * @brief Run a message handler w/msg on Core-0 from Core-1, waiting for completion.
  * @ingroup multi-core
@@ -82,6 +242,64 @@ extern bool get_core1_msg_nowait(cmt_msg_t* msg);
  */
 extern void runon_core0(const cmt_msg_t* msg);
 
+/**
+ * @brief Get the statistics for a message queue.
+ * @ingroup multicore
+ *
+ * @param qid The queue
+ * @param stats Pointer to the stats structure to fill in
+ * @return true If the queue ID is valid
+ */
+extern bool multicore_queue_stats(mc_queue_id_t qid, mc_queue_stats_t* stats);
+
+/**
+ * @brief Reset the message queue high-water marks and counts.
+ * @ingroup multicore
+ */
+extern void multicore_queue_stats_reset();
+
+/**
+ * @brief Set the backpressure notification function for a message queue.
+ * @ingroup multicore
+ *
+ * The deadline queues don't assert backpressure (they overflow into the FIFO queue).
+ *
+ * @param qid The queue
+ * @param fn The function to call (NULL to remove)
+ */
+extern void multicore_set_backpressure_fn(mc_queue_id_t qid, mc_backpressure_fn fn);
+
+/**
+ * @brief Run a message handler w/msg on a core, with completion reported back to the calling core.
+ * @ingroup multicore
+ *
+ * This is the non-blocking replacement for `runon_core0`. The message is copied and the copy
+ * is passed to its handler on the target core (through the core's message queue). When the
+ * handler returns, the `done_fn` is called on the calling core with the updated message (so the
+ * handler can return values in the message data). Multiple requests can be in-flight.
+ *
+ * If a timeout is given and the handler hasn't completed within that time, the `done_fn` is called
+ * with RPC_TIMEOUT, and the later completion (if any) is discarded. Note that an RPC that times
+ * out might still run, so the handler must not use data owned by the caller (other than the message).
+ *
+ * @param corenum The core to run the handler on (0|1)
+ * @param msg Pointer to a message that has been initialized with a handler function to use.
+ * @param done_fn Function to call on completion (or NULL)
+ * @param user_data Data to pass to the `done_fn`
+ * @param timeout_ms Time (ms) to wait for completion, or 0 for no timeout (uses a µs timer until completion)
+ * @return int32_t The RPC ID (>0), or -1 if the maximum number of requests are in-flight (or no
+ * timer is available for the timeout)
+ */
+extern int32_t rpc_on_core(uint8_t corenum, const cmt_msg_t* msg, rpc_done_fn done_fn, void* user_data, int32_t timeout_ms);
+
+/**
+ * @brief Get the number of cross-core RPC requests in-flight.
+ * @ingroup multicore
+ *
+ * @return int The number of requests that haven't completed (or timed out)
+ */
+extern int rpc_inflight();
+
 /**
  * @brief Start the Core 1 functionality.
  * @ingroup multi_core
@@ -32,11 +32,31 @@ specific language governing permissions and limitations under the License.
 #define SD_CRC_H
 
 #include <stddef.h>
-    
+#include <stdint.h>
+
+// CRC7 byte (CRC7 << 1 | end bit) of the fixed command packets (with the
+// argument the driver uses), so it isn't computed for each command.
+#define CRC7_CMD0_ARG0      0x95
+#define CRC7_CMD8_ARG1AA    0x87
+#define CRC7_CMD13_ARG0     0x0D
+#define CRC7_CMD55_ARG0     0x65
+
+// The CRC16 kernel used by crc16/update_crc16: crc16_slice8 (fastest, 4KB of
+// tables), crc16_slice4 or crc16_bytewise (smallest).
+#ifndef CRC16_KERNEL
+#define CRC16_KERNEL crc16_slice8
+#endif
+
 char crc7(const char* data, int length);
 unsigned short crc16(const char* data, int length);
 void update_crc16(unsigned short *pCrc16, const char data[], size_t length);
 
+// CRC16 kernels: continue the CRC (0 to start) over the data.
+// All of them give the same result; they differ in speed and table size.
+uint16_t crc16_bytewise(uint16_t crc, const uint8_t *data, size_t length);
+uint16_t crc16_slice4(uint16_t crc, const uint8_t *data, size_t length);
+uint16_t crc16_slice8(uint16_t crc, const uint8_t *data, size_t length);
+
 #endif
 
 /* [] END OF FILE */
@@ -0,0 +1,362 @@
+/**
+ * SD Card Sector Cache.
+ *
+ * Write-back sector cache (see sd_cache.h).
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+//
+#include "pico/mutex.h"
+//
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "sd_cache.h"
+
+//#define TRACE_PRINTF(fmt, args...)
+#define TRACE_PRINTF DBG_PRINTF
+
+#if SD_CACHE_SECTORS
+
+#define SD_CACHE_SECTOR_SIZE 512
+
+// Hash buckets (a power of 2). Twice the sectors keeps the chains short.
+#ifndef SD_CACHE_BUCKETS
+#define SD_CACHE_BUCKETS 64
+#endif
+_Static_assert((SD_CACHE_BUCKETS & (SD_CACHE_BUCKETS - 1)) == 0,
+               "SD_CACHE_BUCKETS must be a power of 2");
+_Static_assert(SD_CACHE_SECTORS < INT16_MAX, "SD_CACHE_SECTORS is too large");
+
+#define SD_CACHE_NONE (-1)
+
+// A cached sector. Every entry is on the LRU list (free ones at the tail), and
+// the used ones are also on the hash chain of their sector.
+typedef struct {
+    sd_card_t *pSD;     // NULL when the entry is free
+    uint64_t sector;
+    int16_t hash_next;  // Next entry on the hash chain
+    int16_t lru_prev;   // Toward the most recently used
+    int16_t lru_next;   // Toward the least recently used
+    bool dirty;
+} sd_cache_entry_t;
+
+static sd_cache_entry_t entries[SD_CACHE_SECTORS];
+static uint8_t sectors[SD_CACHE_SECTORS][SD_CACHE_SECTOR_SIZE] __attribute__((aligned(4)));
+static int16_t buckets[SD_CACHE_BUCKETS];
+static int16_t lru_head;  // Most recently used
+static int16_t lru_tail;  // Least recently used (or free)
+static uint32_t used;
+static uint32_t dirty;
+static bool initialized;
+static sd_cache_stats_t stats;
+
+auto_init_mutex(sd_cache_mutex);
+
+static void lru_unlink(int16_t i) {
+    sd_cache_entry_t *e = &entries[i];
+    if (e->lru_prev != SD_CACHE_NONE)
+        entries[e->lru_prev].lru_next = e->lru_next;
+    else
+        lru_head = e->lru_next;
+    if (e->lru_next != SD_CACHE_NONE)
+        entries[e->lru_next].lru_prev = e->lru_prev;
+    else
+        lru_tail = e->lru_prev;
+}
+static void lru_push_head(int16_t i) {
+    sd_cache_entry_t *e = &entries[i];
+    e->lru_prev = SD_CACHE_NONE;
+    e->lru_next = lru_head;
+    if (lru_head != SD_CACHE_NONE)
+        entries[lru_head].lru_prev = i;
+    else
+        lru_tail = i;
+    lru_head = i;
+}
+static void lru_push_tail(int16_t i) {
+    sd_cache_entry_t *e = &entries[i];
+    e->lru_next = SD_CACHE_NONE;
+    e->lru_prev = lru_tail;
+    if (lru_tail != SD_CACHE_NONE)
+        entries[lru_tail].lru_next = i;
+    else
+        lru_head = i;
+    lru_tail = i;
+}
+static void touch(int16_t i) {
+    if (lru_head != i) {
+        lru_unlink(i);
+        lru_push_head(i);
+    }
+}
+
+static void init_nolock() {
+    if (initialized) return;
+    for (int i = 0; i < SD_CACHE_BUCKETS; ++i) buckets[i] = SD_CACHE_NONE;
+    lru_head = lru_tail = SD_CACHE_NONE;
+    for (int16_t i = 0; i < SD_CACHE_SECTORS; ++i) {
+        entries[i].pSD = NULL;
+        entries[i].hash_next = SD_CACHE_NONE;
+        entries[i].dirty = false;
+        lru_push_tail(i);
+    }
+    initialized = true;
+}
+static void lock() {
+    mutex_enter_blocking(&sd_cache_mutex);
+    init_nolock();
+}
+static void unlock() { mutex_exit(&sd_cache_mutex); }
+
+// Sequential sectors fall in sequential buckets
+static uint32_t hash(sd_card_t *pSD, uint64_t sector) {
+    return ((uint32_t)sector ^ (uint32_t)(sector >> 32) ^
+            (uint32_t)((uintptr_t)pSD >> 4)) &
+           (SD_CACHE_BUCKETS - 1);
+}
+static int16_t find(sd_card_t *pSD, uint64_t sector) {
+    int16_t i = buckets[hash(pSD, sector)];
+    while (i != SD_CACHE_NONE &&
+           (entries[i].pSD != pSD || entries[i].sector != sector))
+        i = entries[i].hash_next;
+    return i;
+}
+static void unhash(int16_t i) {
+    sd_cache_entry_t *e = &entries[i];
+    int16_t *link = &buckets[hash(e->pSD, e->sector)];
+    while (*link != i) link = &entries[*link].hash_next;
+    *link = e->hash_next;
+    e->hash_next = SD_CACHE_NONE;
+}
+
+// Free an entry (without writing it back)
+static void drop(int16_t i) {
+    sd_cache_entry_t *e = &entries[i];
+    if (e->dirty) --dirty;
+    unhash(i);
+    e->pSD = NULL;
+    e->dirty = false;
+    --used;
+    lru_unlink(i);
+    lru_push_tail(i);
+}
+
+static bool in_range(uint64_t sector, uint64_t start, uint64_t count) {
+    return sector - start < count;  // (wraps when below the start)
+}
+
+// Write back the card's dirty sectors, in ascending order so that the SD
+// driver can stream them (CMD25) when they are consecutive.
+static int flush_nolock(sd_card_t *pSD) {
+    int16_t order[SD_CACHE_SECTORS];
+    size_t n = 0;
+    for (int16_t i = 0; i < SD_CACHE_SECTORS; ++i) {
+        if (entries[i].pSD != pSD || !entries[i].dirty) continue;
+        // Insertion sort by sector
+        size_t j = n++;
+        while (j > 0 && entries[order[j - 1]].sector > entries[i].sector) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+    if (!n) return SD_BLOCK_DEVICE_ERROR_NONE;
+    TRACE_PRINTF("%s: %zu sectors\r\n", __FUNCTION__, n);
+    ++stats.flushes;
+    for (size_t k = 0; k < n; ++k) {
+        sd_cache_entry_t *e = &entries[order[k]];
+        int status = sd_write_blocks(pSD, sectors[order[k]], e->sector, 1);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            ++stats.write_errors;
+            return status;
+        }
+        e->dirty = false;
+        --dirty;
+        ++stats.writebacks;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Get an entry for the sector, replacing the least recently used clean (or free)
+// one. Only when every entry is dirty is the least recently used one's card
+// written back first, which can fail.
+static int alloc(sd_card_t *pSD, uint64_t sector, int16_t *pi) {
+    int16_t i = lru_tail;
+    while (i != SD_CACHE_NONE && entries[i].dirty) i = entries[i].lru_prev;
+    if (i == SD_CACHE_NONE) {
+        i = lru_tail;
+        int status = flush_nolock(entries[i].pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    }
+    sd_cache_entry_t *e = &entries[i];
+    if (e->pSD) {
+        unhash(i);
+        --used;
+        ++stats.evictions;
+    }
+    e->pSD = pSD;
+    e->sector = sector;
+    e->dirty = false;
+    uint32_t h = hash(pSD, sector);
+    e->hash_next = buckets[h];
+    buckets[h] = i;
+    ++used;
+    touch(i);
+    *pi = i;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+int sd_cache_read(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                  uint32_t ulSectorCount) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    lock();
+    if (ulSectorCount >= SD_CACHE_BYPASS) {
+        // Straight from the card, with the (newer) dirty sectors laid over it
+        status = sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+        stats.bypassed += ulSectorCount;
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status && dirty) {
+            for (int16_t i = 0; i < SD_CACHE_SECTORS; ++i) {
+                sd_cache_entry_t *e = &entries[i];
+                if (e->pSD == pSD && e->dirty &&
+                    in_range(e->sector, ulSectorNumber, ulSectorCount))
+                    memcpy(buffer + (e->sector - ulSectorNumber) * SD_CACHE_SECTOR_SIZE,
+                           sectors[i], SD_CACHE_SECTOR_SIZE);
+            }
+        }
+        unlock();
+        return status;
+    }
+    for (uint32_t n = 0; n < ulSectorCount; ++n) {
+        uint64_t sector = ulSectorNumber + n;
+        int16_t i = find(pSD, sector);
+        if (i != SD_CACHE_NONE) {
+            touch(i);
+            ++stats.hits;
+        } else {
+            if (SD_BLOCK_DEVICE_ERROR_NONE != alloc(pSD, sector, &i)) {
+                // Every entry is dirty and can't be written back (they are
+                // kept, for a sync to retry and report): read around the cache
+                status = sd_read_blocks(pSD, buffer + n * SD_CACHE_SECTOR_SIZE, sector, 1);
+                if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+                ++stats.bypassed;
+                continue;
+            }
+            status = sd_read_blocks(pSD, sectors[i], sector, 1);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+                drop(i);
+                break;
+            }
+            ++stats.misses;
+        }
+        memcpy(buffer + n * SD_CACHE_SECTOR_SIZE, sectors[i], SD_CACHE_SECTOR_SIZE);
+    }
+    unlock();
+    return status;
+}
+
+int sd_cache_write(sd_card_t *pSD, const uint8_t *buffer,
+                   uint64_t ulSectorNumber, uint32_t ulSectorCount) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    lock();
+    if (ulSectorCount >= SD_CACHE_BYPASS) {
+        // Straight to the card. The cached copies are updated (and are now
+        // clean), or dropped if the write failed (the card's data is unknown).
+        status = sd_write_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+        stats.bypassed += ulSectorCount;
+        for (int16_t i = 0; used && i < SD_CACHE_SECTORS; ++i) {
+            sd_cache_entry_t *e = &entries[i];
+            if (e->pSD != pSD || !in_range(e->sector, ulSectorNumber, ulSectorCount))
+                continue;
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+                drop(i);
+                continue;
+            }
+            memcpy(sectors[i], buffer + (e->sector - ulSectorNumber) * SD_CACHE_SECTOR_SIZE,
+                   SD_CACHE_SECTOR_SIZE);
+            if (e->dirty) {
+                e->dirty = false;
+                --dirty;
+            }
+        }
+        unlock();
+        return status;
+    }
+    for (uint32_t n = 0; n < ulSectorCount; ++n) {
+        uint64_t sector = ulSectorNumber + n;
+        int16_t i = find(pSD, sector);
+        if (i != SD_CACHE_NONE) {
+            touch(i);
+        } else {
+            status = alloc(pSD, sector, &i);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+        }
+        memcpy(sectors[i], buffer + n * SD_CACHE_SECTOR_SIZE, SD_CACHE_SECTOR_SIZE);
+        if (!entries[i].dirty) {
+            entries[i].dirty = true;
+            ++dirty;
+        }
+        ++stats.writes;
+    }
+    unlock();
+    return status;
+}
+
+int sd_cache_flush(sd_card_t *pSD) {
+    lock();
+    int status = dirty ? flush_nolock(pSD) : SD_BLOCK_DEVICE_ERROR_NONE;
+    unlock();
+    return status;
+}
+
+void sd_cache_discard(sd_card_t *pSD, uint64_t ulSectorNumber,
+                      uint64_t ulSectorCount) {
+    lock();
+    for (int16_t i = 0; used && i < SD_CACHE_SECTORS; ++i) {
+        if (entries[i].pSD == pSD &&
+            in_range(entries[i].sector, ulSectorNumber, ulSectorCount))
+            drop(i);
+    }
+    unlock();
+}
+
+void sd_cache_invalidate(sd_card_t *pSD) {
+    sd_cache_discard(pSD, 0, UINT64_MAX);
+}
+
+void sd_cache_stats_get(sd_cache_stats_t *pStats, bool reset) {
+    lock();
+    *pStats = stats;
+    pStats->used = used;
+    pStats->dirty = dirty;
+    pStats->size = SD_CACHE_SECTORS;
+    if (reset) memset(&stats, 0, sizeof stats);
+    unlock();
+}
+
+#else  // No cache
+
+int sd_cache_read(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                  uint32_t ulSectorCount) {
+    return sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+}
+int sd_cache_write(sd_card_t *pSD, const uint8_t *buffer,
+                   uint64_t ulSectorNumber, uint32_t ulSectorCount) {
+    return sd_write_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+}
+int sd_cache_flush(sd_card_t *pSD) { return SD_BLOCK_DEVICE_ERROR_NONE; }
+void sd_cache_discard(sd_card_t *pSD, uint64_t ulSectorNumber,
+                      uint64_t ulSectorCount) {}
+void sd_cache_invalidate(sd_card_t *pSD) {}
+void sd_cache_stats_get(sd_cache_stats_t *pStats, bool reset) {
+    memset(pStats, 0, sizeof *pStats);
+}
+
+#endif
+
+/* [] END OF FILE */
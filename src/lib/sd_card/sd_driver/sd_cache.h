@@ -0,0 +1,79 @@
+/**
+ * SD Card Sector Cache.
+ *
+ * Write-back sector cache between FatFs (glue.c) and the SD card driver.
+ *
+ * Small reads and writes (FAT, directory, and partial-sector file data) are
+ * kept in a pool of SD_CACHE_SECTORS sectors. A sector is found through a hash
+ * of its number, and the least recently used clean sector is replaced. A
+ * written sector is held (dirty) until the cache is flushed (CTRL_SYNC,
+ * sd_cache_flush) or every sector is dirty and one has to be replaced, which
+ * writes back all of the dirty sectors in ascending order (so they can be
+ * streamed to the card). If that fails, a read is served from the card
+ * (uncached) rather than failed.
+ *
+ * Transfers of SD_CACHE_BYPASS or more sectors go straight to the card, so a
+ * large file transfer doesn't wash out the cache, and are kept coherent with
+ * the cached copies.
+ *
+ * One cache is shared by the cards. Set SD_CACHE_SECTORS to 0 to remove it.
+ *
+ * Copyright 2023-26 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+
+#ifndef _SD_CACHE_H_
+#define _SD_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_CACHE_SECTORS
+#define SD_CACHE_SECTORS 32
+#endif
+#ifndef SD_CACHE_BYPASS
+#define SD_CACHE_BYPASS 4
+#endif
+
+typedef struct {
+    uint32_t hits;          // Sectors read from the cache
+    uint32_t misses;        // Sectors read from the card into the cache
+    uint32_t writes;        // Sectors written into the cache
+    uint32_t evictions;     // Cached sectors replaced to make room
+    uint32_t writebacks;    // Dirty sectors written to the card
+    uint32_t flushes;       // Flushes that wrote back sectors
+    uint32_t write_errors;  // Failed write-backs (the sector is kept dirty)
+    uint32_t bypassed;      // Sectors straight to/from the card (large transfers, or
+                            // reads when no entry can be freed)
+    uint32_t used;          // Sectors cached (now)
+    uint32_t dirty;         // Sectors dirty (now)
+    uint32_t size;          // SD_CACHE_SECTORS
+} sd_cache_stats_t;
+
+int sd_cache_read(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                  uint32_t ulSectorCount);
+int sd_cache_write(sd_card_t *pSD, const uint8_t *buffer,
+                   uint64_t ulSectorNumber, uint32_t ulSectorCount);
+// Write back the dirty sectors of the card
+int sd_cache_flush(sd_card_t *pSD);
+// Drop cached sectors (dirty ones are not written), for data the card no
+// longer needs (trimmed) or that is written around the cache.
+void sd_cache_discard(sd_card_t *pSD, uint64_t ulSectorNumber,
+                      uint64_t ulSectorCount);
+// Drop all of the card's sectors (when it is unmounted or changed)
+void sd_cache_invalidate(sd_card_t *pSD);
+void sd_cache_stats_get(sd_cache_stats_t *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -200,7 +200,13 @@ static bool crc_on = true;
 */
 
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
+#define SD_DMA_TIMEOUT 1000 /*!< Timeout in ms for an asynchronous block's DMA (as spi_transfer_dma) */
 #define SD_PRESENT_TIMEOUT 5    /* Timeout in ms for detecting card */
+#define SD_CRC_RETRIES 2        /* Retries (at a lower SPI rate) after a CRC error */
+#define SD_PROBE_SECTOR 0       /* Sector read to check the SPI clock rates */
+#define SD_PROBE_READS 4        /* Reads that must pass for a rate to be used */
+#define SD_ERASE_CHUNK 8192     /* Sectors erased by each CMD38 (4MB, or an AU if larger) */
+#define SD_ERASE_TIMEOUT 5000   /* Minimum timeout in ms for erasing a chunk */
 
 /* Control Tokens   */
 #define SPI_DATA_RESPONSE_MASK (0x1F)
@@ -302,7 +308,18 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        cmdPacket[5] = (crc7(cmdPacket, 5) << 1) | 0x01;
+        // The frequent fixed commands have a precomputed CRC
+        if (CMD13_SEND_STATUS == cmd && 0 == arg) {
+            cmdPacket[5] = CRC7_CMD13_ARG0;
+        } else if (CMD55_APP_CMD == cmd && 0 == arg) {
+            cmdPacket[5] = CRC7_CMD55_ARG0;
+        } else if (CMD0_GO_IDLE_STATE == cmd && 0 == arg) {
+            cmdPacket[5] = CRC7_CMD0_ARG0;
+        } else if (CMD8_SEND_IF_COND == cmd && 0x1AA == arg) {
+            cmdPacket[5] = CRC7_CMD8_ARG1AA;
+        } else {
+            cmdPacket[5] = (crc7(cmdPacket, 5) << 1) | 0x01;
+        }
     } else
 #endif
     {
@@ -320,10 +337,8 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
                 break;
         }
     }
-    // send a command
-    for (int i = 0; i < PACKET_SIZE; i++) {
-        sd_spi_write(pSD, cmdPacket[i]);
-    }
+    // send a command (one short, polled, transfer)
+    sd_spi_transfer(pSD, (const uint8_t *)cmdPacket, NULL, PACKET_SIZE);
     // The received byte immediataly following CMD12 is a stuff byte,
     // it should be discarded before receive the response of the CMD12.
     if (CMD12_STOP_TRANSMISSION == cmd) {
@@ -341,21 +356,80 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
     return response;
 }
 
-static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
-    char resp;
+// Telemetry (see sd_stats_t)
+#if SD_STATS
+#define SD_STATS_INC(pSD, field) ((pSD)->stats.field++)
+#define SD_STATS_TIME(pSD, field, t0) ((pSD)->stats.field += time_us_32() - (t0))
+#define SD_STATS_OP(pSD, op, t0, status) sd_stats_op(&(pSD)->stats.op, (t0), (status))
+
+static void sd_stats_op(sd_stats_op_t *op, uint32_t t0, int status) {
+    uint32_t us = time_us_32() - t0;
+    uint32_t bin = us ? (31 - __builtin_clz(us)) : 0;
+    op->count++;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) op->errors++;
+    if (us > op->max_us) op->max_us = us;
+    op->total_us += us;
+    op->hist[bin < SD_STATS_HIST_BINS ? bin : SD_STATS_HIST_BINS - 1]++;
+}
+#else
+#define SD_STATS_INC(pSD, field) ((void)(pSD))
+#define SD_STATS_TIME(pSD, field, t0) ((void)(t0))
+#define SD_STATS_OP(pSD, op, t0, status) ((void)(t0))
+#endif
 
+// Polling: The card is polled (for a data token, or the end of busy) with bursts
+// of SD_POLL_BURST fill bytes, which are scanned a word at a time.
+typedef union {
+    uint32_t w[SD_POLL_BURST / 4];
+    uint8_t b[SD_POLL_BURST];
+} sd_burst_t;
+
+// Index of the first byte of the burst that isn't fill, or SD_POLL_BURST
+static uint32_t sd_burst_scan(const sd_burst_t *burst, uint8_t fill) {
+    const uint32_t fill_word = fill * 0x01010101u;
+    for (uint32_t i = 0; i < SD_POLL_BURST / 4; i++) {
+        if (burst->w[i] != fill_word) {
+            uint32_t j = i * 4;
+            while (burst->b[j] == fill) j++;
+            return j;
+        }
+    }
+    return SD_POLL_BURST;
+}
+
+// Poll a burst for the end of busy (the card releases the DO line)
+static bool sd_poll_ready(sd_card_t *pSD) {
+    sd_burst_t burst;
+    sd_spi_transfer(pSD, NULL, burst.b, sizeof burst.b);
+    if (SD_POLL_BURST == sd_burst_scan(&burst, 0x00)) {
+        return false;
+    }
+    pSD->busy = false;
+    return true;
+}
+
+static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
+    // Usually the card is ready: check a byte before polling with bursts
+    if (0x00 != sd_spi_write(pSD, SPI_FILL_CHAR)) {
+        pSD->busy = false;
+        return true;
+    }
     // Keep sending dummy clocks with DI held high until the card releases the
     // DO line
+    uint32_t t0 = time_us_32();
+    bool ready;
     absolute_time_t timeout_time = make_timeout_time_ms(timeout);
     do {
-        resp = sd_spi_write(pSD, 0xFF);
-    } while (resp == 0x00 &&
-             0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
-
-    if (resp == 0x00) DBG_PRINTF("%s failed\r\n", __FUNCTION__);
-
-    // Return success/failure
-    return (resp > 0x00);
+        ready = sd_poll_ready(pSD);
+    } while (!ready && 0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
+
+    SD_STATS_INC(pSD, busy_waits);
+    SD_STATS_TIME(pSD, busy_us, t0);
+    if (!ready) {
+        DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+        SD_STATS_INC(pSD, timeouts);
+    }
+    return ready;
 }
 
 // An SD card can only do one thing at a time.
@@ -368,16 +442,54 @@ static void sd_unlock(sd_card_t *pSD) {
     mutex_exit(&pSD->mutex);
 }
 
+// The card is left selected between calls while a streamed or asynchronous
+// transfer is open
+static bool sd_held(sd_card_t *pSD) {
+    return (SD_STREAM_NONE != pSD->stream || SD_ASYNC_NONE != pSD->async_op);
+}
+
 // Locks the SD card and acquires its SPI
+// (with a transfer open, the card has been left selected)
 static void sd_acquire(sd_card_t *pSD) {
     sd_lock(pSD);
-    sd_spi_acquire(pSD);
+    if (!sd_held(pSD)) {
+        sd_spi_acquire(pSD);
+    } else {
+        sd_spi_resume(pSD);
+    }
 }
 static void sd_release(sd_card_t *pSD) {
+    bool streaming = sd_held(pSD);
     sd_unlock(pSD);
-    sd_spi_release(pSD);
+    if (streaming) {
+        sd_spi_suspend(pSD);
+    } else {
+        sd_spi_release(pSD);
+    }
 }
 
+static void sd_write_complete_nolock(sd_card_t *pSD);
+
+static uint64_t sd_sector_addr(sd_card_t *pSD, uint64_t ulSectorNumber) {
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    return (SDCARD_V2HC == pSD->card_type) ? ulSectorNumber
+                                           : ulSectorNumber * _block_size;
+}
+
+#if SD_STREAMING
+static void sd_stream_stop_nolock(sd_card_t *pSD);
+static int in_sd_read_stream(sd_card_t *pSD, uint8_t *buffer,
+                             uint64_t ulSectorNumber, uint32_t ulSectorCount);
+static int in_sd_write_stream(sd_card_t *pSD, const uint8_t *buffer,
+                              uint64_t ulSectorNumber, uint32_t blockCnt);
+#define in_sd_read in_sd_read_stream
+#define in_sd_write in_sd_write_stream
+#else
+#define in_sd_read in_sd_read_blocks
+#define in_sd_write in_sd_write_blocks
+#endif
+
 #if DEBUG_TRACE_ENABLE
 static const char *cmd2str(const cmdSupported cmd) {
     switch (cmd) {
@@ -444,8 +556,8 @@ static const char *cmd2str(const cmdSupported cmd) {
 static const char* cmd2str(const cmdSupported cmd) {return ("");}
 #endif
 
-static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
-                  bool isAcmd, uint32_t *resp) {
+static int in_sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                     bool isAcmd, uint32_t *resp) {
     TRACE_PRINTF("%s(%s(0x%08lx)): ", __FUNCTION__, cmd2str(cmd), arg);
 
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
@@ -471,6 +583,7 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
         response = sd_cmd_spi(pSD, cmd, arg);
         if (R1_NO_RESPONSE == response) {
             DBG_PRINTF("No response CMD:%d\r\n", cmd);
+            SD_STATS_INC(pSD, cmd_retries);
             continue;
         }
         break;
@@ -605,11 +718,45 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     return status;
 }
 
+#if SD_STATS
+static sd_stats_cmd_t sd_stats_cmd_class(const cmdSupported cmd) {
+    switch (cmd) {
+        case CMD17_READ_SINGLE_BLOCK:
+            return SD_STATS_CMD17;
+        case CMD18_READ_MULTIPLE_BLOCK:
+            return SD_STATS_CMD18;
+        case CMD24_WRITE_BLOCK:
+            return SD_STATS_CMD24;
+        case CMD25_WRITE_MULTIPLE_BLOCK:
+            return SD_STATS_CMD25;
+        case CMD13_SEND_STATUS:
+            return SD_STATS_CMD13;
+        case CMD12_STOP_TRANSMISSION:
+            return SD_STATS_CMD12;
+        default:
+            return SD_STATS_CMD_OTHER;
+    }
+}
+#endif
+
+static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                  bool isAcmd, uint32_t *resp) {
+    uint32_t t0 = time_us_32();
+    int status = in_sd_cmd(pSD, cmd, arg, isAcmd, resp);
+    SD_STATS_OP(pSD, cmd[sd_stats_cmd_class(cmd)], t0, status);
+    return status;
+}
+
 /* Return non-zero if the SD-card is present. */
 bool sd_card_detect(sd_card_t *pSD) {
     TRACE_PRINTF("> %s\r\n", __FUNCTION__);
     bool present = false;
     if (!pSD->use_card_detect) {
+        // With a transfer open, or written data being programmed, polling the bus
+        // would corrupt it (and the card was there), so report what's known.
+        if (sd_held(pSD) || pSD->busy) {
+            return !(pSD->m_Status & STA_NODISK);
+        }
         // See if a card responds
         present = sd_wait_ready(pSD, SD_PRESENT_TIMEOUT);
     }
@@ -679,18 +826,23 @@ static int sd_cmd8(sd_card_t *pSD) {
     return status;
 }
 
-static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
+// Bits msb..lsb of a register of n bytes (sent MSB first)
+static uint32_t ext_bits_n(unsigned char *data, uint32_t n, int msb, int lsb) {
     uint32_t bits = 0;
     uint32_t size = 1 + msb - lsb;
     for (uint32_t i = 0; i < size; i++) {
         uint32_t position = lsb + i;
-        uint32_t byte = 15 - (position >> 3);
+        uint32_t byte = (n - 1) - (position >> 3);
         uint32_t bit = position & 0x7;
         uint32_t value = (data[byte] >> bit) & 1;
         bits |= value << i;
     }
     return bits;
 }
+// Bits of the CSD/CID (16 bytes)
+static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
+    return ext_bits_n(data, 16, msb, lsb);
+}
 
 static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length);
 
@@ -750,85 +902,125 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     return blocks;
 }
 uint64_t sd_sectors(sd_card_t *pSD) {
+    if (SD_ASYNC_NONE != pSD->async_op) {
+        return pSD->sectors;  // As found at init
+    }
     sd_acquire(pSD);
+    sd_write_complete_nolock(pSD);
+#if SD_STREAMING
+    sd_stream_stop_nolock(pSD);
+#endif
     uint64_t sectors = sd_sectors_nolock(pSD);
     sd_release(pSD);
     return sectors;
 }
 
-// SPI function to wait till chip is ready and sends start token
-static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
-    TRACE_PRINTF("%s(0x%02hhx)\r\n", __FUNCTION__, token);
+#define SPI_START_BLOCK \
+    (0xFE) /*!< For Single Block Read/Write and Multiple Block Read */
 
-    const uint32_t timeout = SD_COMMAND_TIMEOUT;  // Wait for start token
-    absolute_time_t timeout_time = make_timeout_time_ms(timeout);
-    do {
-        if (token == sd_spi_write(pSD, SPI_FILL_CHAR)) {
-            return true;
+// Poll a burst for the start token of a data block. The bytes received after
+// the token are the start of the block: they're put in buffer (up to length,
+// then crc_bytes). Returns the number of bytes of the block received (data and
+// CRC), SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK if there's no token yet, or
+// SD_BLOCK_DEVICE_ERROR_NO_RESPONSE for a data error token.
+static int sd_poll_token(sd_card_t *pSD, uint8_t *buffer, uint32_t length,
+                         uint8_t crc_bytes[2]) {
+    sd_burst_t burst;
+    sd_spi_transfer(pSD, NULL, burst.b, sizeof burst.b);
+    uint32_t i = sd_burst_scan(&burst, SPI_FILL_CHAR);
+    if (SD_POLL_BURST == i) {
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+    if (SPI_START_BLOCK != burst.b[i]) {
+        DBG_PRINTF("%s: Data error token 0x%02x\r\n", __FUNCTION__, burst.b[i]);
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    }
+    uint32_t got = 0;
+    for (++i; i < SD_POLL_BURST && got < length + 2; ++i, ++got) {
+        if (got < length) {
+            buffer[got] = burst.b[i];
+        } else {
+            crc_bytes[got - length] = burst.b[i];
         }
-    } while (0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
-    DBG_PRINTF("sd_wait_token: timeout\r\n");
-    return false;
+    }
+    return got;
 }
 
-#define SPI_START_BLOCK \
-    (0xFE) /*!< For Single Block Read/Write and Multiple Block Read */
-
-static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
-    uint16_t crc;
+// SPI function to wait till chip is ready and sends start token.
+// Returns as sd_poll_token, or SD_BLOCK_DEVICE_ERROR_NO_RESPONSE on timeout.
+static int sd_wait_token(sd_card_t *pSD, uint8_t *buffer, uint32_t length,
+                         uint8_t crc_bytes[2]) {
+    TRACE_PRINTF("%s\r\n", __FUNCTION__);
 
-    // read until start byte (0xFE)
-    if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
-        DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
+    const uint32_t timeout = SD_COMMAND_TIMEOUT;  // Wait for start token
+    uint32_t t0 = time_us_32();
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout);
+    int got;
+    do {
+        got = sd_poll_token(pSD, buffer, length, crc_bytes);
+    } while (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == got &&
+             0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
+    SD_STATS_TIME(pSD, token_us, t0);
+    if (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == got) {
+        DBG_PRINTF("sd_wait_token: timeout\r\n");
+        SD_STATS_INC(pSD, timeouts);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    // read data
-    for (uint32_t i = 0; i < length; i++) {
-        buffer[i] = sd_spi_write(pSD, SPI_FILL_CHAR);
-    }
-    // Read the CRC16 checksum for the data block
-    crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
-    crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+    return got;
+}
 
+// Transfer a data block. With the CRC on, the CRC16 in *crc is updated with the
+// data as it's transferred (by the DMA sniffer, see spi_transfer_crc).
+static bool sd_data_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                             uint32_t length, uint16_t *crc) {
 #if SD_CRC_ENABLED
     if (crc_on) {
-        uint32_t crc_result;
-        // Compute and verify checksum
-        crc_result = crc16((void *)buffer, length);
-        if ((uint16_t)crc_result != crc) {
-            DBG_PRINTF("_read_bytes: Invalid CRC received 0x%" PRIx16
-                       " result of computation 0x%" PRIx16 "\r\n",
-                       crc, (uint16_t)crc_result);
-            return SD_BLOCK_DEVICE_ERROR_CRC;
-        }
+        return sd_spi_transfer_crc(pSD, tx, rx, length, crc);
     }
 #endif
+    *crc = (~0);
+    return sd_spi_transfer(pSD, tx, rx, length);
+}
 
-    return 0;
+// The CRC16 of the start of a data block (received with its token)
+static uint16_t sd_data_crc_start(const uint8_t *buffer, uint32_t got) {
+    uint16_t crc = 0;
+#if SD_CRC_ENABLED
+    if (crc_on && got) {
+        update_crc16(&crc, (const char *)buffer, got);
+    }
+#endif
+    return crc;
 }
+
 static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     uint16_t crc;
+    uint8_t crc_bytes[2];
 
-    // read until start byte (0xFE)
-    if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
+    // read until start byte (0xFE), which comes with the start of the data
+    int got = sd_wait_token(pSD, buffer, length, crc_bytes);
+    if (got < 0) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
-        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        return got;
     }
-    // read data
-    // bool spi_transfer(const uint8_t *tx, uint8_t *rx, size_t length)
-    if (!sd_spi_transfer(pSD, NULL, buffer, length)) {
+    uint32_t data_got = ((uint32_t)got < length) ? (uint32_t)got : length;
+    // read the rest of the data
+    uint16_t crc_result = sd_data_crc_start(buffer, data_got);
+    if (data_got < length &&
+        !sd_data_transfer(pSD, NULL, buffer + data_got, length - data_got, &crc_result)) {
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    // Read the CRC16 checksum for the data block
-    crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
-    crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+    // Read the CRC16 checksum for the data block (what wasn't in the burst)
+    uint32_t crc_got = (uint32_t)got - data_got;
+    if (crc_got < sizeof crc_bytes) {
+        sd_spi_transfer(pSD, NULL, crc_bytes + crc_got, sizeof crc_bytes - crc_got);
+    }
+    crc = (crc_bytes[0] << 8) | crc_bytes[1];
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        uint32_t crc_result;
-        // Compute and verify checksum
-        crc_result = crc16((void *)buffer, length);
-        if ((uint16_t)crc_result != crc) {
+        // Verify checksum
+        if (crc_result != crc) {
             DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
                        " result of computation 0x%" PRIx16 "\r\n",
                        __FUNCTION__, crc, (uint16_t)crc_result);
@@ -840,6 +1032,11 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     return SD_BLOCK_DEVICE_ERROR_NONE;
 }
 
+// A register (CSD/CID) is read as a (short) data block
+static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
+    return sd_read_block(pSD, buffer, length);
+}
+
 static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
                              uint64_t ulSectorNumber, uint32_t ulSectorCount) {
     uint32_t blockCnt = ulSectorCount;
@@ -871,8 +1068,8 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     // receive the data : one block at a time
     int rd_status = 0;
     while (blockCnt) {
-        if (0 != sd_read_block(pSD, buffer, _block_size)) {
-            rd_status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        // Keep the status, so a CRC error can be retried at a lower rate
+        if (0 != (rd_status = sd_read_block(pSD, buffer, _block_size))) {
             break;
         }
         buffer += _block_size;
@@ -887,47 +1084,71 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
 
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount) {
+    if (SD_ASYNC_NONE != pSD->async_op)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
     sd_acquire(pSD);
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, ulSectorCount);
-    int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    uint32_t t0 = time_us_32();
+    sd_write_complete_nolock(pSD);
+    int status;
+    int retries = 0;
+    while (SD_BLOCK_DEVICE_ERROR_CRC ==
+           (status = in_sd_read(pSD, buffer, ulSectorNumber, ulSectorCount))) {
+        pSD->crc_errors++;
+        if (retries++ == SD_CRC_RETRIES) break;
+        SD_STATS_INC(pSD, crc_retries);
+        sd_spi_step_down(pSD);
+    }
+    SD_STATS_OP(pSD, read, t0, status);
     sd_release(pSD);
     return status;
 }
 
 static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
                               uint8_t token, uint32_t length) {
-    uint16_t crc = (~0);
+    uint16_t crc = 0;  // The CRC16 seed (see sd_data_transfer)
     uint8_t response = 0xFF;
 
+    // The card must have finished programming the previous block
+    if (pSD->busy && false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+        DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
+    }
     // indicate start of block
     sd_spi_write(pSD, token);
 
-    // write the data
-    bool ret = sd_spi_transfer(pSD, buffer, NULL, length);
+    // write the data (and get its CRC)
+    bool ret = sd_data_transfer(pSD, buffer, NULL, length, &crc);
     myASSERT(ret);
 
-#if SD_CRC_ENABLED
-    if (crc_on) {
-        // Compute CRC
-        crc = crc16((void *)buffer, length);
-    }
-#endif
-
     // write the checksum CRC16
-    sd_spi_write(pSD, crc >> 8);
-    sd_spi_write(pSD, crc);
+    uint8_t crc_bytes[2] = {crc >> 8, crc & 0xFF};
+    sd_spi_transfer(pSD, crc_bytes, NULL, sizeof crc_bytes);
 
     // check the response token
     response = sd_spi_write(pSD, SPI_FILL_CHAR);
 
-    // Wait for last block to be written
-    if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
-        DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
-    }
+    // Don't wait for the block to be programmed. The card is busy until it has
+    // been, which is waited for before the next command or block (or noticed by
+    // sd_service).
+    pSD->busy = true;
+    pSD->wr_pending = true;
     return (response & SPI_DATA_RESPONSE_MASK);
 }
 
+// End a multiple block write with the Stop Tran token. The card must have
+// programmed the last block first (it doesn't see the token while it holds DO
+// low), and is busy again while it finishes the write.
+static bool sd_stop_tran_nolock(sd_card_t *pSD) {
+    bool ready = !pSD->busy || sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+    if (!ready) {
+        DBG_PRINTF("%s:%d: Card not ready for Stop Tran\r\n", __FILE__, __LINE__);
+    }
+    sd_spi_write(pSD, SPI_STOP_TRAN);
+    pSD->busy = true;
+    return ready;
+}
+
 /** Program blocks to a block device
  *
  *
@@ -974,7 +1195,8 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
         // Only CRC and general write error are communicated via response token
         if (response != SPI_DATA_ACCEPTED) {
             DBG_PRINTF("Single Block Write failed: 0x%x \r\n", response);
-            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+            status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                      : SD_BLOCK_DEVICE_ERROR_WRITE;
         }
     } else {
         // Pre-erase setting prior to multiple block write operation
@@ -993,7 +1215,8 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
             response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE, _block_size);
             if (response != SPI_DATA_ACCEPTED) {
                 DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
-                status = SD_BLOCK_DEVICE_ERROR_WRITE;
+                status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                          : SD_BLOCK_DEVICE_ERROR_WRITE;
                 break;
             }
             buffer += _block_size;
@@ -1002,25 +1225,895 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
          * done by sending 'Stop Tran' token instead of 'Start Block' token at
          * the beginning of the next block
          */
-        sd_spi_write(pSD, SPI_STOP_TRAN);
+        if (!sd_stop_tran_nolock(pSD) && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+        }
     }
-    uint32_t stat = 0;
-    // Some SD cards want to be deselected between every bus transaction:
-    sd_spi_deselect_pulse(pSD);
-    status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    // The card status (CMD13) is checked when the data has been programmed
+    // (sd_write_complete_nolock)
+    pSD->wr_check = (SD_BLOCK_DEVICE_ERROR_NONE == status);
     return status;
 }
 
 int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt) {
+    if (SD_ASYNC_NONE != pSD->async_op)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
     sd_acquire(pSD);
     TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, blockCnt);
-    int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    uint32_t t0 = time_us_32();
+    sd_write_complete_nolock(pSD);
+    int status;
+    int retries = 0;
+    while (SD_BLOCK_DEVICE_ERROR_CRC ==
+           (status = in_sd_write(pSD, buffer, ulSectorNumber, blockCnt))) {
+        pSD->crc_errors++;
+        if (retries++ == SD_CRC_RETRIES) break;
+        SD_STATS_INC(pSD, crc_retries);
+        sd_spi_step_down(pSD);
+    }
+    SD_STATS_OP(pSD, write, t0, status);
+    // An error completing an earlier write
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        status = pSD->wr_err;
+        pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;
+    }
     sd_release(pSD);
     return status;
 }
 
+// Complete a write: wait for the data to be programmed (the card not busy), check
+// the card status if the write wasn't streamed, and report the completion. An
+// error is kept in wr_err, to be returned by the next write or sync.
+static void sd_write_complete_nolock(sd_card_t *pSD) {
+    if (!pSD->wr_pending) {
+        return;
+    }
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (pSD->busy && false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+        status = SD_BLOCK_DEVICE_ERROR_WRITE;
+    } else if (pSD->wr_check) {
+        uint32_t stat = 0;
+        // Some SD cards want to be deselected between every bus transaction:
+        sd_spi_deselect_pulse(pSD);
+        status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    }
+    pSD->wr_pending = false;
+    pSD->wr_check = false;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        pSD->wr_err = status;
+    }
+    if (pSD->write_done) {
+        pSD->write_done(pSD, status);
+    }
+}
+
+#if SD_STREAMING
+// Streaming: A sequential multi-block transfer is kept open across calls.
+//   Reads: CMD18 is opened for a multi-sector read, or a read that starts where
+//   the last one ended (an isolated single sector is read with CMD17). It runs
+//   on, and while the reads are sequential the sectors after the last one asked
+//   for are read ahead (sd_service) into a ring, to be taken by the next read.
+//   Writes: ACMD23 (the count of the first request) and CMD25 are opened for a
+//   multi-sector write, or a write that starts where the last one ended (an
+//   isolated single sector, such as a FAT or directory update, is written with
+//   CMD24), and run on.
+// The transfer is stopped (CMD12 / Stop Tran token) by a request that doesn't
+// continue it (not the next sector, or the other direction), a sync, an erase
+// (sd_erase_blocks), a capacity read (sd_sectors), a probe retry (sd_init), or
+// after SD_STREAM_IDLE_MS unused. sd_card_detect doesn't use the bus while it's
+// open.
+
+// Track the reads: a read is sequential if it starts where the last one ended.
+// Read-ahead is only done for sequential reads.
+static bool sd_read_sequential(sd_card_t *pSD, uint64_t ulSectorNumber,
+                               uint32_t ulSectorCount) {
+    bool sequential = (ulSectorNumber == pSD->rd_next);
+    pSD->rd_next = ulSectorNumber + ulSectorCount;
+#if SD_READ_AHEAD
+    pSD->ra_on = sequential;
+#endif
+    return sequential;
+}
+
+// Track the writes the same way: only sequential runs are streamed
+static bool sd_write_sequential(sd_card_t *pSD, uint64_t ulSectorNumber,
+                                uint32_t blockCnt) {
+    bool sequential = (ulSectorNumber == pSD->wr_next);
+    pSD->wr_next = ulSectorNumber + blockCnt;
+    return sequential;
+}
+
+static uint32_t sd_ms(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+// Stop the open transfer (if any). An error completing a write transfer is kept
+// in wr_err, to be returned by the next write or sync.
+static void sd_stream_stop_nolock(sd_card_t *pSD) {
+    switch (pSD->stream) {
+        case SD_STREAM_READ:
+#if SD_READ_AHEAD
+            pSD->ra_count = 0;
+#endif
+            sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
+            break;
+        case SD_STREAM_WRITE: {
+            sd_write_complete_nolock(pSD);
+            sd_stop_tran_nolock(pSD);
+            uint32_t stat = 0;
+            // Some SD cards want to be deselected between every bus transaction:
+            sd_spi_deselect_pulse(pSD);
+            int status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+                pSD->wr_err = status;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    pSD->stream = SD_STREAM_NONE;
+}
+
+static int in_sd_read_stream(sd_card_t *pSD, uint8_t *buffer,
+                             uint64_t ulSectorNumber, uint32_t ulSectorCount) {
+    if (ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    bool sequential = sd_read_sequential(pSD, ulSectorNumber, ulSectorCount);
+    pSD->stream_t_used = sd_ms();
+#if SD_READ_AHEAD
+    // Take what has been read ahead
+    while (ulSectorCount && pSD->ra_count &&
+           ulSectorNumber == pSD->stream_next - pSD->ra_count) {
+        memcpy(buffer, pSD->ra_buf[pSD->ra_head], _block_size);
+        pSD->ra_head = (pSD->ra_head + 1) % SD_READ_AHEAD;
+        pSD->ra_count--;
+        buffer += _block_size;
+        ++ulSectorNumber;
+        --ulSectorCount;
+    }
+    if (0 == ulSectorCount) {
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+#endif
+    int status;
+    if (SD_STREAM_READ != pSD->stream || pSD->stream_next != ulSectorNumber
+#if SD_READ_AHEAD
+        || pSD->ra_count
+#endif
+    ) {
+        // Not sequential (or a write is open)
+        sd_stream_stop_nolock(pSD);
+        if (1 == ulSectorCount && !sequential) {
+            // An isolated sector: a single block read (not worth a stream)
+            status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK,
+                            sd_sector_addr(pSD, ulSectorNumber), false, 0);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+                status = sd_read_block(pSD, buffer, _block_size);
+            }
+            return status;
+        }
+        status = sd_cmd(pSD, CMD18_READ_MULTIPLE_BLOCK,
+                        sd_sector_addr(pSD, ulSectorNumber), false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            return status;
+        }
+        pSD->stream = SD_STREAM_READ;
+        pSD->stream_next = ulSectorNumber;
+    }
+    // receive the data : one block at a time
+    while (ulSectorCount) {
+        status = sd_read_block(pSD, buffer, _block_size);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            sd_stream_stop_nolock(pSD);
+            return status;
+        }
+        buffer += _block_size;
+        ++pSD->stream_next;
+        --ulSectorCount;
+    }
+    if (pSD->stream_next >= pSD->sectors) {
+        // Don't let the card run on past the last sector
+        sd_stream_stop_nolock(pSD);
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int in_sd_write_stream(sd_card_t *pSD, const uint8_t *buffer,
+                              uint64_t ulSectorNumber, uint32_t blockCnt) {
+    if (ulSectorNumber + blockCnt > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    bool sequential = sd_write_sequential(pSD, ulSectorNumber, blockCnt);
+    int status;
+    if (SD_STREAM_WRITE != pSD->stream || pSD->stream_next != ulSectorNumber) {
+        // Not sequential (or a read is open, and its read-ahead is dropped)
+        sd_stream_stop_nolock(pSD);
+        if (1 == blockCnt && !sequential) {
+            // An isolated sector: a single block write (not worth a stream)
+            return in_sd_write_blocks(pSD, buffer, ulSectorNumber, 1);
+        }
+        // Pre-erase setting prior to multiple block write operation
+        sd_cmd(pSD, ACMD23_SET_WR_BLK_ERASE_COUNT, blockCnt, 1, 0);
+
+        // Some SD cards want to be deselected between every bus transaction:
+        sd_spi_deselect_pulse(pSD);
+
+        status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK,
+                        sd_sector_addr(pSD, ulSectorNumber), false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            return status;
+        }
+        pSD->stream = SD_STREAM_WRITE;
+        pSD->stream_next = ulSectorNumber;
+    }
+    // Write the data: one block at a time
+    do {
+        uint8_t response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE, _block_size);
+        if (response != SPI_DATA_ACCEPTED) {
+            DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
+            sd_stream_stop_nolock(pSD);
+            pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;  // This is the error
+            return (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                    : SD_BLOCK_DEVICE_ERROR_WRITE;
+        }
+        buffer += _block_size;
+        ++pSD->stream_next;
+    } while (--blockCnt);
+    pSD->stream_t_used = sd_ms();
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+#if SD_READ_AHEAD
+static void sd_read_ahead_nolock(sd_card_t *pSD, uint32_t max_sectors) {
+    while (max_sectors-- && pSD->ra_count < SD_READ_AHEAD &&
+           pSD->stream_next < pSD->sectors) {
+        uint8_t slot = (pSD->ra_head + pSD->ra_count) % SD_READ_AHEAD;
+        if (SD_BLOCK_DEVICE_ERROR_NONE !=
+            sd_read_block(pSD, pSD->ra_buf[slot], _block_size)) {
+            // Leave it to a real read to retry
+            sd_stream_stop_nolock(pSD);
+            return;
+        }
+        pSD->ra_count++;
+        ++pSD->stream_next;
+    }
+}
+#endif
+#endif
+
+static void sd_async_dma_check(sd_card_t *pSD);
+
+void sd_service(sd_card_t *pSD, uint32_t max_sectors) {
+    if (SD_ASYNC_NONE != pSD->async_op) {
+        sd_async_dma_check(pSD);
+        return;
+    }
+    if (!pSD->wr_pending && SD_STREAM_NONE == pSD->stream) {
+        return;
+    }
+    sd_acquire(pSD);
+    // A write completes when the card releases DO (isn't busy)
+    if (pSD->wr_pending && (!pSD->busy || 0x00 != sd_spi_write(pSD, SPI_FILL_CHAR))) {
+        pSD->busy = false;
+        sd_write_complete_nolock(pSD);
+    }
+#if SD_STREAMING
+    if (SD_STREAM_NONE != pSD->stream &&
+        (sd_ms() - pSD->stream_t_used) >= SD_STREAM_IDLE_MS) {
+        sd_stream_stop_nolock(pSD);
+    }
+#if SD_READ_AHEAD
+    else if (SD_STREAM_READ == pSD->stream && pSD->ra_on) {
+        sd_read_ahead_nolock(pSD, max_sectors);
+    }
+#endif
+#endif
+    sd_release(pSD);
+}
+
+int sd_sync(sd_card_t *pSD) {
+    if (SD_ASYNC_NONE != pSD->async_op)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    if (!pSD->wr_pending && SD_STREAM_NONE == pSD->stream &&
+        SD_BLOCK_DEVICE_ERROR_NONE == pSD->wr_err) {
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    sd_acquire(pSD);
+    sd_write_complete_nolock(pSD);
+#if SD_STREAMING
+    sd_stream_stop_nolock(pSD);
+#endif
+    int status = pSD->wr_err;
+    pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;
+    sd_release(pSD);
+    return status;
+}
+
+// Asynchronous transfers: The command is sent (and the read-ahead ring taken
+// from) by sd_read_blocks_async/sd_write_blocks_async. The blocks are then
+// transferred by steps (sd_async_step), each of which runs until it has to wait:
+//   Reads: poll for the start token (a burst per step, kicking for another
+//   step), DMA the rest of the data, then check the CRC.
+//   Writes: poll for the end of busy, send the token and DMA the data, then
+//   send the CRC and get the data response. Without streaming, a multiple block
+//   write then polls for the end of busy again to send the Stop Tran token.
+// The DMA completion (IRQ) kicks the next step. With streaming, the transfer
+// joins (and is left as) the open stream.
+
+#define SD_ASYNC_RD_TOKEN 0
+#define SD_ASYNC_RD_DATA 1
+#define SD_ASYNC_WR_BUSY 2
+#define SD_ASYNC_WR_DATA 3
+#define SD_ASYNC_FINISH 4
+#define SD_ASYNC_WR_STOP 5
+
+#define SD_ASYNC_WAIT 1  // A step is waiting (not a status)
+
+static bool sd_async_crc(void) {
+#if SD_CRC_ENABLED
+    return crc_on;
+#else
+    return false;
+#endif
+}
+
+// DMA IRQ
+static void sd_async_dma_done(void *ctx) {
+    sd_card_t *pSD = ctx;
+    pSD->async_dma = false;
+    pSD->async_kick(pSD, false);
+}
+
+// With the CRC on, async_crc is updated with the data
+static void sd_async_dma_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                               uint32_t length) {
+    pSD->async_timeout = make_timeout_time_ms(SD_DMA_TIMEOUT);
+    pSD->async_dma = true;
+    bool ret = sd_spi_transfer_start(pSD, tx, rx, length,
+                                     sd_async_crc() ? &pSD->async_crc : NULL,
+                                     sd_async_dma_done, pSD);
+    myASSERT(ret);
+}
+
+// Poll the card again later, or time out
+static int sd_async_wait_nolock(sd_card_t *pSD, int timeout_status) {
+    if (0 >= absolute_time_diff_us(get_absolute_time(), pSD->async_timeout)) {
+        DBG_PRINTF("%s: timeout\r\n", __FUNCTION__);
+        SD_STATS_INC(pSD, timeouts);
+        return timeout_status;
+    }
+    if (!pSD->async_waiting) {
+        pSD->async_kick(pSD, true);
+    }
+    return SD_ASYNC_WAIT;
+}
+
+// The current block is done
+static void sd_async_next(sd_card_t *pSD, int state) {
+    pSD->async_buf += _block_size;
+#if SD_STREAMING
+    ++pSD->stream_next;
+#endif
+    pSD->async_timeout = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+    pSD->async_state = (--pSD->async_count) ? state : SD_ASYNC_FINISH;
+}
+
+// Run the transfer until it has to wait (SD_ASYNC_WAIT) or is finished (the status)
+static int sd_async_run_nolock(sd_card_t *pSD) {
+    for (;;) {
+        switch (pSD->async_state) {
+            case SD_ASYNC_RD_TOKEN: {
+                // The data is a block (longer than a burst), so the CRC isn't in it
+                int got = sd_poll_token(pSD, pSD->async_buf, _block_size, NULL);
+                if (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == got) {
+                    return sd_async_wait_nolock(pSD, SD_BLOCK_DEVICE_ERROR_NO_RESPONSE);
+                }
+                if (got < 0) {
+                    return got;
+                }
+                pSD->async_state = SD_ASYNC_RD_DATA;
+                pSD->async_crc = sd_data_crc_start(pSD->async_buf, got);
+                sd_async_dma_start(pSD, NULL, pSD->async_buf + got, _block_size - got);
+                return SD_ASYNC_WAIT;
+            }
+            case SD_ASYNC_RD_DATA: {
+                sd_spi_transfer_end(pSD);
+                // Read the CRC16 checksum for the data block
+                uint8_t crc_bytes[2];
+                sd_spi_transfer(pSD, NULL, crc_bytes, sizeof crc_bytes);
+                if (sd_async_crc() &&
+                    pSD->async_crc != ((crc_bytes[0] << 8) | crc_bytes[1])) {
+                    DBG_PRINTF("%s: Invalid CRC received 0x%02x%02x result of "
+                               "computation 0x%" PRIx16 "\r\n", __FUNCTION__,
+                               crc_bytes[0], crc_bytes[1], pSD->async_crc);
+                    // Left to the caller to retry (at the lower rate)
+                    pSD->crc_errors++;
+                    sd_spi_step_down(pSD);
+                    return SD_BLOCK_DEVICE_ERROR_CRC;
+                }
+                sd_async_next(pSD, SD_ASYNC_RD_TOKEN);
+                break;
+            }
+            case SD_ASYNC_WR_BUSY: {
+                // The card must have finished programming the previous block
+                if (pSD->busy && !sd_poll_ready(pSD)) {
+                    return sd_async_wait_nolock(pSD, SD_BLOCK_DEVICE_ERROR_WRITE);
+                }
+                sd_write_complete_nolock(pSD);  // The previous block (doesn't wait)
+                // indicate start of block
+#if SD_STREAMING
+                sd_spi_write(pSD, SPI_START_BLK_MUL_WRITE);
+#else
+                sd_spi_write(pSD, pSD->async_multi ? SPI_START_BLK_MUL_WRITE
+                                                   : SPI_START_BLOCK);
+#endif
+                pSD->async_state = SD_ASYNC_WR_DATA;
+                pSD->async_crc = sd_async_crc() ? 0 : (~0);
+                sd_async_dma_start(pSD, pSD->async_buf, NULL, _block_size);
+                return SD_ASYNC_WAIT;
+            }
+            case SD_ASYNC_WR_DATA: {
+                sd_spi_transfer_end(pSD);
+                uint16_t crc = pSD->async_crc;
+                // write the checksum CRC16
+                uint8_t crc_bytes[2] = {crc >> 8, crc & 0xFF};
+                sd_spi_transfer(pSD, crc_bytes, NULL, sizeof crc_bytes);
+                // check the response token
+                uint8_t response = sd_spi_write(pSD, SPI_FILL_CHAR) & SPI_DATA_RESPONSE_MASK;
+                pSD->busy = true;
+                pSD->wr_pending = true;
+                if (response != SPI_DATA_ACCEPTED) {
+                    DBG_PRINTF("Asynchronous Block Write failed: 0x%x\r\n", response);
+                    if (SPI_DATA_CRC_ERROR == response) {
+                        pSD->crc_errors++;
+                        sd_spi_step_down(pSD);
+                        return SD_BLOCK_DEVICE_ERROR_CRC;
+                    }
+                    return SD_BLOCK_DEVICE_ERROR_WRITE;
+                }
+                sd_async_next(pSD, SD_ASYNC_WR_BUSY);
+                if (SD_ASYNC_FINISH == pSD->async_state && pSD->async_multi) {
+                    pSD->async_state = SD_ASYNC_WR_STOP;
+                }
+                break;
+            }
+            case SD_ASYNC_WR_STOP: {
+                // The card must have programmed the last block before Stop Tran
+                if (pSD->busy && !sd_poll_ready(pSD)) {
+                    return sd_async_wait_nolock(pSD, SD_BLOCK_DEVICE_ERROR_WRITE);
+                }
+                sd_spi_write(pSD, SPI_STOP_TRAN);
+                pSD->busy = true;
+                pSD->async_multi = false;  // Stopped
+                pSD->async_state = SD_ASYNC_FINISH;
+                break;
+            }
+            case SD_ASYNC_FINISH:
+            default:
+                return SD_BLOCK_DEVICE_ERROR_NONE;
+        }
+    }
+}
+
+// End the transfer: stop the command (unless it's streamed), and get the status
+// to report
+static int sd_async_finish_nolock(sd_card_t *pSD, int status) {
+    bool write = (SD_ASYNC_WRITE == pSD->async_op);
+    pSD->async_op = SD_ASYNC_NONE;
+#if SD_STREAMING
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        sd_stream_stop_nolock(pSD);
+        if (write) pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;  // This is the error
+    } else {
+        pSD->stream_t_used = sd_ms();
+        if (!write && pSD->stream_next >= pSD->sectors) {
+            // Don't let the card run on past the last sector
+            sd_stream_stop_nolock(pSD);
+        }
+    }
+#else
+    if (write) {
+        // Still open if the transfer failed (or was cancelled)
+        if (pSD->async_multi) sd_stop_tran_nolock(pSD);
+        pSD->wr_check = (SD_BLOCK_DEVICE_ERROR_NONE == status);
+    } else if (pSD->async_multi) {
+        sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
+    }
+#endif
+    if (write && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        // An error completing an earlier write
+        status = pSD->wr_err;
+        pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    if (write) {
+        SD_STATS_OP(pSD, write, pSD->async_t0, status);
+    } else {
+        SD_STATS_OP(pSD, read, pSD->async_t0, status);
+    }
+    return status;
+}
+
+// Send the read command (or continue the open read stream)
+static int sd_async_read_cmd_nolock(sd_card_t *pSD, uint64_t ulSectorNumber,
+                                    uint32_t ulSectorCount) {
+    sd_write_complete_nolock(pSD);
+#if SD_STREAMING
+    pSD->async_multi = false;
+    if (SD_STREAM_READ == pSD->stream && pSD->stream_next == ulSectorNumber
+#if SD_READ_AHEAD
+        && 0 == pSD->ra_count
+#endif
+    ) {
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    sd_stream_stop_nolock(pSD);
+    int status = sd_cmd(pSD, CMD18_READ_MULTIPLE_BLOCK,
+                        sd_sector_addr(pSD, ulSectorNumber), false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        pSD->stream = SD_STREAM_READ;
+        pSD->stream_next = ulSectorNumber;
+    }
+    return status;
+#else
+    pSD->async_multi = (ulSectorCount > 1);
+    return sd_cmd(pSD, pSD->async_multi ? CMD18_READ_MULTIPLE_BLOCK : CMD17_READ_SINGLE_BLOCK,
+                  sd_sector_addr(pSD, ulSectorNumber), false, 0);
+#endif
+}
+
+// Send the write command (or continue the open write stream)
+static int sd_async_write_cmd_nolock(sd_card_t *pSD, uint64_t ulSectorNumber,
+                                     uint32_t blockCnt) {
+#if SD_STREAMING
+    sd_write_sequential(pSD, ulSectorNumber, blockCnt);
+    pSD->async_multi = false;
+    if (SD_STREAM_WRITE == pSD->stream && pSD->stream_next == ulSectorNumber) {
+        // The busy of the last block is waited for by the first step
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    sd_write_complete_nolock(pSD);
+    sd_stream_stop_nolock(pSD);
+#else
+    sd_write_complete_nolock(pSD);
+    pSD->async_multi = (blockCnt > 1);
+    if (!pSD->async_multi) {
+        return sd_cmd(pSD, CMD24_WRITE_BLOCK, sd_sector_addr(pSD, ulSectorNumber), false, 0);
+    }
+#endif
+    // Pre-erase setting prior to multiple block write operation
+    sd_cmd(pSD, ACMD23_SET_WR_BLK_ERASE_COUNT, blockCnt, 1, 0);
+
+    // Some SD cards want to be deselected between every bus transaction:
+    sd_spi_deselect_pulse(pSD);
+
+    int status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK,
+                        sd_sector_addr(pSD, ulSectorNumber), false, 0);
+#if SD_STREAMING
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        pSD->stream = SD_STREAM_WRITE;
+        pSD->stream_next = ulSectorNumber;
+    }
+#endif
+    return status;
+}
+
+static int sd_async_start(sd_card_t *pSD, int op, uint8_t *buffer,
+                          uint64_t ulSectorNumber, uint32_t count,
+                          sd_async_done_fn done, void *user_data) {
+    myASSERT(pSD->async_kick && done);
+    if (SD_ASYNC_NONE != pSD->async_op)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    if (0 == count || ulSectorNumber + count > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    sd_acquire(pSD);
+    TRACE_PRINTF("%s(0x%p, 0x%llx, 0x%lx)\r\n", __FUNCTION__, buffer,
+                 ulSectorNumber, count);
+    pSD->async_t0 = time_us_32();
+    int status;
+    if (SD_ASYNC_READ == op) {
+#if SD_STREAMING
+        sd_read_sequential(pSD, ulSectorNumber, count);
+#endif
+#if SD_STREAMING && SD_READ_AHEAD
+        // Take what has been read ahead
+        while (count && pSD->ra_count &&
+               ulSectorNumber == pSD->stream_next - pSD->ra_count) {
+            memcpy(buffer, pSD->ra_buf[pSD->ra_head], _block_size);
+            pSD->ra_head = (pSD->ra_head + 1) % SD_READ_AHEAD;
+            pSD->ra_count--;
+            buffer += _block_size;
+            ++ulSectorNumber;
+            --count;
+        }
+        status = count ? sd_async_read_cmd_nolock(pSD, ulSectorNumber, count)
+                       : SD_BLOCK_DEVICE_ERROR_NONE;
+#else
+        status = sd_async_read_cmd_nolock(pSD, ulSectorNumber, count);
+#endif
+        pSD->async_state = count ? SD_ASYNC_RD_TOKEN : SD_ASYNC_FINISH;
+    } else {
+        status = sd_async_write_cmd_nolock(pSD, ulSectorNumber, count);
+        pSD->async_state = SD_ASYNC_WR_BUSY;
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        pSD->async_op = op;
+        pSD->async_buf = buffer;
+        pSD->async_count = count;
+        pSD->async_timeout = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+        pSD->async_done = done;
+        pSD->async_user_data = user_data;
+        pSD->async_dma = false;
+        pSD->async_waiting = false;
+        pSD->async_kick(pSD, true);
+    }
+    sd_release(pSD);
+    return status;
+}
+
+int sd_read_blocks_async(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                         uint32_t ulSectorCount, sd_async_done_fn done, void *user_data) {
+    return sd_async_start(pSD, SD_ASYNC_READ, buffer, ulSectorNumber,
+                          ulSectorCount, done, user_data);
+}
+
+int sd_write_blocks_async(sd_card_t *pSD, const uint8_t *buffer, uint64_t ulSectorNumber,
+                          uint32_t blockCnt, sd_async_done_fn done, void *user_data) {
+    // The buffer is only read
+    return sd_async_start(pSD, SD_ASYNC_WRITE, (uint8_t *)buffer, ulSectorNumber,
+                          blockCnt, done, user_data);
+}
+
+void sd_async_step(sd_card_t *pSD) {
+    if (SD_ASYNC_NONE == pSD->async_op || pSD->async_dma) {
+        return;  // Nothing to do yet (a stale kick)
+    }
+    sd_async_done_fn done = NULL;
+    void *user_data = NULL;
+    sd_acquire(pSD);
+    int status = sd_async_run_nolock(pSD);
+    if (SD_ASYNC_WAIT != status) {
+        done = pSD->async_done;
+        user_data = pSD->async_user_data;
+        status = sd_async_finish_nolock(pSD, status);
+    }
+    sd_release(pSD);
+    // Called unlocked, so it can start another transfer
+    if (done) {
+        done(pSD, status, user_data);
+    }
+}
+
+// A block's DMA that doesn't complete (no IRQ) would leave the transfer waiting
+// for ever, so it's aborted and the transfer ends with NO_RESPONSE.
+static void sd_async_dma_check(sd_card_t *pSD) {
+    if (!pSD->async_dma ||
+        0 < absolute_time_diff_us(get_absolute_time(), pSD->async_timeout)) {
+        return;
+    }
+    sd_async_done_fn done = NULL;
+    void *user_data = NULL;
+    int status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    sd_acquire(pSD);
+    if (SD_ASYNC_NONE != pSD->async_op && pSD->async_dma) {  // It might have just completed
+        DBG_PRINTF("%s: DMA timeout\r\n", __FUNCTION__);
+        SD_STATS_INC(pSD, timeouts);
+        sd_spi_transfer_abort(pSD);
+        pSD->async_dma = false;
+        done = pSD->async_done;
+        user_data = pSD->async_user_data;
+        status = sd_async_finish_nolock(pSD, status);
+    }
+    sd_release(pSD);
+    if (done) {
+        done(pSD, status, user_data);
+    }
+}
+
+void sd_async_wait(sd_card_t *pSD) {
+    if (SD_ASYNC_NONE == pSD->async_op) {
+        return;
+    }
+    pSD->async_waiting = true;
+    while (SD_ASYNC_NONE != pSD->async_op) {
+        if (pSD->async_dma) {
+            sd_async_dma_check(pSD);
+            tight_loop_contents();
+        } else {
+            sd_async_step(pSD);
+        }
+    }
+}
+
+// Timeout for erasing n sectors: per the SD Status, erase_size AUs take up to
+// erase_timeout seconds, plus erase_offset
+static uint32_t sd_erase_timeout_ms(sd_card_t *pSD, uint64_t n) {
+    if (0 == pSD->au_sectors || 0 == pSD->erase_size || 0 == pSD->erase_timeout)
+        return SD_ERASE_TIMEOUT;
+    uint64_t aus = (n + pSD->au_sectors - 1) / pSD->au_sectors;
+    uint64_t ms = (aus * pSD->erase_timeout * 1000) / pSD->erase_size +
+                  pSD->erase_offset * 1000;
+    return (ms > SD_ERASE_TIMEOUT) ? (uint32_t)ms : SD_ERASE_TIMEOUT;
+}
+
+// Erase a range of sectors, a chunk at a time (CMD32/CMD33 set the range, and
+// CMD38 erases it, with the card busy until it's done). The chunks are aligned
+// to the AU.
+static int sd_erase_nolock(sd_card_t *pSD, uint64_t ulSectorNumber,
+                           uint64_t ulSectorCount) {
+    uint64_t chunk = (pSD->au_sectors > SD_ERASE_CHUNK) ? pSD->au_sectors : SD_ERASE_CHUNK;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    while (ulSectorCount && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint64_t n = chunk - (ulSectorNumber % chunk);
+        if (n > ulSectorCount) n = ulSectorCount;
+        status = sd_cmd(pSD, CMD32_ERASE_WR_BLK_START_ADDR, ulSectorNumber, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_cmd(pSD, CMD33_ERASE_WR_BLK_END_ADDR,
+                            ulSectorNumber + n - 1, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_cmd(pSD, CMD38_ERASE, 0, false, 0);
+        // An erase can take longer than a command
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status &&
+            false == sd_wait_ready(pSD, sd_erase_timeout_ms(pSD, n))) {
+            status = SD_BLOCK_DEVICE_ERROR_ERASE;
+        }
+        ulSectorNumber += n;
+        ulSectorCount -= n;
+    }
+    return status;
+}
+
+int sd_erase_blocks(sd_card_t *pSD, uint64_t ulSectorNumber,
+                    uint64_t ulSectorCount) {
+    if (SD_ASYNC_NONE != pSD->async_op)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    if (ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    // SDSC cards (byte addressed) may erase in units larger than a sector
+    // (CSD ERASE_BLK_EN/SECTOR_SIZE), which would take data around the range
+    if (SDCARD_V2HC != pSD->card_type)
+        return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    if (0 == ulSectorCount)
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    sd_acquire(pSD);
+    TRACE_PRINTF("%s(0x%llx, 0x%llx)\r\n", __FUNCTION__, ulSectorNumber,
+                 ulSectorCount);
+    sd_write_complete_nolock(pSD);
+#if SD_STREAMING
+    sd_stream_stop_nolock(pSD);
+#endif
+    int status = sd_erase_nolock(pSD, ulSectorNumber, ulSectorCount);
+    sd_release(pSD);
+    return status;
+}
+
+void sd_stats_get(sd_card_t *pSD, sd_stats_t *stats, bool reset) {
+#if SD_STATS
+    sd_lock(pSD);
+    *stats = pSD->stats;
+    stats->crc_errors = pSD->crc_errors;
+    if (reset) {
+        memset(&pSD->stats, 0, sizeof pSD->stats);
+        pSD->crc_errors = 0;
+    }
+    sd_unlock(pSD);
+#else
+    memset(stats, 0, sizeof *stats);
+#endif
+}
+
+#if SD_CRC_ENABLED
+// SPI clock probing: The probe sector is read at the initialization (low) rate for
+// a reference, then read at each candidate rate. A rate is used if every read
+// passes the data CRC check and matches the reference.
+static uint8_t probe_buf[BLOCK_SIZE_HC];
+static uint16_t probe_ref_crc;
+static bool probe_ref_valid;
+
+static int sd_read_probe_sector(sd_card_t *pSD) {
+    // Not in_sd_read_blocks, as the card isn't marked as initialized yet
+    uint64_t addr = (SDCARD_V2HC == pSD->card_type) ? SD_PROBE_SECTOR
+                                                    : SD_PROBE_SECTOR * _block_size;
+    int status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, addr, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        return status;
+    }
+    return sd_read_block(pSD, probe_buf, _block_size);
+}
+
+static bool sd_clk_probe(sd_card_t *pSD) {
+    if (!probe_ref_valid) {
+        return false;
+    }
+    for (int i = 0; i < SD_PROBE_READS; i++) {
+        if (SD_BLOCK_DEVICE_ERROR_NONE != sd_read_probe_sector(pSD) ||
+            crc16((void *)probe_buf, _block_size) != probe_ref_crc) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+// Set SCK for data transfer: the fastest rate that reads reliably
+static void sd_go_data_frequency(sd_card_t *pSD) {
+#if SD_CRC_ENABLED
+    if (crc_on) {
+        probe_ref_valid = (SD_BLOCK_DEVICE_ERROR_NONE == sd_read_probe_sector(pSD));
+        probe_ref_crc = crc16((void *)probe_buf, _block_size);
+        sd_spi_go_high_frequency(pSD, sd_clk_probe);
+        // Without the reference no rate passes, so the lowest rate is used. That
+        // isn't the card's limit, so the probe is retried by the next sd_init.
+        pSD->probe_retry = !probe_ref_valid;
+        if (!probe_ref_valid) {
+            pSD->probe_fails++;
+            DBG_PRINTF("%s: Probe reference read failed, using %u Hz until the next mount\r\n",
+                       __FUNCTION__, pSD->spi_rate);
+        }
+        return;
+    }
+#endif
+    // Without the data CRC a bad read can't be detected, so just use the configured rate
+    sd_spi_go_high_frequency(pSD, NULL);
+}
+
+#if SD_CRC_ENABLED
+// Retry the SCK probe for an initialized card whose probe reference read failed
+static void sd_probe_retry(sd_card_t *pSD) {
+    sd_acquire(pSD);
+    if (SD_ASYNC_NONE == pSD->async_op) {
+        sd_write_complete_nolock(pSD);
+#if SD_STREAMING
+        sd_stream_stop_nolock(pSD);
+#endif
+        sd_go_data_frequency(pSD);
+    }
+    sd_release(pSD);
+}
+#endif
+
+// Read the SD Status (ACMD13) for the allocation unit (AU) size and the erase
+// timing. They're left 0 if it can't be read (not an SD card, or v1).
+static void sd_read_sd_status_nolock(sd_card_t *pSD) {
+    // AU_SIZE 0xA..0xF (SDXC): 8, 12, 16, 24, 32 and 64 MB
+    static const uint32_t au_sectors_xc[] = {16384, 24576, 32768, 49152, 65536, 131072};
+    uint8_t status[64];
+
+    pSD->au_sectors = 0;
+    pSD->erase_size = 0;
+    pSD->erase_timeout = 0;
+    pSD->erase_offset = 0;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_cmd(pSD, ACMD13_SD_STATUS, 0, true, 0) ||
+        SD_BLOCK_DEVICE_ERROR_NONE != sd_read_bytes(pSD, status, sizeof status)) {
+        DBG_PRINTF("Couldn't read the SD Status\r\n");
+        return;
+    }
+    uint32_t au_size = ext_bits_n(status, sizeof status, 431, 428);
+    if (au_size >= 0xA) {
+        pSD->au_sectors = au_sectors_xc[au_size - 0xA];
+    } else if (au_size) {
+        pSD->au_sectors = 32u << (au_size - 1);  // 16KB << (AU_SIZE - 1)
+    }
+    pSD->erase_size = ext_bits_n(status, sizeof status, 423, 408);
+    pSD->erase_timeout = ext_bits_n(status, sizeof status, 407, 402);
+    pSD->erase_offset = ext_bits_n(status, sizeof status, 401, 400);
+    DBG_PRINTF("AU: %" PRIu32 " sectors  Erase: %u AUs in %u s + %u s\r\n",
+               pSD->au_sectors, pSD->erase_size, pSD->erase_timeout,
+               pSD->erase_offset);
+}
+
 static int sd_init_medium(sd_card_t *pSD) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response, arg;
@@ -1148,10 +2241,28 @@ int sd_init(sd_card_t *pSD) {
     // Make sure we're not already initialized before proceeding
     if (!(pSD->m_Status & STA_NOINIT)) {
         sd_unlock(pSD);
+#if SD_CRC_ENABLED
+        if (pSD->probe_retry) {
+            sd_probe_retry(pSD);
+        }
+#endif
         return pSD->m_Status;
     }
     // Initialize the member variables
     pSD->card_type = SDCARD_NONE;
+    pSD->stream = SD_STREAM_NONE;
+    pSD->rd_next = UINT64_MAX;
+    pSD->wr_next = UINT64_MAX;
+    pSD->busy = false;
+    pSD->wr_pending = false;
+    pSD->wr_check = false;
+    pSD->wr_err = SD_BLOCK_DEVICE_ERROR_NONE;
+    pSD->async_op = SD_ASYNC_NONE;
+    pSD->async_dma = false;
+#if SD_STREAMING && SD_READ_AHEAD
+    pSD->ra_count = 0;
+    pSD->ra_on = false;
+#endif
 
     sd_spi_acquire(pSD);
 
@@ -1178,7 +2289,9 @@ int sd_init(sd_card_t *pSD) {
         return pSD->m_Status;
     }
     // Set SCK for data transfer
-    sd_spi_go_high_frequency(pSD);
+    sd_go_data_frequency(pSD);
+    // The allocation unit (for GET_BLOCK_SIZE) and erase timing
+    sd_read_sd_status_nolock(pSD);
 
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
@@ -31,8 +31,86 @@ specific language governing permissions and limitations under the License.
 extern "C" {
 #endif
 
-// "Class" representing SD Cards
+// Streaming: A sequential multi-block read (CMD18) or write (CMD25) is kept
+// open across calls, and stopped on a request that doesn't continue it, a sync,
+// an erase or capacity read, or when it has been idle for SD_STREAM_IDLE_MS (see
+// sd_service). An isolated single sector read uses CMD17 (no stream).
+// While a transfer is open the card stays selected, so the SD card must be the
+// only device on its SPI.
+#ifndef SD_STREAMING
+#define SD_STREAMING 1
+#endif
+#ifndef SD_STREAM_IDLE_MS
+#define SD_STREAM_IDLE_MS 20
+#endif
+// Sectors read ahead from an open read transfer (by sd_service).
+#ifndef SD_READ_AHEAD
+#define SD_READ_AHEAD 8
+#endif
+
+#define SD_STREAM_NONE 0
+#define SD_STREAM_READ 1
+#define SD_STREAM_WRITE 2
+
+// Bytes clocked (in a burst) each time the card is polled for a data token or
+// the end of busy. A multiple of 4, 16..64.
+#ifndef SD_POLL_BURST
+#define SD_POLL_BURST 32
+#endif
+
+#define SD_ASYNC_NONE 0
+#define SD_ASYNC_READ 1
+#define SD_ASYNC_WRITE 2
+
+// Performance telemetry (sd_stats_get): per command class and per read/write,
+// counts, errors and latency (with a log2 histogram), and the time spent waiting
+// for the card.
+#ifndef SD_STATS
+#define SD_STATS 1
+#endif
+// Latency histogram: bin n counts latencies of [2^n, 2^(n+1)) us (bin 0 also
+// counts 0 us, the last bin counts all longer ones).
+#define SD_STATS_HIST_BINS 16
+
+// Command classes of the telemetry
+typedef enum {
+    SD_STATS_CMD17,  // READ_SINGLE_BLOCK
+    SD_STATS_CMD18,  // READ_MULTIPLE_BLOCK
+    SD_STATS_CMD24,  // WRITE_BLOCK
+    SD_STATS_CMD25,  // WRITE_MULTIPLE_BLOCK
+    SD_STATS_CMD13,  // SEND_STATUS
+    SD_STATS_CMD12,  // STOP_TRANSMISSION
+    SD_STATS_CMD_OTHER,
+    SD_STATS_CMD_CNT
+} sd_stats_cmd_t;
+
 typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t hist[SD_STATS_HIST_BINS];
+} sd_stats_op_t;
+
+typedef struct {
+    sd_stats_op_t cmd[SD_STATS_CMD_CNT];  // Commands (wait for ready to response)
+    sd_stats_op_t read;          // Block reads (sd_read_blocks and asynchronous)
+    sd_stats_op_t write;         // Block writes (to the data being accepted)
+    uint64_t busy_us;            // Time waiting for the card to be ready
+    uint32_t busy_waits;         // Waits that found the card busy
+    uint64_t token_us;           // Time waiting for read data tokens
+    uint32_t timeouts;           // Busy and data token waits that timed out
+    uint32_t cmd_retries;        // Commands resent after no response
+    uint32_t crc_retries;        // Reads/writes retried after a CRC error
+    uint32_t crc_errors;         // Reads/writes that failed with a CRC error
+} sd_stats_t;
+
+struct sd_card_t_;
+// Called (from sd_async_step) when an asynchronous transfer finishes.
+typedef void (*sd_async_done_fn)(struct sd_card_t_ *pSD, int status, void *user_data);
+
+// "Class" representing SD Cards
+typedef struct sd_card_t_ {
     const char *pcName;
     spi_t *spi;
     // Slave select is here in sd_card_t because multiple SDs can share an SPI
@@ -53,6 +131,60 @@ typedef struct {
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    // SPI clock for data transfer (see sd_spi_go_high_frequency):
+    uint8_t spi_rate_idx;        // Index of the rate in the clock ladder
+    uint spi_rate;               // Actual rate (Hz)
+    uint spi_rate_max;           // Highest rate that passed the probe at init (Hz)
+    uint32_t crc_errors;         // Reads/writes that failed with a CRC error
+    uint32_t rate_drops;         // Times the rate was lowered due to CRC errors
+    uint32_t probe_fails;        // Times the probe reference read failed (the rate was left low)
+    bool probe_retry;            // Retry the probe on the next sd_init (mount)
+    // From the SD Status (ACMD13) at init (0 if unknown):
+    uint32_t au_sectors;         // Allocation unit (sectors)
+    uint16_t erase_size;         // AUs erased in erase_timeout
+    uint8_t erase_timeout;       // Seconds to erase erase_size AUs
+    uint8_t erase_offset;        // Seconds added to an erase
+    // Write completion: A write returns when the card accepts the data, and the
+    // card's programming (busy) is waited for lazily (see sd_service).
+    bool busy;                   // The card may be busy programming written data
+    bool wr_pending;             // A write's completion hasn't been reported yet
+    bool wr_check;               // Check the card status (CMD13) on completion
+    int wr_err;                  // Error completing a write (for the next write/sync)
+    // Called when written data has been programmed, with the status. May be NULL.
+    void (*write_done)(struct sd_card_t_ *pSD, int status);
+    // Streaming (see SD_STREAMING):
+    int stream;                  // SD_STREAM_NONE, SD_STREAM_READ or SD_STREAM_WRITE
+    uint64_t stream_next;        // Next sector of the open transfer
+    uint32_t stream_t_used;      // Time (ms since boot) the transfer was last used
+    uint64_t rd_next;            // Sector after the last read (to detect sequential reads)
+    uint64_t wr_next;            // Sector after the last write (to detect sequential writes)
+    // Asynchronous transfer (see sd_read_blocks_async):
+    int async_op;                // SD_ASYNC_NONE, SD_ASYNC_READ or SD_ASYNC_WRITE
+    int async_state;             // Step of the current block
+    volatile bool async_dma;     // A DMA transfer is in progress
+    uint8_t *async_buf;          // Current block
+    uint32_t async_count;        // Blocks left (including the current one)
+    bool async_multi;            // A multi-block command is open (without streaming)
+    absolute_time_t async_timeout;  // For the token/busy wait or the DMA of the current block
+    bool async_waiting;          // sd_async_wait is running the transfer (no kicks)
+    uint16_t async_crc;          // CRC16 of the current block
+    uint32_t async_t0;           // Time (us) the transfer was started
+    sd_async_done_fn async_done;
+    void *async_user_data;
+    // Has sd_async_step called soon, on the core that started the transfer. Called
+    // from the DMA IRQ when a transfer completes (poll false), and from a step that
+    // is polling the card (poll true). Must be set to use the asynchronous API.
+    void (*async_kick)(struct sd_card_t_ *pSD, bool poll);
+#if SD_STATS
+    sd_stats_t stats;            // Telemetry (crc_errors is kept above)
+#endif
+#if SD_STREAMING && SD_READ_AHEAD
+    // Read-ahead ring: the ra_count sectors before stream_next, from ra_head
+    uint8_t ra_buf[SD_READ_AHEAD][512];
+    uint8_t ra_head;
+    uint8_t ra_count;
+    bool ra_on;                  // The reads are sequential, so read ahead
+#endif
 } sd_card_t;
 
 #define SD_BLOCK_DEVICE_ERROR_NONE 0
@@ -93,6 +225,36 @@ int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount);
 bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
+// Stop an open (streamed) transfer and wait for written data to be programmed.
+// Returns the status of the writes (an error found completing them, since the
+// last write or sync).
+int sd_sync(sd_card_t *pSD);
+// Call periodically: completes a write when the card is no longer busy (calling
+// write_done), stops an idle transfer, and reads up to max_sectors ahead (into
+// the read-ahead ring) from an open read transfer. With an asynchronous transfer
+// in progress, it times out a DMA that hasn't completed.
+void sd_service(sd_card_t *pSD, uint32_t max_sectors);
+// Asynchronous transfers: The command is sent and the transfer is started, then
+// these return. The transfer is advanced by sd_async_step (see async_kick) without
+// waiting for the card or the DMA, and done is called with the status when it
+// finishes. One transfer at a time; while it's in progress the other functions
+// return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK (sd_service does nothing).
+// The buffer must stay valid until done is called.
+int sd_read_blocks_async(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                         uint32_t ulSectorCount, sd_async_done_fn done, void *user_data);
+int sd_write_blocks_async(sd_card_t *pSD, const uint8_t *buffer, uint64_t ulSectorNumber,
+                          uint32_t blockCnt, sd_async_done_fn done, void *user_data);
+// Advance the asynchronous transfer (call when kicked, in thread context).
+void sd_async_step(sd_card_t *pSD);
+// Finish the asynchronous transfer in progress (if any) here, waiting for the
+// card and the DMA (done is called as usual). For a caller that needs the card
+// and can't wait for the kicks (FatFs, see glue.c).
+void sd_async_wait(sd_card_t *pSD);
+// Erase (TRIM) sectors: the data is no longer needed, so the card needn't keep
+// it when it reuses the blocks. Only SDHC/SDXC cards (sector erase units).
+int sd_erase_blocks(sd_card_t *pSD, uint64_t ulSectorNumber, uint64_t ulSectorCount);
+// Get the telemetry (all 0 if SD_STATS is 0), then reset it if reset.
+void sd_stats_get(sd_card_t *pSD, sd_stats_t *stats, bool reset);
 
 #ifdef __cplusplus
 }
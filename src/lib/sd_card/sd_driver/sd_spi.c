@@ -31,10 +31,60 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic ignored "-Wunused-variable"
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
 
-void sd_spi_go_high_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
-    //TRACE_PRINTF("%s: Requested: %lu  Actual frequency: %lu\n", __FUNCTION__, (long)pSD->spi->baud_rate, (long)actual);
+// SPI clock ladder for data transfer (Hz), fastest first. The rate used is the
+// fastest one, not above the configured baud_rate, that passes the probe. The
+// actual rate can be lower than requested (clk_peri is divided down), so
+// entries that end up at the same divider are only tried once.
+static const uint sd_spi_rates[] = {
+    25 * 1000 * 1000, 20 * 1000 * 1000, 16 * 1000 * 1000, 12500 * 1000,
+    8 * 1000 * 1000,  4 * 1000 * 1000,  2 * 1000 * 1000,  800 * 1000,
+    400 * 1000
+};
+#define SD_SPI_RATE_CNT (sizeof sd_spi_rates / sizeof sd_spi_rates[0])
+
+static void sd_spi_set_rate(sd_card_t *pSD, uint8_t idx) {
+    pSD->spi_rate_idx = idx;
+    pSD->spi_rate = spi_set_baudrate(pSD->spi->hw_inst, sd_spi_rates[idx]);
+}
+
+void sd_spi_go_high_frequency(sd_card_t *pSD, sd_spi_probe_t probe) {
+    uint8_t idx = 0;
+    // Start at the first rate that isn't above the configured rate
+    while (idx < SD_SPI_RATE_CNT - 1 && sd_spi_rates[idx] > pSD->spi->baud_rate) {
+        idx++;
+    }
+    // Step down until a rate passes the probe. The lowest rate is used regardless.
+    uint failed = 0;
+    for (; idx < SD_SPI_RATE_CNT - 1; idx++) {
+        sd_spi_set_rate(pSD, idx);
+        if (pSD->spi_rate == failed) {
+            continue;
+        }
+        if (!probe || probe(pSD)) {
+            break;
+        }
+        TRACE_PRINTF("%s: %u Hz failed the probe\n", __FUNCTION__, pSD->spi_rate);
+        failed = pSD->spi_rate;
+    }
+    sd_spi_set_rate(pSD, idx);
+    pSD->spi_rate_max = pSD->spi_rate;
+    DBG_PRINTF("%s: Max: %lu  Using: %lu\n", __FUNCTION__, (long)pSD->spi->baud_rate, (long)pSD->spi_rate);
+}
+
+bool sd_spi_step_down(sd_card_t *pSD) {
+    uint rate = pSD->spi_rate;
+    uint8_t idx = pSD->spi_rate_idx;
+    while (idx < SD_SPI_RATE_CNT - 1) {
+        sd_spi_set_rate(pSD, ++idx);
+        if (pSD->spi_rate < rate) {
+            pSD->rate_drops++;
+            DBG_PRINTF("%s: %lu -> %lu\n", __FUNCTION__, (long)rate, (long)pSD->spi_rate);
+            return true;
+        }
+    }
+    return false;
 }
+
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
     uint slow = (400 * 1000);
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, slow); // Actual frequency: 398089
@@ -86,21 +136,44 @@ void sd_spi_release(sd_card_t *pSD) {
     sd_spi_unlock(pSD);
 }
 
+void sd_spi_suspend(sd_card_t *pSD) {
+    sd_spi_unlock(pSD);
+}
+
+void sd_spi_resume(sd_card_t *pSD) {
+    sd_spi_lock(pSD);
+}
+
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
                      size_t length) {
     return spi_transfer(pSD->spi, tx, rx, length);
 }
 
+bool sd_spi_transfer_crc(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                         size_t length, uint16_t *crc) {
+    return spi_transfer_crc(pSD->spi, tx, rx, length, crc);
+}
+
+bool sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                           size_t length, uint16_t *crc, void (*done)(void *ctx),
+                           void *ctx) {
+    return spi_transfer_start(pSD->spi, tx, rx, length, crc, done, ctx);
+}
+
+void sd_spi_transfer_end(sd_card_t *pSD) {
+    spi_transfer_end(pSD->spi);
+}
+
+void sd_spi_transfer_abort(sd_card_t *pSD) {
+    spi_transfer_abort(pSD->spi);
+}
+
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     // TRACE_PRINTF("%s\n", __FUNCTION__);
     uint8_t received = SPI_FILL_CHAR;
-#if 0
-    int num = spi_write_read_blocking(pSD->spi->hw_inst, &value, &received, 1);
-    myASSERT(1 == num);
-#else
-    bool success = spi_transfer(pSD->spi, &value, &received, 1);
+    // A single byte is always polled (a DMA transfer per byte costs far more).
+    bool success = spi_transfer_polled(pSD->spi, &value, &received, 1);
     myASSERT(success);
-#endif
     return received;
 }
 
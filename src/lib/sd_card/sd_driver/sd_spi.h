@@ -21,12 +21,37 @@ specific language governing permissions and limitations under the License.
 /* Transfer tx to SPI while receiving SPI to rx. 
 tx or rx can be NULL if not important. */
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+/* Same as sd_spi_transfer, also updating the CRC16 in *crc (0 to start) with the
+data (rx if not NULL, otherwise tx). See spi_transfer_crc. */
+bool sd_spi_transfer_crc(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length, uint16_t *crc);
+/* Start a transfer and return without waiting for it. done(ctx) is called from
+the DMA IRQ when it completes, then sd_spi_transfer_end must be called, which
+updates the CRC16 in *crc if crc isn't NULL (see spi_transfer_start). */
+bool sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                           uint16_t *crc, void (*done)(void *ctx), void *ctx);
+void sd_spi_transfer_end(sd_card_t *pSD);
+/* Abort a transfer started with sd_spi_transfer_start that didn't complete. */
+void sd_spi_transfer_abort(sd_card_t *pSD);
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value);
 void sd_spi_deselect_pulse(sd_card_t *pSD);
 void sd_spi_acquire(sd_card_t *pSD);
 void sd_spi_release(sd_card_t *pSD);
+/* Release/re-acquire the SPI, leaving the card selected (a multi-block transfer
+is open, and a select fill byte could take the card's next token). */
+void sd_spi_suspend(sd_card_t *pSD);
+void sd_spi_resume(sd_card_t *pSD);
 void sd_spi_go_low_frequency(sd_card_t *this);
-void sd_spi_go_high_frequency(sd_card_t *this);
+
+/* Check that the card works at the current SPI rate. */
+typedef bool (*sd_spi_probe_t)(sd_card_t *pSD);
+
+/* Set the SPI rate for data transfer: the fastest rate in the clock ladder, not
+above the configured baud_rate, that passes the probe (any rate, if probe is NULL). */
+void sd_spi_go_high_frequency(sd_card_t *pSD, sd_spi_probe_t probe);
+
+/* Step down to the next lower rate in the clock ladder (after CRC errors).
+Returns false if already at the lowest rate. */
+bool sd_spi_step_down(sd_card_t *pSD);
 
 /* 
 After power up, the host starts the clock and sends the initializing sequence on the CMD line. 
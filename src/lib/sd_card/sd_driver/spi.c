@@ -20,23 +20,34 @@ specific language governing permissions and limitations under the License.
 //
 #include "my_debug.h"
 //
+#include "crc.h"
 #include "spi.h"
 
 static bool irqChannel1 = false;
 static bool irqShared = true;
 
+// The DMA transfer is complete: notify the waiting transfer, or the starter of
+// an asynchronous one.
+static void spi_dma_done(spi_t *pSPI) {
+    if (pSPI->async_done) {
+        pSPI->async_done(pSPI->async_ctx);
+    } else {
+        sem_release(&pSPI->sem);
+    }
+}
+
 void spi_irq_handler(spi_t *pSPI) {
     if (irqChannel1) {
         if (dma_hw->ints1 & 1u << pSPI->rx_dma) {  // Ours?
             dma_hw->ints1 = 1u << pSPI->rx_dma;    // clear it
             myASSERT(!dma_channel_is_busy(pSPI->rx_dma));
-            sem_release(&pSPI->sem);
+            spi_dma_done(pSPI);
         }
     } else {
         if (dma_hw->ints0 & 1u << pSPI->rx_dma) {  // Ours?
             dma_hw->ints0 = 1u << pSPI->rx_dma;    // clear it
             myASSERT(!dma_channel_is_busy(pSPI->rx_dma));
-            sem_release(&pSPI->sem);
+            spi_dma_done(pSPI);
         }
     }
 }
@@ -46,15 +57,45 @@ void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
     irqShared = shared;
 }
 
-// SPI Transfer: Read & Write (simultaneously) on SPI bus
-//   If the data that will be received is not important, pass NULL as rx.
-//   If the data that will be transmitted is not important,
-//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
-//     element.
-bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
-    // myASSERT(512 == length || 1 == length);
+// SPI Transfer by polling the FIFOs (for short transfers): Read & Write
+// (simultaneously) on SPI bus. Same arguments as `spi_transfer`.
+//   The TX FIFO is kept no more than a FIFO depth ahead of the RX FIFO, so the
+//   RX FIFO can't overflow.
+bool spi_transfer_polled(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
     myASSERT(tx || rx);
-    // myASSERT(!(tx && rx));
+    const size_t fifo_depth = 8;
+    spi_hw_t *hw = spi_get_hw(pSPI->hw_inst);
+    size_t tx_remaining = length;
+    size_t rx_remaining = length;
+    while (rx_remaining) {
+        if (tx_remaining && (rx_remaining < tx_remaining + fifo_depth) &&
+            (hw->sr & SPI_SSPSR_TNF_BITS)) {
+            hw->dr = (uint32_t)(tx ? *tx++ : SPI_FILL_CHAR);
+            --tx_remaining;
+        }
+        if (hw->sr & SPI_SSPSR_RNE_BITS) {
+            uint8_t received = (uint8_t)hw->dr;
+            if (rx) *rx++ = received;
+            --rx_remaining;
+        }
+    }
+    return true;
+}
+
+// Start a DMA transfer. If crc isn't NULL, the DMA sniffer continues the CRC16
+// in *crc with the data (rx if it's wanted, otherwise tx) as it's transferred.
+static void spi_dma_start(spi_t *pSPI, const uint8_t *tx, uint8_t *rx,
+                          size_t length, const uint16_t *crc) {
+    // Only the channel carrying the data is sniffed
+    bool sniff = (NULL != crc);
+    bool sniff_rx = (sniff && rx);
+    channel_config_set_sniff_enable(&pSPI->tx_dma_cfg, sniff && !rx);
+    channel_config_set_sniff_enable(&pSPI->rx_dma_cfg, sniff_rx);
+    if (sniff) {
+        dma_sniffer_enable(sniff_rx ? pSPI->rx_dma : pSPI->tx_dma,
+                           DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false);
+        dma_sniffer_set_data_accumulator(*crc);  // 0 (the SD CRC16 seed) or a CRC so far
+    }
 
     // tx write increment is already false
     if (tx) {
@@ -92,6 +133,19 @@ bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << pSPI->tx_dma) | (1u << pSPI->rx_dma));
+}
+
+static uint16_t spi_dma_sniffed_crc(void) {
+    uint16_t crc = (uint16_t)dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    return crc;
+}
+
+// DMA transfer. If crc isn't NULL the DMA sniffer continues the CRC16 in *crc
+// with the data (rx if it's wanted, otherwise tx) as it's transferred.
+static bool spi_transfer_dma(spi_t *pSPI, const uint8_t *tx, uint8_t *rx,
+                             size_t length, uint16_t *crc) {
+    spi_dma_start(pSPI, tx, rx, length, crc);
 
     /* Timeout 1 sec */
     uint32_t timeOut = 1000;
@@ -110,6 +164,122 @@ bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
     myASSERT(!dma_channel_is_busy(pSPI->tx_dma));
     myASSERT(!dma_channel_is_busy(pSPI->rx_dma));
 
+    if (crc) {
+        *crc = spi_dma_sniffed_crc();
+    }
+    return true;
+}
+
+// SPI Transfer: Read & Write (simultaneously) on SPI bus
+//   If the data that will be received is not important, pass NULL as rx.
+//   If the data that will be transmitted is not important,
+//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
+//     element.
+//   Short transfers are polled (see SPI_POLLED_MAX), longer ones use DMA.
+bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
+    // myASSERT(512 == length || 1 == length);
+    myASSERT(tx || rx);
+    // myASSERT(!(tx && rx));
+
+    if (length <= SPI_POLLED_MAX) {
+        return spi_transfer_polled(pSPI, tx, rx, length);
+    }
+    return spi_transfer_dma(pSPI, tx, rx, length, NULL);
+}
+
+// SPI Transfer that also computes the CRC16 (SD data CRC) of the data: of rx if
+// it isn't NULL, otherwise of tx. *crc is the CRC so far (0 to start a block),
+// and is updated with the data. For a DMA transfer the CRC is computed by the
+// DMA sniffer in-flight, unless the sniffer failed the check at init, in which
+// case (and for polled transfers) the table CRC is used.
+bool spi_transfer_crc(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                      uint16_t *crc) {
+    myASSERT(tx || rx);
+    myASSERT(crc);
+    if (length > SPI_POLLED_MAX && pSPI->dma_crc) {
+        return spi_transfer_dma(pSPI, tx, rx, length, crc);
+    }
+    if (!spi_transfer(pSPI, tx, rx, length)) {
+        return false;
+    }
+    update_crc16(crc, (const char *)(rx ? rx : tx), length);
+    return true;
+}
+
+// Start a DMA transfer and return without waiting for it. When it completes,
+// done(ctx) is called from the DMA IRQ handler, after which spi_transfer_end
+// must be called (from thread context). If crc isn't NULL, the CRC16 in *crc is
+// updated with the data (rx if it isn't NULL, otherwise tx) by spi_transfer_end,
+// as for spi_transfer_crc (so *crc must stay valid).
+bool spi_transfer_start(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                        uint16_t *crc, void (*done)(void *ctx), void *ctx) {
+    myASSERT(tx || rx);
+    myASSERT(done && !pSPI->async_done);
+    pSPI->async_done = done;
+    pSPI->async_ctx = ctx;
+    pSPI->async_crc = crc;
+    pSPI->async_data = rx ? rx : tx;
+    pSPI->async_length = length;
+    pSPI->async_sniff = crc && pSPI->dma_crc;
+    spi_dma_start(pSPI, tx, rx, length, pSPI->async_sniff ? crc : NULL);
+    return true;
+}
+
+// Finish a transfer started with spi_transfer_start (updating its CRC16).
+void spi_transfer_end(spi_t *pSPI) {
+    myASSERT(!dma_channel_is_busy(pSPI->tx_dma));
+    myASSERT(!dma_channel_is_busy(pSPI->rx_dma));
+    if (pSPI->async_sniff) {
+        *pSPI->async_crc = spi_dma_sniffed_crc();
+    } else if (pSPI->async_crc) {
+        update_crc16(pSPI->async_crc, (const char *)pSPI->async_data, pSPI->async_length);
+    }
+    pSPI->async_done = NULL;
+}
+
+// Abort a transfer started with spi_transfer_start that didn't complete (done
+// isn't called, and its CRC16 isn't updated).
+void spi_transfer_abort(spi_t *pSPI) {
+    dma_channel_abort(pSPI->rx_dma);
+    dma_channel_abort(pSPI->tx_dma);
+    // An abort can raise the completion interrupt, so clear it
+    if (irqChannel1) {
+        dma_hw->ints1 = 1u << pSPI->rx_dma;
+    } else {
+        dma_hw->ints0 = 1u << pSPI->rx_dma;
+    }
+    if (pSPI->async_sniff) {
+        dma_sniffer_disable();
+    }
+    pSPI->async_done = NULL;
+}
+
+// Check that the DMA sniffer computes the same CRC16 as crc16() by sniffing a
+// memory to memory transfer of a test pattern on the TX channel. (How the CRC is
+// continued with the sniffer is checked by host crc_bench, on a model of the DMA.)
+static bool spi_dma_crc_check(spi_t *pSPI) {
+    uint8_t pattern[64];
+    static uint8_t sink;
+    for (size_t i = 0; i < sizeof pattern; ++i) {
+        pattern[i] = (uint8_t)(i * 37 + 11);
+    }
+    dma_channel_config cfg = dma_channel_get_default_config(pSPI->tx_dma);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_sniff_enable(&cfg, true);
+    dma_sniffer_enable(pSPI->tx_dma, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false);
+    dma_sniffer_set_data_accumulator(0);
+    dma_channel_configure(pSPI->tx_dma, &cfg, &sink, pattern, sizeof pattern, true);
+    dma_channel_wait_for_finish_blocking(pSPI->tx_dma);
+    uint16_t dma_crc = (uint16_t)dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    uint16_t tbl_crc = crc16((const char *)pattern, sizeof pattern);
+    if (dma_crc != tbl_crc) {
+        DBG_PRINTF("%s: DMA sniffer CRC 0x%04x != 0x%04x, using the table CRC\n",
+                   __FUNCTION__, dma_crc, tbl_crc);
+        return false;
+    }
     return true;
 }
 
@@ -191,6 +361,9 @@ bool my_spi_init(spi_t *pSPI) {
                                                        : DREQ_SPI0_RX);
         channel_config_set_read_increment(&pSPI->rx_dma_cfg, false);
 
+        // Use the DMA sniffer for the data CRC if it agrees with the table CRC
+        pSPI->dma_crc = spi_dma_crc_check(pSPI);
+
         /* Theory: we only need an interrupt on rx complete,
         since if rx is complete, tx must also be complete. */
 
@@ -30,6 +30,14 @@ specific language governing permissions and limitations under the License.
 
 #define SPI_FILL_CHAR (0xFF)
 
+// Transfers of this many bytes or less are done by polling the SPI FIFOs.
+// For command bytes, R1 polls, tokens and CRCs, setting up the DMA channels and
+// waiting for the completion interrupt takes much longer than the transfer itself.
+// DMA is used for the data blocks.
+#ifndef SPI_POLLED_MAX
+#define SPI_POLLED_MAX 16
+#endif
+
 // "Class" representing SPIs
 typedef struct {
     // SPI HW
@@ -54,6 +62,14 @@ typedef struct {
     dma_channel_config rx_dma_cfg;
     irq_handler_t dma_isr;
     bool initialized;
+    bool dma_crc;  // The DMA sniffer CRC16 agrees with crc16() (checked at init)
+    // Asynchronous transfer in progress (see spi_transfer_start):
+    void (*async_done)(void *ctx);  // Called from the DMA IRQ when it completes
+    void *async_ctx;
+    uint16_t *async_crc;            // CRC16 to update with the data (or NULL)
+    const uint8_t *async_data;      // Data to compute the CRC16 of (without the sniffer)
+    size_t async_length;
+    bool async_sniff;               // The sniffer is computing the CRC16
     semaphore_t sem;
     mutex_t mutex;
 } spi_t;
@@ -66,6 +82,12 @@ extern "C" {
 void __not_in_flash_func(spi_irq_handler)(spi_t *pSPI);
 
 bool __not_in_flash_func(spi_transfer)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);
+bool __not_in_flash_func(spi_transfer_polled)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);
+bool __not_in_flash_func(spi_transfer_crc)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length, uint16_t *crc);
+bool __not_in_flash_func(spi_transfer_start)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                                             uint16_t *crc, void (*done)(void *ctx), void *ctx);
+void __not_in_flash_func(spi_transfer_end)(spi_t *pSPI);
+void spi_transfer_abort(spi_t *pSPI);
 void spi_lock(spi_t *pSPI);
 void spi_unlock(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
@@ -27,6 +27,7 @@ specific language governing permissions and limitations under the License.
 //
 #include "hw_config.h"
 #include "my_debug.h"
+#include "sd_cache.h"
 #include "sd_card.h"
 
 //#define TRACE_PRINTF(fmt, args...)
@@ -41,7 +42,7 @@ DSTATUS disk_status(BYTE pdrv /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    sd_card_detect(p_sd);   // Fast: just a GPIO read
+    sd_card_detect(p_sd);   // A GPIO read, or a poll of the card when it's idle
     return p_sd->m_Status;  // See http://elm-chan.org/fsw/ff/doc/dstat.html
 }
 
@@ -67,13 +68,14 @@ static int sdrc2dresult(int sd_rc) {
         case SD_BLOCK_DEVICE_ERROR_NO_INIT:
         case SD_BLOCK_DEVICE_ERROR_NO_DEVICE:
             return RES_NOTRDY;
+        case SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK:  // Not sticky (the card is only busy)
+            return RES_NOTRDY;
         case SD_BLOCK_DEVICE_ERROR_PARAMETER:
         case SD_BLOCK_DEVICE_ERROR_UNSUPPORTED:
             return RES_PARERR;
         case SD_BLOCK_DEVICE_ERROR_WRITE_PROTECTED:
             return RES_WRPRT;
         case SD_BLOCK_DEVICE_ERROR_CRC:
-        case SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK:
         case SD_BLOCK_DEVICE_ERROR_ERASE:
         case SD_BLOCK_DEVICE_ERROR_WRITE:
         default:
@@ -93,7 +95,8 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = sd_read_blocks(p_sd, buff, sector, count);
+    sd_async_wait(p_sd);  // FatFs can't wait for an asynchronous transfer to finish
+    int rc = sd_cache_read(p_sd, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -111,7 +114,8 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = sd_write_blocks(p_sd, buff, sector, count);
+    sd_async_wait(p_sd);
+    int rc = sd_cache_write(p_sd, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -128,6 +132,7 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+    sd_async_wait(p_sd);
     switch (cmd) {
         case GET_SECTOR_COUNT: {  // Retrieves number of available sectors, the
                                   // largest allowable LBA + 1, on the drive
@@ -151,12 +156,35 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // The card's allocation unit (from the SD Status), as the
+            // largest power of 2 (up to 32768) it's a multiple of
+            DWORD bs = 1;
+            if (p_sd->au_sectors) {
+                bs = p_sd->au_sectors & -p_sd->au_sectors;
+                if (bs > 32768) bs = 32768;
+            }
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
-            return RES_OK;
+        case CTRL_SYNC: {  // Write back the cached sectors, and complete a
+                           // streamed (still open) write
+            int rc = sd_cache_flush(p_sd);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = sd_sync(p_sd);
+            return sdrc2dresult(rc);
+        }
+#if FF_USE_TRIM
+        case CTRL_TRIM: {  // Informs the device that the data on the block of
+                           // sectors is no longer needed. buff points to an
+                           // LBA_t array: the start and end (inclusive) sectors.
+                           // Used by f_unlink, f_truncate and f_mkfs (on
+                           // clusters that are freed).
+            LBA_t *range = (LBA_t *)buff;
+            if (range[1] < range[0]) return RES_PARERR;
+            sd_cache_discard(p_sd, range[0], range[1] - range[0] + 1);
+            return sdrc2dresult(
+                sd_erase_blocks(p_sd, range[0], range[1] - range[0] + 1));
+        }
+#endif
         default:
             return RES_PARERR;
     }
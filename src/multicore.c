@@ -17,25 +17,75 @@
 #include "picoutil.h"
 
 #include "pico/multicore.h"
+#include "hardware/sync.h"
 #include "pico/util/queue.h"
 
 #include <stdio.h>
 #include <string.h>
 
-#define CORE0_QUEUE_NP_ENTRIES_MAX 64
-#define CORE0_QUEUE_LP_ENTRIES_MAX 8
-#define CORE1_QUEUE_NP_ENTRIES_MAX 64
-#define CORE1_QUEUE_LP_ENTRIES_MAX 8
-
 static int32_t _msg_num;
 // Flag indicating that we don't want to panic if we can't add a message to a queue.
 // (the following are global to aid with debugging)
 bool    _no_qadd_panic;
 int     _c0_reqmsg_post_errs;
 int     _c1_reqmsg_post_errs;
+int     _cany_reqmsg_post_errs;
 
 queue_t _core0_queue;
 queue_t _core1_queue;
+queue_t _coreany_queue;     // Shared work queue for messages that can be handled by either core
+
+/** @brief Message queue control (sizes, statistics, backpressure). */
+typedef struct mc_queue_ctl_ {
+    queue_t* queue;
+    uint16_t size;
+    uint16_t bp_high;
+    uint16_t bp_low;
+    volatile uint16_t hwm;
+    volatile uint32_t posted;
+    volatile uint32_t full;
+    volatile uint32_t dropped;
+    volatile uint32_t waited;
+    volatile uint32_t bp_events;
+    volatile bool bp_asserted;
+    mc_backpressure_fn bp_fn;
+} mc_queue_ctl_t;
+
+static mc_queue_ctl_t _qctl[MCQ_CNT];
+static spin_lock_t* _qctl_lock;     // Guards the FIFO queue adds/removes with their statistics and backpressure
+
+/** @brief Deadline queue for a core. Kept in deadline order with the earliest at the end. */
+typedef struct mc_dl_queue_ {
+    cmt_msg_t msgs[MC_DEADLINE_QUEUE_ENTRIES];
+    volatile uint16_t level;
+} mc_dl_queue_t;
+
+static mc_dl_queue_t _dl_queues[2];
+static spin_lock_t* _dlq_lock;      // Guards the deadline queues (posted to from either core and irq handlers)
+
+/** @brief State of a cross-core RPC slot. */
+typedef enum RPC_STATE_ {
+    RPCS_FREE = 0,
+    RPCS_PENDING,       // Request posted to the target core
+    RPCS_RUNNING,       // Handler running on the target core
+    RPCS_COMPLETE,      // Completion posted to the requesting core
+    RPCS_ABANDONED,     // Timed out (the target core will free it)
+} rpc_state_t;
+
+/** @brief Cross-core RPC request slot. */
+typedef struct rpc_slot_ {
+    volatile rpc_state_t state;
+    uint8_t caller_core;
+    uint16_t seq;
+    int32_t timer_id;   // Timeout (µs timer) or 0 for none
+    rpc_done_fn done_fn;
+    void* user_data;
+    cmt_msg_t msg;
+} rpc_slot_t;
+
+static spin_lock_t* _rpc_lock;      // Guards the RPC slot claims and state changes (both cores and the timeout)
+static rpc_slot_t _rpc_slots[RPC_INFLIGHT_MAX];
+static uint16_t _rpc_seq;
 
 static void _copy_and_set_num_ts(cmt_msg_t* msg, const cmt_msg_t* msgsrc) {
     memcpy(msg, msgsrc, sizeof(cmt_msg_t));
@@ -44,17 +94,278 @@ static void _copy_and_set_num_ts(cmt_msg_t* msg, const cmt_msg_t* msgsrc) {
 }
 
 
+static void _post_to_core(uint8_t corenum, const cmt_msg_t* msg) {
+    if (corenum == 0) {
+        post_to_core0(msg);
+    }
+    else {
+        post_to_core1(msg);
+    }
+}
+
+/**
+ * @brief Get the slot for an RPC ID (the low byte is the index, the upper bits the sequence).
+ *
+ * @return rpc_slot_t* The slot, or NULL if the ID is not for the current use of the slot.
+ */
+static rpc_slot_t* _rpc_slot(uint32_t id) {
+    uint idx = (id & 0xFF);
+    if (idx < RPC_INFLIGHT_MAX && _rpc_slots[idx].seq == (uint16_t)(id >> 8) && _rpc_slots[idx].state != RPCS_FREE) {
+        return (&_rpc_slots[idx]);
+    }
+    return (NULL);
+}
+
+static rpc_state_t _rpc_state_change(rpc_slot_t* slot, rpc_state_t from, rpc_state_t to) {
+    uint32_t flags = spin_lock_blocking(_rpc_lock);
+    rpc_state_t was = slot->state;
+    if (was == from) {
+        slot->state = to;
+    }
+    spin_unlock(_rpc_lock, flags);
+    return (was);
+}
+
+static void _rpc_done_hdlr(cmt_msg_t* msg) {
+    // Runs on the requesting core.
+    rpc_slot_t* slot = _rpc_slot(msg->data.value32u);
+    if (slot && slot->state == RPCS_COMPLETE) {
+        if (slot->timer_id > 0) {
+            cmt_us_timer_cancel(slot->timer_id);
+        }
+        if (slot->done_fn) {
+            slot->done_fn(&slot->msg, RPC_DONE, slot->user_data);
+        }
+        slot->state = RPCS_FREE;
+    }
+}
+
+static void _rpc_exec_hdlr(cmt_msg_t* msg) {
+    // Runs on the target core.
+    uint32_t id = msg->data.value32u;
+    rpc_slot_t* slot = _rpc_slot(id);
+    if (!slot) {
+        return;
+    }
+    if (_rpc_state_change(slot, RPCS_PENDING, RPCS_RUNNING) != RPCS_PENDING) {
+        // Timed out before it was run.
+        slot->state = RPCS_FREE;
+        return;
+    }
+    slot->msg.hdlr(&slot->msg);
+    if (_rpc_state_change(slot, RPCS_RUNNING, RPCS_COMPLETE) != RPCS_RUNNING) {
+        // Timed out while running. The requester has been told, so just free it.
+        slot->state = RPCS_FREE;
+        return;
+    }
+    cmt_msg_t done_msg;
+    cmt_exec_init(&done_msg, _rpc_done_hdlr);
+    done_msg.data.value32u = id;
+    _post_to_core(slot->caller_core, &done_msg);
+}
+
+static void _rpc_timeout_hdlr(cmt_msg_t* msg) {
+    // Runs on the requesting core.
+    rpc_slot_t* slot = _rpc_slot(msg->data.value32u);
+    if (!slot) {
+        return; // Completed (this is a stale timeout)
+    }
+    rpc_state_t was = _rpc_state_change(slot, RPCS_PENDING, RPCS_ABANDONED);
+    if (was == RPCS_RUNNING) {
+        was = _rpc_state_change(slot, RPCS_RUNNING, RPCS_ABANDONED);
+    }
+    if (was == RPCS_PENDING || was == RPCS_RUNNING) {
+        if (slot->done_fn) {
+            slot->done_fn(&slot->msg, RPC_TIMEOUT, slot->user_data);
+        }
+    }
+}
+
+static void _queue_ctl_init(mc_queue_id_t qid, queue_t* queue, uint16_t size) {
+    mc_queue_ctl_t* qc = &_qctl[qid];
+    memset(qc, 0, sizeof(mc_queue_ctl_t));
+    qc->queue = queue;
+    qc->size = size;
+    qc->bp_high = (uint16_t)((size * MC_QUEUE_BP_HIGH_PCT) / 100);
+    qc->bp_low = (uint16_t)((size * MC_QUEUE_BP_LOW_PCT) / 100);
+}
+
+static uint _queue_level(mc_queue_id_t qid) {
+    if (qid == MCQ_CORE0_DL || qid == MCQ_CORE1_DL) {
+        return (_dl_queues[qid - MCQ_CORE0_DL].level);
+    }
+    return (queue_get_level(_qctl[qid].queue));
+}
+
+/**
+ * @brief Add a message to a core's deadline queue, in deadline order.
+ *
+ * Messages with the same deadline are kept in the order they were posted.
+ *
+ * @param corenum The core
+ * @param m The message (numbered and timestamped, with a deadline)
+ * @return true If added, false if the deadline queue is full
+ */
+static bool _dl_queue_add(uint8_t corenum, const cmt_msg_t* m) {
+    mc_queue_ctl_t* qc = &_qctl[MCQ_CORE0_DL + corenum];
+    mc_dl_queue_t* dlq = &_dl_queues[corenum];
+    uint32_t flags = spin_lock_blocking(_dlq_lock);
+    uint16_t level = dlq->level;
+    bool posted = (level < MC_DEADLINE_QUEUE_ENTRIES);
+    if (posted) {
+        // Move the messages that are due before (or with) this one toward the end.
+        int i = level;
+        while (i > 0 && (int32_t)(dlq->msgs[i - 1].deadline - m->deadline) <= 0) {
+            dlq->msgs[i] = dlq->msgs[i - 1];
+            i--;
+        }
+        dlq->msgs[i] = *m;
+        dlq->level = ++level;
+        qc->posted++;
+        if (level > qc->hwm) {
+            qc->hwm = level;
+        }
+    }
+    else {
+        qc->full++;
+    }
+    spin_unlock(_dlq_lock, flags);
+    return (posted);
+}
+
+/**
+ * @brief Add a message to a queue, tracking the high-water mark and backpressure.
+ *
+ * The statistics and backpressure state are updated under the same lock as the add,
+ * so they are consistent when both cores (and interrupt handlers) post. The backpressure
+ * function is called after the lock is released.
+ *
+ * @param qid The queue
+ * @param m The message (numbered and timestamped)
+ * @param count_full Count a failure in the queue's 'full' count
+ * @return true If added
+ */
+static bool _queue_add(mc_queue_id_t qid, const cmt_msg_t* m, bool count_full) {
+    if (m->deadline != 0 && (qid == MCQ_CORE0 || qid == MCQ_CORE1) && _dl_queue_add((uint8_t)qid, m)) {
+        return (true);
+    }
+    mc_queue_ctl_t* qc = &_qctl[qid];
+    bool bp_on = false;
+    uint32_t flags = spin_lock_blocking(_qctl_lock);
+    register bool posted = queue_try_add(qc->queue, m);
+    if (posted) {
+        uint level = queue_get_level(qc->queue);
+        qc->posted++;
+        if (level > qc->hwm) {
+            qc->hwm = level;
+        }
+        if (!qc->bp_asserted && level >= qc->bp_high) {
+            qc->bp_asserted = true;
+            qc->bp_events++;
+            bp_on = true;
+        }
+    }
+    else if (count_full) {
+        qc->full++;
+    }
+    spin_unlock(_qctl_lock, flags);
+    if (bp_on && qc->bp_fn) {
+        qc->bp_fn(qid, true);
+    }
+    return (posted);
+}
+
+/**
+ * @brief Count a message that couldn't be posted (it is lost).
+ */
+static void _queue_dropped(mc_queue_id_t qid) {
+    uint32_t flags = spin_lock_blocking(_qctl_lock);
+    _qctl[qid].dropped++;
+    spin_unlock(_qctl_lock, flags);
+}
+
+/**
+ * @brief Add a message to a queue, waiting up to a time limit for room.
+ *
+ * Waiting is only done if the queue isn't the calling core's own queue, as only
+ * the owning core can make room in it.
+ */
+static bool _queue_add_wait(mc_queue_id_t qid, const cmt_msg_t* m, uint32_t timeout_us) {
+    if (_queue_add(qid, m, true)) {
+        return (true);
+    }
+    if (timeout_us == 0 || (uint)qid == get_core_num()) {
+        _queue_dropped(qid);
+        return (false);
+    }
+    uint32_t flags = spin_lock_blocking(_qctl_lock);
+    _qctl[qid].waited++;
+    spin_unlock(_qctl_lock, flags);
+    absolute_time_t timeout_time = make_timeout_time_us(timeout_us);
+    do {
+        tight_loop_contents();
+        if (_queue_add(qid, m, false)) {
+            return (true);
+        }
+    } while (!time_reached(timeout_time));
+    _queue_dropped(qid);
+    return (false);
+}
+
+/**
+ * @brief Take a message from a queue, releasing backpressure when it has drained.
+ */
+static bool _queue_remove(mc_queue_id_t qid, cmt_msg_t* msg) {
+    mc_queue_ctl_t* qc = &_qctl[qid];
+    bool bp_off = false;
+    uint32_t flags = spin_lock_blocking(_qctl_lock);
+    register bool retrieved = queue_try_remove(qc->queue, msg);
+    if (retrieved && qc->bp_asserted && queue_get_level(qc->queue) <= qc->bp_low) {
+        qc->bp_asserted = false;
+        bp_off = true;
+    }
+    spin_unlock(_qctl_lock, flags);
+    if (bp_off && qc->bp_fn) {
+        qc->bp_fn(qid, false);
+    }
+    return (retrieved);
+}
+
+/**
+ * @brief Handle a failed post to a core queue (or the Core-Any queue). Panics (debug)
+ * showing what is in the queue and the message the core (or each core) is running.
+ */
+static void _post_failed(mc_queue_id_t qid, const cmt_msg_t* m) {
+    if (MC_QUEUE_FULL_PANIC && !_no_qadd_panic) {
+        // We are going to halt (board panic), so print the message that is
+        // currently being processed by the core.
+        save_and_disable_interrupts();
+        uint8_t pid = lowByte(m->id);
+        // Read and print all of the messages in the queue.
+        cmt_msg_t cmsg;
+        while (queue_try_remove(_qctl[qid].queue, &cmsg)) {
+            printf("\n %02X", (unsigned int)cmsg.id);
+        }
+        if (qid == MCQ_ANY) {
+            // Either core takes from the shared queue, so show what both are doing.
+            printf("\nReq Core-Any msg '%02X' could not post. Current/Last C0 msg: %02X C1 msg: %02X\n", (unsigned int)pid,
+                (unsigned int)lowByte(cmt_curlast_msg(0)), (unsigned int)lowByte(cmt_curlast_msg(1)));
+        }
+        else {
+            int corenum = (qid == MCQ_CORE0 ? 0 : 1);
+            uint8_t id = lowByte(cmt_curlast_msg(corenum));
+            printf("\nReq Core%d msg '%02X' could not post. Current/Last C%d msg: %02X\n", corenum, (unsigned int)pid, corenum, (unsigned int)id);
+        }
+        board_panic("!!! HALTING !!!");
+    }
+}
+
 void get_core0_msg_blocking(cmt_msg_t* msg) {
     queue_remove_blocking(&_core0_queue,msg);
 }
 
 bool get_core0_msg_nowait(cmt_msg_t* msg) {
-    // If no messages exist return false.
-    register bool retrieved = false;
-    uint32_t flags = save_and_disable_interrupts();
-    retrieved = queue_try_remove(&_core0_queue, msg);
-    restore_interrupts_from_disabled(flags);
-    return (retrieved);
+    return (_queue_remove(MCQ_CORE0, msg));
 }
 
 void get_core1_msg_blocking(cmt_msg_t* msg) {
@@ -62,84 +373,199 @@ void get_core1_msg_blocking(cmt_msg_t* msg) {
 }
 
 bool get_core1_msg_nowait(cmt_msg_t* msg) {
-    // If no messages exist return false.
-    register bool retrieved = false;
-    uint32_t flags = save_and_disable_interrupts();
-    retrieved = queue_try_remove(&_core1_queue, msg);
-    restore_interrupts_from_disabled(flags);
+    return (_queue_remove(MCQ_CORE1, msg));
+}
+
+bool get_coreany_msg_nowait(cmt_msg_t* msg) {
+    return (_queue_remove(MCQ_ANY, msg));
+}
+
+bool get_core_deadline_msg_nowait(uint8_t corenum, cmt_msg_t* msg) {
+    mc_dl_queue_t* dlq = &_dl_queues[corenum & 0x01];
+    if (dlq->level == 0) {
+        return (false);
+    }
+    uint32_t flags = spin_lock_blocking(_dlq_lock);
+    uint16_t level = dlq->level;
+    bool retrieved = (level > 0);
+    if (retrieved) {
+        *msg = dlq->msgs[--level];
+        dlq->level = level;
+    }
+    spin_unlock(_dlq_lock, flags);
     return (retrieved);
 }
 
+uint get_core_msg_queue_level(uint8_t corenum) {
+    return (queue_get_level(corenum == 0 ? &_core0_queue : &_core1_queue));
+}
+
+bool multicore_queue_stats(mc_queue_id_t qid, mc_queue_stats_t* stats) {
+    if (qid >= MCQ_CNT) {
+        return (false);
+    }
+    mc_queue_ctl_t* qc = &_qctl[qid];
+    spin_lock_t* lock = ((qid == MCQ_CORE0_DL || qid == MCQ_CORE1_DL) ? _dlq_lock : _qctl_lock);
+    uint32_t flags = spin_lock_blocking(lock);
+    stats->size = qc->size;
+    stats->level = (uint16_t)_queue_level(qid);
+    stats->hwm = qc->hwm;
+    stats->posted = qc->posted;
+    stats->full = qc->full;
+    stats->dropped = qc->dropped;
+    stats->waited = qc->waited;
+    stats->bp_events = qc->bp_events;
+    stats->bp_asserted = qc->bp_asserted;
+    spin_unlock(lock, flags);
+    return (true);
+}
+
+void multicore_queue_stats_reset() {
+    for (int i = 0; i < MCQ_CNT; i++) {
+        mc_queue_ctl_t* qc = &_qctl[i];
+        spin_lock_t* lock = ((i == MCQ_CORE0_DL || i == MCQ_CORE1_DL) ? _dlq_lock : _qctl_lock);
+        uint32_t flags = spin_lock_blocking(lock);
+        qc->hwm = (uint16_t)_queue_level((mc_queue_id_t)i);
+        qc->posted = 0;
+        qc->full = 0;
+        qc->dropped = 0;
+        qc->waited = 0;
+        qc->bp_events = 0;
+        spin_unlock(lock, flags);
+    }
+}
+
+void multicore_set_backpressure_fn(mc_queue_id_t qid, mc_backpressure_fn fn) {
+    if (qid < MCQ_CNT && _qctl[qid].queue) {
+        _qctl[qid].bp_fn = fn;
+    }
+}
+
 void post_to_core0(const cmt_msg_t* msg) {
     cmt_msg_t m; // queue_add copies the contents, so 'm' on the stack is okay.
     _copy_and_set_num_ts(&m, msg);
-    uint32_t flags = save_and_disable_interrupts();
-    register bool posted = queue_try_add(&_core0_queue, &m);
-    restore_interrupts_from_disabled(flags);
-    if (!posted) {
+    if (!_queue_add(MCQ_CORE0, &m, true)) {
+        _queue_dropped(MCQ_CORE0);
         _c0_reqmsg_post_errs++;
-        if (!_no_qadd_panic) {
-            // We are going to halt (board panic), so print the message that is
-            // currently being processed by Core1.
-            save_and_disable_interrupts();
-            uint8_t id = lowByte(cmt_curlast_msg(1));
-            uint8_t pid = lowByte(m.id);
-            // Read and print all of the messages in the C1 queue.
-            cmt_msg_t cmsg;
-            while (queue_try_remove(&_core0_queue, &cmsg)) {
-                printf("\n %02X", (unsigned int)cmsg.id);
-            }
-            printf("\nReq Core0 msg '%02X' could not post. Current/Last C0 msg: %02X\n", (unsigned int)pid, (unsigned int)id);
-            board_panic("!!! HALTING !!!");
-        }
+        _post_failed(MCQ_CORE0, &m);
     }
 }
 
 bool post_to_core0_nowait(const cmt_msg_t* msg) {
     cmt_msg_t m; // queue_add copies the contents, so on the stack is okay.
     _copy_and_set_num_ts(&m, msg);
-    register bool posted = false;
-    uint32_t flags = save_and_disable_interrupts();
-    posted = queue_try_add(&_core0_queue, &m);
-    restore_interrupts_from_disabled(flags);
+    if (!_queue_add(MCQ_CORE0, &m, true)) {
+        _queue_dropped(MCQ_CORE0);
+        return (false);
+    }
+    return (true);
+}
 
-    return (posted);
+bool post_to_core0_wait(const cmt_msg_t* msg, uint32_t timeout_us) {
+    cmt_msg_t m; // queue_add copies the contents, so on the stack is okay.
+    _copy_and_set_num_ts(&m, msg);
+    return (_queue_add_wait(MCQ_CORE0, &m, timeout_us));
 }
 
 void post_to_core1(const cmt_msg_t* msg) {
     cmt_msg_t m; // queue_add copies the contents, so 'm' on the stack is okay.
     _copy_and_set_num_ts(&m, msg);
-    uint32_t flags = save_and_disable_interrupts();
-    register bool posted = queue_try_add(&_core1_queue, &m);
-    restore_interrupts_from_disabled(flags);
-    if (!posted) {
+    if (!_queue_add(MCQ_CORE1, &m, true)) {
+        _queue_dropped(MCQ_CORE1);
         _c1_reqmsg_post_errs++;
-        if (!_no_qadd_panic) {
-            // We are going to halt (board panic), so print the message that is
-            // currently being processed by Core1.
-            save_and_disable_interrupts();
-            uint8_t id = lowByte(cmt_curlast_msg(1));
-            uint8_t pid = lowByte(m.id);
-            // Read and print all of the messages in the C1 queue.
-            cmt_msg_t cmsg;
-            while (queue_try_remove(&_core1_queue, &cmsg)) {
-                printf("\n %02X", (unsigned int)cmsg.id);
-            }
-            printf("\nReq Core1 msg '%02X' could not post. Current/Last C1 msg: %02X\n", (unsigned int)pid, (unsigned int)id);
-            board_panic("!!! HALTING !!!");
-        }
+        _post_failed(MCQ_CORE1, &m);
     }
 }
 
 bool post_to_core1_nowait(const cmt_msg_t* msg) {
     cmt_msg_t m; // queue_add copies the contents, so 'm' on the stack is okay.
     _copy_and_set_num_ts(&m, msg);
-    register bool posted = false;
-    uint32_t flags = save_and_disable_interrupts();
-    posted = queue_try_add(&_core1_queue, &m);
-    restore_interrupts_from_disabled(flags);
+    if (!_queue_add(MCQ_CORE1, &m, true)) {
+        _queue_dropped(MCQ_CORE1);
+        return (false);
+    }
+    return (true);
+}
 
-    return (posted);
+bool post_to_core1_wait(const cmt_msg_t* msg, uint32_t timeout_us) {
+    cmt_msg_t m; // queue_add copies the contents, so on the stack is okay.
+    _copy_and_set_num_ts(&m, msg);
+    return (_queue_add_wait(MCQ_CORE1, &m, timeout_us));
+}
+
+void post_to_coreany(const cmt_msg_t* msg) {
+    cmt_msg_t m; // queue_add copies the contents, so 'm' on the stack is okay.
+    _copy_and_set_num_ts(&m, msg);
+    if (!_queue_add(MCQ_ANY, &m, true)) {
+        _queue_dropped(MCQ_ANY);
+        _cany_reqmsg_post_errs++;
+        _post_failed(MCQ_ANY, &m);
+    }
+}
+
+bool post_to_coreany_nowait(const cmt_msg_t* msg) {
+    cmt_msg_t m; // queue_add copies the contents, so 'm' on the stack is okay.
+    _copy_and_set_num_ts(&m, msg);
+    if (!_queue_add(MCQ_ANY, &m, true)) {
+        _queue_dropped(MCQ_ANY);
+        return (false);
+    }
+    return (true);
+}
+
+
+int32_t rpc_on_core(uint8_t corenum, const cmt_msg_t* msg, rpc_done_fn done_fn, void* user_data, int32_t timeout_ms) {
+    if (!msg->hdlr) {
+        board_panic("!!! rpc_on_core no handler in msg !!!");
+    }
+    int32_t id = -1;
+    uint32_t flags = spin_lock_blocking(_rpc_lock);
+    for (int i = 0; i < RPC_INFLIGHT_MAX; i++) {
+        rpc_slot_t* slot = &_rpc_slots[i];
+        if (slot->state == RPCS_FREE) {
+            slot->state = RPCS_PENDING;
+            slot->seq = ++_rpc_seq;
+            slot->caller_core = (uint8_t)get_core_num();
+            slot->timer_id = 0;
+            slot->done_fn = done_fn;
+            slot->user_data = user_data;
+            memcpy(&slot->msg, msg, sizeof(cmt_msg_t));
+            id = (int32_t)(((uint32_t)slot->seq << 8) | i);
+            break;
+        }
+    }
+    spin_unlock(_rpc_lock, flags);
+    if (id < 0) {
+        return (id);
+    }
+    if (timeout_ms > 0) {
+        // The timeout is cancelled when the RPC completes, so it doesn't hold a timer.
+        cmt_msg_t to_msg;
+        cmt_exec_init(&to_msg, _rpc_timeout_hdlr);
+        to_msg.data.value32u = (uint32_t)id;
+        int32_t timer_id = schedule_msg_in_us((uint32_t)timeout_ms * 1000, &to_msg);
+        if (timer_id < 0) {
+            _rpc_slots[id & 0xFF].state = RPCS_FREE;
+            return (-1);
+        }
+        _rpc_slots[id & 0xFF].timer_id = timer_id;
+    }
+    cmt_msg_t req_msg;
+    cmt_exec_init(&req_msg, _rpc_exec_hdlr);
+    req_msg.data.value32u = (uint32_t)id;
+    _post_to_core(corenum & 0x01, &req_msg);
+
+    return (id);
+}
+
+int rpc_inflight() {
+    int cnt = 0;
+    for (int i = 0; i < RPC_INFLIGHT_MAX; i++) {
+        if (_rpc_slots[i].state != RPCS_FREE) {
+            cnt++;
+        }
+    }
+    return (cnt);
 }
 
 void runon_core0(const cmt_msg_t* msg) {
@@ -196,8 +622,18 @@ void multicore_modinit(bool no_qadd_panic) {
     _no_qadd_panic = no_qadd_panic;
     _c0_reqmsg_post_errs = 0;
     _c1_reqmsg_post_errs = 0;
+    _cany_reqmsg_post_errs = 0;
     multicore_fifo_drain();
-    queue_init(&_core0_queue, sizeof(cmt_msg_t), CORE0_QUEUE_NP_ENTRIES_MAX);
-    queue_init(&_core1_queue, sizeof(cmt_msg_t), CORE1_QUEUE_NP_ENTRIES_MAX);
+    queue_init(&_core0_queue, sizeof(cmt_msg_t), CORE0_QUEUE_ENTRIES);
+    queue_init(&_core1_queue, sizeof(cmt_msg_t), CORE1_QUEUE_ENTRIES);
+    queue_init(&_coreany_queue, sizeof(cmt_msg_t), COREANY_QUEUE_ENTRIES);
+    _queue_ctl_init(MCQ_CORE0, &_core0_queue, CORE0_QUEUE_ENTRIES);
+    _queue_ctl_init(MCQ_CORE1, &_core1_queue, CORE1_QUEUE_ENTRIES);
+    _queue_ctl_init(MCQ_ANY, &_coreany_queue, COREANY_QUEUE_ENTRIES);
+    _dlq_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    _qctl_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    _rpc_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    _queue_ctl_init(MCQ_CORE0_DL, NULL, MC_DEADLINE_QUEUE_ENTRIES);
+    _queue_ctl_init(MCQ_CORE1_DL, NULL, MC_DEADLINE_QUEUE_ENTRIES);
 }
 
@@ -42,7 +42,7 @@ extern "C" {
 #define SPI_SD_SCK              GP26
 #define SPI_SD_CS               GP17
 #define SPI_SLOW_SPEED          (50 * 1000)     // Very slow speed for init ops
-#define SPI_SD_SPEED            (800 * 1000)    // SPI at 800KHz
+#define SPI_SD_SPEED            (25 * 1000 * 1000) // SPI max (the rate is negotiated at init)
 #define SPI_CS_ENABLE           0               // Chip Select is active LOW
 #define SPI_CS_DISABLE          1               // Chip Select is active LOW
 
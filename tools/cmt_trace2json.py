@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+Convert a CMT message dispatch trace dump into Chrome/Perfetto trace JSON.
+
+The dump is the terminal output of the `.cmttrace dump` shell command (a log of
+the whole session is fine, only the lines between 'CMTTRACE 1' and 'CMTTRACE END'
+are used). Handler addresses are symbolised using the ELF that is running on the
+board, and message IDs are named from 'cmt_t.h'.
+
+Usage:
+    cmt_trace2json.py [-e dkr_db.elf] [-m src/cmt/include/cmt_t.h] [-o trace.json] dump.txt
+
+Load the output in https://ui.perfetto.dev or chrome://tracing
+
+Copyright 2023-26 AESilky
+SPDX-License-Identifier: MIT License
+"""
+
+import argparse
+import bisect
+import json
+import re
+import struct
+import subprocess
+import sys
+
+# Must match `cmt_trace_rec_t` in cmt.h
+REC_FMT = "<IIIBBH"
+REC_SIZE = struct.calcsize(REC_FMT)
+FLG_CORE = 0x01
+FLG_RUNON = 0x02
+
+
+def read_dump(path):
+    """Return the list of (core, t_start, duration, hdlr, msg_id, flags, qdepth) records."""
+    recs = []
+    in_dump = False
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith("CMTTRACE "):
+                in_dump = (line != "CMTTRACE END")
+                continue
+            if not in_dump or not line.startswith("CT "):
+                continue
+            parts = line.split()
+            if len(parts) != 3 or len(parts[2]) != REC_SIZE * 2:
+                print(f"Skipping malformed line: {line}", file=sys.stderr)
+                continue
+            t_start, duration, hdlr, msg_id, flags, qdepth = struct.unpack(REC_FMT, bytes.fromhex(parts[2]))
+            recs.append((flags & FLG_CORE, t_start, duration, hdlr, msg_id, flags, qdepth))
+    return recs
+
+
+def unwrap_times(recs):
+    """
+    The record times are the low 32 bits of the µs timer (wraps every ~71 minutes).
+    Each core's records are in order, so extend the times across any wrap.
+    """
+    out = []
+    for core in (0, 1):
+        last = None
+        high = 0
+        for r in (r for r in recs if r[0] == core):
+            if last is not None and r[1] < last:
+                high += 1 << 32
+            last = r[1]
+            out.append((r[0], r[1] + high) + r[2:])
+    return out
+
+
+def load_symbols(elf, nm):
+    """Return (sorted addresses, names) for the function symbols in the ELF."""
+    try:
+        res = subprocess.run([nm, "-n", "-C", elf], capture_output=True, text=True, check=True)
+    except (OSError, subprocess.CalledProcessError) as e:
+        print(f"Unable to read symbols from '{elf}': {e}", file=sys.stderr)
+        return [], []
+    addrs = []
+    names = []
+    for line in res.stdout.splitlines():
+        parts = line.split(maxsplit=2)
+        if len(parts) == 3 and parts[1] in "tTwW":
+            addrs.append(int(parts[0], 16))
+            names.append(parts[2])
+    return addrs, names
+
+
+def symbolise(addr, addrs, names):
+    if addr == 0:
+        return "(none)"
+    a = addr & ~1  # Clear the Thumb bit
+    i = bisect.bisect_right(addrs, a) - 1
+    if i < 0:
+        return f"0x{addr:08X}"
+    off = a - addrs[i]
+    return names[i] if off == 0 else f"{names[i]}+0x{off:X}"
+
+
+def load_msg_names(path):
+    """Parse the `msg_id_t` enum for the message names."""
+    names = {}
+    try:
+        with open(path, "r") as f:
+            text = f.read()
+    except OSError as e:
+        print(f"Unable to read message IDs from '{path}': {e}", file=sys.stderr)
+        return names
+    m = re.search(r"typedef\s+enum\s+MSG_ID_\s*\{(.*?)\}\s*msg_id_t", text, re.S)
+    if not m:
+        return names
+    value = -1
+    for line in m.group(1).splitlines():
+        line = line.split("//")[0].strip().rstrip(",")
+        if not line:
+            continue
+        em = re.match(r"(\w+)\s*(?:=\s*(\w+))?$", line)
+        if not em:
+            continue
+        value = int(em.group(2), 0) if em.group(2) else value + 1
+        names[value] = em.group(1)
+    return names
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Convert a CMT dispatch trace dump to Chrome trace JSON.")
+    ap.add_argument("dump", help="File containing the '.cmttrace dump' output")
+    ap.add_argument("-e", "--elf", help="ELF file for handler symbols")
+    ap.add_argument("-m", "--msgids", help="cmt_t.h for message ID names")
+    ap.add_argument("-o", "--output", default="-", help="Output file (default stdout)")
+    ap.add_argument("--nm", default="arm-none-eabi-nm", help="nm to use for the ELF")
+    args = ap.parse_args()
+
+    recs = unwrap_times(read_dump(args.dump))
+    if not recs:
+        print("No trace records found.", file=sys.stderr)
+        return 1
+    addrs, names = load_symbols(args.elf, args.nm) if args.elf else ([], [])
+    msg_names = load_msg_names(args.msgids) if args.msgids else {}
+
+    t0 = min(r[1] for r in recs)
+    events = [
+        {"ph": "M", "pid": 0, "name": "process_name", "args": {"name": "RP2040 CMT"}},
+        {"ph": "M", "pid": 0, "tid": 0, "name": "thread_name", "args": {"name": "Core 0"}},
+        {"ph": "M", "pid": 0, "tid": 1, "name": "thread_name", "args": {"name": "Core 1"}},
+    ]
+    for core, t_start, duration, hdlr, msg_id, flags, qdepth in sorted(recs, key=lambda r: r[1]):
+        hdlr_name = symbolise(hdlr, addrs, names) if addrs else f"0x{hdlr:08X}"
+        msg_name = msg_names.get(msg_id, f"MSG_{msg_id:02X}")
+        runon = bool(flags & FLG_RUNON)
+        events.append({
+            "ph": "X",
+            "pid": 0,
+            "tid": core,
+            "ts": t_start - t0,
+            "dur": duration,
+            "name": f"runon_core0 {hdlr_name}" if runon else msg_name,
+            "cat": "runon" if runon else "msg",
+            "args": {"msg_id": f"0x{msg_id:02X}", "handler": hdlr_name, "qdepth": qdepth},
+        })
+        if not runon:
+            events.append({
+                "ph": "C",
+                "pid": 0,
+                "ts": t_start - t0,
+                "name": f"Core {core} queue",
+                "args": {"depth": qdepth},
+            })
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, out, indent=1)
+    if out is not sys.stdout:
+        out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())